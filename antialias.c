@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "antialias.h"
+
+// budget is the most samples an edge pixel may take, the grid is the
+// largest square within it
+int antialias_init(antialias *aa, int budget, int contrast, int number_workers)
+{
+    int count;
+
+    aa->side = ANTIALIAS_MIN_SIDE;
+    while ((aa->side < ANTIALIAS_MAX_SIDE) && ((aa->side + 1) * (aa->side + 1) <= budget))
+        aa->side++;
+    aa->samples = aa->side * aa->side;
+    aa->contrast = (contrast < 1) ? 1 : contrast;
+
+    for (count = 0; count < aa->side; count++)
+        aa->offsets[count] = (count + 0.5) / aa->side - 0.5;
+
+    aa->number_workers = (number_workers < 1) ? 1 : number_workers;
+    aa->pixels = calloc(aa->number_workers, sizeof(unsigned long));
+    aa->refined = calloc(aa->number_workers, sizeof(unsigned long));
+    if ((aa->pixels == NULL) || (aa->refined == NULL))
+    {
+        fprintf(stderr, "Bad luck, out of memory\n");
+        return 2;
+    }
+
+    return 0;
+}
+
+// Whether the pixel at counts[x + y * stride] is on an edge. Only its
+// neighbours within the width x height block at counts are looked at.
+int antialias_edge(const antialias *aa, const int *counts, int stride, int width, int height, int x, int y)
+{
+    int value = counts[x + y * stride], difference, around_x, around_y;
+
+    for (around_y = y - 1; around_y <= y + 1; around_y++)
+    {
+        if ((around_y < 0) || (around_y >= height))
+            continue;
+        for (around_x = x - 1; around_x <= x + 1; around_x++)
+        {
+            if ((around_x < 0) || (around_x >= width))
+                continue;
+            difference = counts[around_x + around_y * stride] - value;
+            if ((difference >= aa->contrast) || (difference <= -aa->contrast))
+                return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Mean of the colors, channel by channel
+uint32_t antialias_average(const uint32_t *colors, int number)
+{
+    unsigned long red = 0, green = 0, blue = 0;
+    int count;
+
+    for (count = 0; count < number; count++)
+    {
+        red += (colors[count] >> 16) & 0xff;
+        green += (colors[count] >> 8) & 0xff;
+        blue += colors[count] & 0xff;
+    }
+
+    return 0xff000000u | (uint32_t) ((red + number / 2) / number) << 16 |
+           (uint32_t) ((green + number / 2) / number) << 8 | (uint32_t) ((blue + number / 2) / number);
+}
+
+void antialias_count(antialias *aa, int worker, int pixels, int refined)
+{
+    aa->pixels[worker % aa->number_workers] += pixels;
+    aa->refined[worker % aa->number_workers] += refined;
+}
+
+// Share of the pixels refined, and the samples taken against uniform
+// supersampling with the same grid
+void antialias_report(const antialias *aa, FILE *file)
+{
+    unsigned long pixels = 0, refined = 0;
+    int worker;
+
+    for (worker = 0; worker < aa->number_workers; worker++)
+    {
+        pixels += aa->pixels[worker];
+        refined += aa->refined[worker];
+    }
+    if (pixels == 0)
+        return;
+
+    fprintf(file, "Antialiasing: %.1f%% of the pixels refined, %.2f samples per pixel (%d uniform)\n",
+            100.0 * refined / pixels, 1.0 + (double) refined * aa->samples / pixels, aa->samples);
+}
+
+void antialias_release(antialias *aa)
+{
+    free(aa->pixels);
+    free(aa->refined);
+}
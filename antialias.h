@@ -0,0 +1,39 @@
+#ifndef ANTIALIAS_H
+#define ANTIALIAS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Sides of the sample grid, 2x2 to 8x8 samples per pixel
+#define ANTIALIAS_MIN_SIDE 2
+#define ANTIALIAS_MAX_SIDE 8
+
+// Adaptive supersampling. Only the pixels on an edge, whose count differs
+// by contrast or more from one of their eight neighbours, get more
+// samples: side x side of them at the centers of a regular grid over the
+// pixel, averaged in color like uniform supersampling does. Flat insides
+// and the far outside keep their single sample. Sample k of a pixel is
+// (offsets[k % side], offsets[k / side]) pixels away from the sample the
+// pixel had, which is in the middle of the grid.
+typedef struct antialias antialias;
+struct antialias
+{
+    int side;
+    int samples;
+    int contrast;
+    double offsets[ANTIALIAS_MAX_SIDE];
+
+    // Pixels looked at and refined by each worker, for the report
+    unsigned long *pixels;
+    unsigned long *refined;
+    int number_workers;
+};
+
+int antialias_init(antialias *aa, int budget, int contrast, int number_workers);
+int antialias_edge(const antialias *aa, const int *counts, int stride, int width, int height, int x, int y);
+uint32_t antialias_average(const uint32_t *colors, int number);
+void antialias_count(antialias *aa, int worker, int pixels, int refined);
+void antialias_report(const antialias *aa, FILE *file);
+void antialias_release(antialias *aa);
+
+#endif
@@ -0,0 +1,496 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tile_queue.h"
+#include "worker_pool.h"
+#include "escape_kernel.h"
+#include "subdivide.h"
+#include "wall_clock.h"
+
+#ifdef WITH_OPENCL
+#include "cl_render.h"
+#endif
+
+// A view of the catalog. The height is width * 2 / 3.5 whatever the size
+// of the frame, the mapping of the renderers and of the kernel. Julia
+// views take c = (0.353 + julia_zoom, 0.288), the same parameter the zoom
+// sequences of the renderers walk; the kernel always shows the whole
+// plane for them, [-1.75, 1.75] x [-1.00001, 0.99999], so they all cover
+// exactly that.
+typedef struct bench_view bench_view;
+struct bench_view
+{
+    const char *name;
+    int julia_mode;
+    double center_x;
+    double center_y;
+    double width;
+    float julia_zoom;
+    int max_iteration;
+};
+
+// Fixed so results compare between releases. Every engine, the OpenCL
+// kernels too, runs a view with its max_iteration.
+static const bench_view views[] =
+{
+    { "full_set",        0, -0.75,         0.0,          3.5,    0.0,  256 },
+    { "seahorse_valley", 0, -0.7453,       0.1127,       0.05,   0.0,  256 },
+    { "narrow_boundary", 0, -0.743643887,  0.131825904,  5.0e-3, 0.0,  512 },
+    { "julia_0.353",     1,  0.0,         -0.00001,      3.5,    0.0,  256 },
+    { "julia_-0.147",    1,  0.0,         -0.00001,      3.5,   -0.5,  256 },
+    { "julia_-0.747",    1,  0.0,         -0.00001,      3.5,   -1.1,  256 },
+};
+
+#define NUMBER_VIEWS ((int) (sizeof(views) / sizeof(views[0])))
+
+// Share of the pixels an engine may count differently from the plain CPU
+// frame of a view. The kernel maps pixels with other float roundings, an
+// ulp off sends orbits close to the boundary elsewhere (about 2% of
+// narrow_boundary), and subdivision fills a few rectangles the border
+// missed. A frame of another region differs almost everywhere.
+#define BENCH_TOLERANCE 0.05
+
+typedef struct bench_frame bench_frame;
+struct bench_frame
+{
+    const bench_view *view;
+    int res_x;
+    int res_y;
+    escape_tile_fn kernel;
+    int subdivide;
+    int *out;
+};
+
+typedef struct bench_result bench_result;
+struct bench_result
+{
+    const char *engine;
+    const char *view;
+    int frames;
+    double total;
+    double p50;
+    double p90;
+    double p99;
+    double mpixels;
+    double giterations;
+    long long iterations;
+};
+
+void bench_tile(void *frame, const tile *piece, int worker)
+{
+    bench_frame *args = (bench_frame *) frame;
+    const bench_view *view = args->view;
+    float pos_x[TILE_SIZE], pos_y[TILE_SIZE];
+    double height = view->width * 2.0 / 3.5;
+    double step_x = view->width / args->res_x, step_y = height / args->res_y;
+    double left = view->center_x - view->width / 2.0;
+    double top = view->center_y - height / 2.0;
+    escape_job job;
+    int x, y;
+
+    for (x = 0; x < piece->width; x++)
+        pos_x[x] = left + (piece->x + x) * step_x;
+    for (y = 0; y < piece->height; y++)
+        pos_y[y] = top + (piece->y + y) * step_y;
+
+    job.out = &args->out[piece->x + piece->y * args->res_x];
+    job.fraction = NULL;
+    job.stride = args->res_x;
+    job.pos_x = pos_x;
+    job.width = piece->width;
+    job.pos_y = pos_y;
+    job.height = piece->height;
+    job.julia_mode = view->julia_mode;
+    job.julia_x = 0.353 + view->julia_zoom;
+    job.julia_y = 0.288;
+    job.power = 2;
+    job.max_iteration = view->max_iteration;
+    job.paired = 0;
+
+    if (args->subdivide)
+        subdivide_tile(&job, args->kernel);
+    else
+        args->kernel(&job);
+}
+
+// Iterations the frame stands for, points inside the set count as
+// max_iteration whatever shortcut the engine took for them
+static long long count_iterations(const int *out, int count, int max_iteration)
+{
+    long long total = 0;
+    int pixel;
+
+    for (pixel = 0; pixel < count; pixel++)
+        total += (out[pixel] == 0) ? max_iteration : out[pixel];
+
+    return total;
+}
+
+static int compare_times(const void *a, const void *b)
+{
+    double first = *(const double *) a, second = *(const double *) b;
+
+    return (first > second) - (first < second);
+}
+
+// Nearest rank percentile of sorted times
+static double percentile(const double *times, int count, int percent)
+{
+    int rank = (percent * count + 99) / 100;
+
+    if (rank < 1)
+        rank = 1;
+    return times[rank - 1];
+}
+
+static void summarize(bench_result *result, double *times, int frames, int res_x, int res_y,
+                      const int *out, int max_iteration)
+{
+    int frame;
+
+    result->frames = frames;
+    result->total = 0.0;
+    for (frame = 0; frame < frames; frame++)
+        result->total += times[frame];
+
+    qsort(times, frames, sizeof(double), compare_times);
+    result->p50 = percentile(times, frames, 50);
+    result->p90 = percentile(times, frames, 90);
+    result->p99 = percentile(times, frames, 99);
+
+    result->iterations = count_iterations(out, res_x * res_y, max_iteration);
+    result->mpixels = (double) res_x * res_y * frames / result->total / 1e6;
+    result->giterations = (double) result->iterations * frames / result->total / 1e9;
+}
+
+static void print_header(FILE *file, const char *format)
+{
+    if (strcmp(format, "csv") == 0)
+        fprintf(file, "engine,view,frames,total_s,p50_ms,p90_ms,p99_ms,mpixel_s,giteration_s,iterations\n");
+    else if (strcmp(format, "json") == 0)
+        fprintf(file, "[\n");
+    else
+        fprintf(file, "%-10s %-16s %6s %10s %9s %9s %9s %10s %9s\n", "engine", "view", "frames",
+                "total s", "p50 ms", "p90 ms", "p99 ms", "Mpixel/s", "Giter/s");
+}
+
+static void print_result(FILE *file, const char *format, const bench_result *result, int first)
+{
+    if (strcmp(format, "csv") == 0)
+        fprintf(file, "%s,%s,%d,%.6f,%.3f,%.3f,%.3f,%.3f,%.4f,%lld\n", result->engine, result->view,
+                result->frames, result->total, result->p50 * 1e3, result->p90 * 1e3, result->p99 * 1e3,
+                result->mpixels, result->giterations, result->iterations);
+    else if (strcmp(format, "json") == 0)
+        fprintf(file, "%s  {\"engine\": \"%s\", \"view\": \"%s\", \"frames\": %d, \"total_s\": %.6f, "
+                "\"p50_ms\": %.3f, \"p90_ms\": %.3f, \"p99_ms\": %.3f, \"mpixel_s\": %.3f, "
+                "\"giteration_s\": %.4f, \"iterations\": %lld}", first ? "" : ",\n",
+                result->engine, result->view, result->frames, result->total, result->p50 * 1e3,
+                result->p90 * 1e3, result->p99 * 1e3, result->mpixels, result->giterations,
+                result->iterations);
+    else
+        fprintf(file, "%-10s %-16s %6d %10.4f %9.3f %9.3f %9.3f %10.2f %9.3f\n", result->engine,
+                result->view, result->frames, result->total, result->p50 * 1e3, result->p90 * 1e3,
+                result->p99 * 1e3, result->mpixels, result->giterations);
+}
+
+static void print_footer(FILE *file, const char *format)
+{
+    if (strcmp(format, "json") == 0)
+        fprintf(file, "\n]\n");
+}
+
+// Plain CPU frames of every view, one after the other in reference, that
+// the other engines are checked against
+static int bench_reference(int number_threads, escape_tile_fn kernel, int res_x, int res_y, int *reference)
+{
+    tile_queue queue;
+    worker_pool pool;
+    bench_frame frame;
+    int view;
+
+    if ((tile_queue_init(&queue, res_x, res_y, TILE_SIZE, number_threads) != 0) ||
+        (worker_pool_init(&pool, number_threads, &queue) != 0))
+        return 2;
+
+    for (view = 0; view < NUMBER_VIEWS; view++)
+    {
+        frame.view = &views[view];
+        frame.res_x = res_x;
+        frame.res_y = res_y;
+        frame.kernel = kernel;
+        frame.subdivide = 0;
+        frame.out = &reference[view * res_x * res_y];
+        worker_pool_render(&pool, bench_tile, (void *) &frame);
+    }
+
+    worker_pool_release(&pool);
+    tile_queue_release(&queue);
+    return 0;
+}
+
+// The frame of an engine against the reference of its view, 0 and
+// max_iteration both meaning inside like in count_iterations. Returns 1
+// when they differ by more than BENCH_TOLERANCE.
+static int bench_check(const char *engine, const bench_view *view, const int *reference, const int *out, int count)
+{
+    int pixel, value, expected, differ = 0;
+
+    for (pixel = 0; pixel < count; pixel++)
+    {
+        value = (out[pixel] == 0) ? view->max_iteration : out[pixel];
+        expected = (reference[pixel] == 0) ? view->max_iteration : reference[pixel];
+        differ += (value != expected);
+    }
+
+    if (differ <= BENCH_TOLERANCE * count)
+        return 0;
+
+    fprintf(stderr, "%s differs from the CPU frame of %s at %.2f%% of the pixels\n", engine, view->name, 100.0 * differ / count);
+    return 1;
+}
+
+// One CPU engine over the catalog: a warm up frame, then the timed ones.
+// With a reference the last frame of every view is checked against it.
+static int bench_cpu(const char *engine, int number_threads, escape_tile_fn kernel, int subdivide,
+                     int res_x, int res_y, int frames, int *out, double *times, FILE *file, const char *format, int *first,
+                     const int *reference)
+{
+    tile_queue queue;
+    worker_pool pool;
+    bench_frame frame;
+    bench_result result;
+    int view, count, failed = 0;
+    double start;
+
+    if ((tile_queue_init(&queue, res_x, res_y, TILE_SIZE, number_threads) != 0) ||
+        (worker_pool_init(&pool, number_threads, &queue) != 0))
+        return 2;
+
+    for (view = 0; view < NUMBER_VIEWS; view++)
+    {
+        frame.view = &views[view];
+        frame.res_x = res_x;
+        frame.res_y = res_y;
+        frame.kernel = kernel;
+        frame.subdivide = subdivide;
+        frame.out = out;
+
+        worker_pool_render(&pool, bench_tile, (void *) &frame);
+        for (count = 0; count < frames; count++)
+        {
+            start = wall_clock_seconds();
+            worker_pool_render(&pool, bench_tile, (void *) &frame);
+            times[count] = wall_clock_seconds() - start;
+        }
+
+        result.engine = engine;
+        result.view = views[view].name;
+        summarize(&result, times, frames, res_x, res_y, out, views[view].max_iteration);
+        print_result(file, format, &result, *first);
+        *first = 0;
+
+        if (reference != NULL)
+            failed |= bench_check(engine, &views[view], &reference[view * res_x * res_y], out, res_x * res_y);
+    }
+
+    worker_pool_release(&pool);
+    tile_queue_release(&queue);
+    return failed;
+}
+
+#ifdef WITH_OPENCL
+static int bench_opencl(int subdevices, int res_x, int res_y, int frames, int *out, double *times,
+                        FILE *file, const char *format, int *first, const int *reference)
+{
+    cl_render mandelbrot, julia, *render;
+    cl_render_options options;
+    bench_result result;
+    const bench_view *current;
+    float zoom, center_x, center_y;
+    int view, count, failed = 0;
+    double start;
+
+    // Every view has its own cap, built into the kernel
+    cl_render_defaults(&options, CL_FRACTAL_MANDELBROT);
+    options.constant_iterations = 1;
+    if (cl_render_init(&mandelbrot, &options, res_x, res_y, subdevices) != 0)
+        return 1;
+    cl_render_defaults(&options, CL_FRACTAL_JULIA);
+    options.constant_iterations = 1;
+    if (cl_render_init(&julia, &options, res_x, res_y, subdevices) != 0)
+        return 1;
+
+    for (view = 0; view < NUMBER_VIEWS; view++)
+    {
+        current = &views[view];
+
+        // The kernel maps x to x / res_x * 3.5 * zoom - center_x and y to
+        // y / res_y * 2 * zoom - center_y, Julia always shows the whole
+        // plane
+        if (current->julia_mode == 0)
+        {
+            render = &mandelbrot;
+            zoom = current->width / 3.5;
+            center_x = current->width / 2.0 - current->center_x;
+            center_y = zoom - current->center_y;
+        }
+        else
+        {
+            render = &julia;
+            zoom = current->julia_zoom;
+            center_x = center_y = 0.0;
+        }
+
+        if (cl_render_frame(render, zoom, center_x, center_y, current->max_iteration, out) != 0)
+            return 1;
+        for (count = 0; count < frames; count++)
+        {
+            start = wall_clock_seconds();
+            if (cl_render_frame(render, zoom, center_x, center_y, current->max_iteration, out) != 0)
+                return 1;
+            times[count] = wall_clock_seconds() - start;
+        }
+
+        result.engine = "opencl";
+        result.view = current->name;
+        summarize(&result, times, frames, res_x, res_y, out, current->max_iteration);
+        print_result(file, format, &result, *first);
+        *first = 0;
+
+        failed |= bench_check("opencl", current, &reference[view * res_x * res_y], out, res_x * res_y);
+    }
+
+    // How the frames were split between the devices
+    cl_render_report(&mandelbrot, stderr);
+    cl_render_report(&julia, stderr);
+
+    cl_render_release(&mandelbrot);
+    cl_render_release(&julia);
+    return failed;
+}
+#endif
+
+int main(int argn, char **argv)
+{
+    int res_x = 800;
+    int res_y = 600;
+    int frames = 10;
+#ifdef WITH_OPENCL
+    int subdevices = 0;
+#endif
+    int number_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *engines = "scalar,threads,subdivide,opencl";
+    const char *format = "text";
+    const char *output = NULL;
+    const char *isa = NULL;
+    const char *isa_name;
+    escape_tile_fn kernel;
+    FILE *file = stdout;
+    int *out, *reference = NULL;
+    double *times;
+    int arg, first = 1, result = 0;
+
+    for (arg = 1; arg < argn; arg++)
+    {
+        if ((strcmp(argv[arg], "-frames") == 0) && (arg + 1 < argn))
+            frames = atoi(argv[++arg]);
+        else if ((strcmp(argv[arg], "-threads") == 0) && (arg + 1 < argn))
+            number_threads = atoi(argv[++arg]);
+#ifdef WITH_OPENCL
+        else if ((strcmp(argv[arg], "-subdevices") == 0) && (arg + 1 < argn))
+            subdevices = atoi(argv[++arg]);
+#endif
+        else if ((strcmp(argv[arg], "-isa") == 0) && (arg + 1 < argn))
+            isa = argv[++arg];
+        else if ((strcmp(argv[arg], "-engines") == 0) && (arg + 1 < argn))
+            engines = argv[++arg];
+        else if ((strcmp(argv[arg], "-format") == 0) && (arg + 1 < argn))
+            format = argv[++arg];
+        else if ((strcmp(argv[arg], "-output") == 0) && (arg + 1 < argn))
+            output = argv[++arg];
+        else if ((strcmp(argv[arg], "-size") == 0) && (arg + 1 < argn) &&
+                 (sscanf(argv[arg + 1], "%dx%d", &res_x, &res_y) == 2) && (res_x > 0) && (res_y > 0))
+            arg++;
+        else
+        {
+            fprintf(stderr, "Usage: %s [-frames N] [-threads N] [-isa scalar|sse2|avx2|avx512] [-size WxH]\n"
+                            "       [-engines scalar,threads,subdivide,opencl] [-format text|csv|json] [-output FILE]\n"
+                            "       [-subdevices N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (frames < 1)
+        frames = 1;
+    if (number_threads < 1)
+        number_threads = 1;
+
+    out = malloc(res_x * res_y * sizeof(int));
+    times = malloc(frames * sizeof(double));
+    if ((out == NULL) || (times == NULL))
+    {
+        fprintf(stderr, "Bad luck, out of memory\n");
+        return 2;
+    }
+
+    if (output != NULL)
+    {
+        file = fopen(output, "w");
+        if (file == NULL)
+        {
+            fprintf(stderr, "Could not open %s for writing\n", output);
+            return 1;
+        }
+    }
+
+    kernel = escape_kernel_select(isa, &isa_name);
+    fprintf(stderr, "%dx%d, %d frames per view, %d threads, escape kernel %s\n",
+            res_x, res_y, frames, number_threads, isa_name);
+
+    // Subdivision and OpenCL must give about the frames of the plain CPU
+    // engine, their timings are of the same work then
+    if ((strstr(engines, "subdivide") != NULL) || (strstr(engines, "opencl") != NULL))
+    {
+        reference = malloc((size_t) NUMBER_VIEWS * res_x * res_y * sizeof(int));
+        if (reference == NULL)
+        {
+            fprintf(stderr, "Bad luck, out of memory\n");
+            return 2;
+        }
+        if (bench_reference(number_threads, kernel, res_x, res_y, reference) != 0)
+            return 2;
+    }
+
+    print_header(file, format);
+
+    if (strstr(engines, "scalar") != NULL)
+        result |= bench_cpu("scalar", 1, escape_tile_scalar, 0, res_x, res_y, frames, out, times, file, format, &first, NULL);
+
+    if (strstr(engines, "threads") != NULL)
+        result |= bench_cpu("threads", number_threads, kernel, 0, res_x, res_y, frames, out, times, file, format, &first, NULL);
+
+    if (strstr(engines, "subdivide") != NULL)
+        result |= bench_cpu("subdivide", number_threads, kernel, 1, res_x, res_y, frames, out, times, file, format, &first,
+                            reference);
+
+    if (strstr(engines, "opencl") != NULL)
+    {
+#ifdef WITH_OPENCL
+        result |= bench_opencl(subdevices, res_x, res_y, frames, out, times, file, format, &first, reference);
+#else
+        fprintf(stderr, "Built without OpenCL, use clbench for the opencl engine\n");
+#endif
+    }
+
+    print_footer(file, format);
+
+    if (file != stdout)
+        fclose(file);
+    free(times);
+    free(out);
+    free(reference);
+
+    return result;
+}
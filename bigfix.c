@@ -0,0 +1,241 @@
+#include <string.h>
+#include <math.h>
+
+#include "bigfix.h"
+
+static int bigfix_negative(const bigfix *a)
+{
+    return (a->limb[a->limbs - 1] & 0x80000000u) != 0;
+}
+
+static void bigfix_negate(bigfix *r)
+{
+    int count;
+    uint64_t carry = 1;
+
+    for (count = 0; count < r->limbs; count++)
+    {
+        carry += (uint32_t) ~r->limb[count];
+        r->limb[count] = (uint32_t) carry;
+        carry >>= 32;
+    }
+}
+
+// Limbs needed to resolve steps of size 2^log2_scale with 64 bits to spare
+int bigfix_limbs_for_scale(double log2_scale)
+{
+    int bits, limbs;
+
+    bits = (int) ceil(-log2_scale);
+    if (bits < 0)
+        bits = 0;
+
+    limbs = (bits + 64) / 32 + 2;
+    if (limbs > BIGFIX_MAX_LIMBS)
+        limbs = BIGFIX_MAX_LIMBS;
+
+    return limbs;
+}
+
+void bigfix_zero(bigfix *r, int limbs)
+{
+    r->limbs = limbs;
+    memset(r->limb, 0, sizeof(r->limb));
+}
+
+void bigfix_from_double(bigfix *r, double value, int limbs)
+{
+    int count, negative = (value < 0.0);
+    double magnitude = fabs(value);
+    double whole = floor(magnitude);
+
+    bigfix_zero(r, limbs);
+    r->limb[limbs - 1] = (uint32_t) whole;
+    magnitude -= whole;
+
+    for (count = limbs - 2; (count >= 0) && (magnitude > 0.0); count--)
+    {
+        magnitude *= 4294967296.0;
+        whole = floor(magnitude);
+        r->limb[count] = (uint32_t) whole;
+        magnitude -= whole;
+    }
+
+    if (negative)
+        bigfix_negate(r);
+}
+
+// value * 2^exponent, for exponents way below what a double can hold
+void bigfix_ldexp(bigfix *r, double value, int exponent, int limbs)
+{
+    int shift = 0;
+
+    while ((exponent < -32) && (shift < limbs))
+    {
+        exponent += 32;
+        shift++;
+    }
+
+    bigfix_from_double(r, ldexp(fabs(value), exponent), limbs);
+
+    if (shift > 0)
+    {
+        memmove(&r->limb[0], &r->limb[shift], (limbs - shift) * sizeof(uint32_t));
+        memset(&r->limb[limbs - shift], 0, shift * sizeof(uint32_t));
+    }
+
+    if (value < 0.0)
+        bigfix_negate(r);
+}
+
+double bigfix_to_double(const bigfix *a)
+{
+    bigfix magnitude = *a;
+    double value = 0.0, weight = 1.0;
+    int count, last, negative = bigfix_negative(a);
+
+    if (negative)
+        bigfix_negate(&magnitude);
+
+    // Three limbs from the first non zero one cover the 53 bits of a double
+    for (count = a->limbs - 1; (count > 0) && (magnitude.limb[count] == 0); count--)
+        weight /= 4294967296.0;
+
+    for (last = count - 3; (count >= 0) && (count > last); count--)
+    {
+        value += magnitude.limb[count] * weight;
+        weight /= 4294967296.0;
+    }
+
+    return negative ? -value : value;
+}
+
+// Reads a plain decimal number such as "-0.7436438870371587047521915"
+int bigfix_parse(bigfix *r, const char *text, int limbs)
+{
+    const char *fraction, *end;
+    int count, negative = 0;
+    uint32_t whole = 0;
+    uint64_t remainder;
+
+    bigfix_zero(r, limbs);
+
+    if ((*text == '-') || (*text == '+'))
+        negative = (*text++ == '-');
+
+    while ((*text >= '0') && (*text <= '9'))
+        whole = whole * 10 + (*text++ - '0');
+
+    if (*text == '.')
+    {
+        fraction = ++text;
+        while ((*text >= '0') && (*text <= '9'))
+            text++;
+        end = text;
+
+        // Horner's rule from the last digit: f = (f + digit) / 10
+        while (text-- > fraction)
+        {
+            r->limb[limbs - 1] += *text - '0';
+            remainder = 0;
+            for (count = limbs - 1; count >= 0; count--)
+            {
+                remainder = (remainder << 32) | r->limb[count];
+                r->limb[count] = (uint32_t) (remainder / 10);
+                remainder %= 10;
+            }
+        }
+        text = end;
+    }
+
+    r->limb[limbs - 1] += whole;
+
+    if (negative)
+        bigfix_negate(r);
+
+    return (*text == '\0') ? 0 : 1;
+}
+
+// Changes the precision keeping the value, dropping or adding fraction limbs
+void bigfix_set_limbs(bigfix *r, int limbs)
+{
+    int shift = limbs - r->limbs;
+
+    if (shift > 0)
+    {
+        memmove(&r->limb[shift], &r->limb[0], r->limbs * sizeof(uint32_t));
+        memset(&r->limb[0], 0, shift * sizeof(uint32_t));
+    }
+    else if (shift < 0)
+    {
+        memmove(&r->limb[0], &r->limb[-shift], limbs * sizeof(uint32_t));
+        memset(&r->limb[limbs], 0, -shift * sizeof(uint32_t));
+    }
+
+    r->limbs = limbs;
+}
+
+void bigfix_add(bigfix *r, const bigfix *a, const bigfix *b)
+{
+    int count;
+    uint64_t carry = 0;
+
+    for (count = 0; count < a->limbs; count++)
+    {
+        carry += (uint64_t) a->limb[count] + b->limb[count];
+        r->limb[count] = (uint32_t) carry;
+        carry >>= 32;
+    }
+    r->limbs = a->limbs;
+}
+
+void bigfix_sub(bigfix *r, const bigfix *a, const bigfix *b)
+{
+    int count;
+    int64_t borrow = 0;
+
+    for (count = 0; count < a->limbs; count++)
+    {
+        borrow += (int64_t) a->limb[count] - b->limb[count];
+        r->limb[count] = (uint32_t) borrow;
+        borrow >>= 32;
+    }
+    r->limbs = a->limbs;
+}
+
+// Truncating product, the low half of the double width result is dropped
+void bigfix_mul(bigfix *r, const bigfix *a, const bigfix *b)
+{
+    bigfix x = *a, y = *b;
+    uint32_t product[2 * BIGFIX_MAX_LIMBS];
+    uint64_t carry;
+    int i, j, limbs = a->limbs;
+    int negative = bigfix_negative(a) ^ bigfix_negative(b);
+
+    if (bigfix_negative(&x))
+        bigfix_negate(&x);
+    if (bigfix_negative(&y))
+        bigfix_negate(&y);
+
+    memset(product, 0, 2 * limbs * sizeof(uint32_t));
+    for (i = 0; i < limbs; i++)
+    {
+        if (x.limb[i] == 0)
+            continue;
+
+        carry = 0;
+        for (j = 0; j < limbs; j++)
+        {
+            carry += (uint64_t) x.limb[i] * y.limb[j] + product[i + j];
+            product[i + j] = (uint32_t) carry;
+            carry >>= 32;
+        }
+        product[i + limbs] = (uint32_t) carry;
+    }
+
+    r->limbs = limbs;
+    memcpy(r->limb, &product[limbs - 1], limbs * sizeof(uint32_t));
+
+    if (negative)
+        bigfix_negate(r);
+}
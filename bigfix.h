@@ -0,0 +1,30 @@
+#ifndef BIGFIX_H
+#define BIGFIX_H
+
+#include <stdint.h>
+
+// Enough for views down to roughly 1e-1200
+#define BIGFIX_MAX_LIMBS 128
+
+// Fixed point number in two's complement. limb[0] is the least
+// significant 32 bits of the fraction and limb[limbs - 1] holds the
+// integer part, so the range is [-2^31, 2^31).
+typedef struct bigfix bigfix;
+struct bigfix
+{
+    int limbs;
+    uint32_t limb[BIGFIX_MAX_LIMBS];
+};
+
+int bigfix_limbs_for_scale(double log2_scale);
+void bigfix_zero(bigfix *r, int limbs);
+void bigfix_from_double(bigfix *r, double value, int limbs);
+void bigfix_ldexp(bigfix *r, double value, int exponent, int limbs);
+double bigfix_to_double(const bigfix *a);
+int bigfix_parse(bigfix *r, const char *text, int limbs);
+void bigfix_set_limbs(bigfix *r, int limbs);
+void bigfix_add(bigfix *r, const bigfix *a, const bigfix *b);
+void bigfix_sub(bigfix *r, const bigfix *a, const bigfix *b);
+void bigfix_mul(bigfix *r, const bigfix *a, const bigfix *b);
+
+#endif
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cl_cache.h"
+
+// First line of a cache file, the key of the binary comes next
+#define CL_CACHE_MAGIC "clfract program binary 1\n"
+
+#define CL_CACHE_PATH 4096
+#define CL_CACHE_KEY 1024
+
+// FNV-1a, 64 bits
+static unsigned long long cl_cache_hash(const char *data, size_t size)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    size_t count;
+
+    for (count = 0; count < size; count++)
+    {
+        hash ^= (unsigned char) data[count];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+// Everything the binary depends on, on one line
+static void cl_cache_key(cl_device_id device_id, const char *source_str, size_t source_size, const char *options,
+                         char *key, size_t key_size)
+{
+    char name[256] = "", vendor[256] = "", version[256] = "", driver[256] = "";
+
+    clGetDeviceInfo(device_id, CL_DEVICE_NAME, sizeof(name) - 1, name, NULL);
+    clGetDeviceInfo(device_id, CL_DEVICE_VENDOR, sizeof(vendor) - 1, vendor, NULL);
+    clGetDeviceInfo(device_id, CL_DEVICE_VERSION, sizeof(version) - 1, version, NULL);
+    clGetDeviceInfo(device_id, CL_DRIVER_VERSION, sizeof(driver) - 1, driver, NULL);
+
+    snprintf(key, key_size, "%s|%s|%s|%s|%016llx|%s", name, vendor, version, driver,
+             cl_cache_hash(source_str, source_size), options);
+    key[strcspn(key, "\n")] = '\0';
+}
+
+// File of the key, 0 when there is no cache
+static int cl_cache_path(const char *key, char *path, size_t path_size)
+{
+    const char *directory = getenv(CL_CACHE_VARIABLE), *home;
+    char parent[CL_CACHE_PATH];
+
+    if (directory == NULL)
+    {
+        home = getenv("HOME");
+        if ((home == NULL) || (home[0] == '\0'))
+            return 0;
+
+        // ~/.cache may not be there yet either
+        snprintf(parent, sizeof(parent), "%s/.cache", home);
+        mkdir(parent, 0755);
+        snprintf(parent, sizeof(parent), "%s/%s", home, CL_CACHE_DIRECTORY);
+        directory = parent;
+    }
+    if (directory[0] == '\0')
+        return 0;
+
+    mkdir(directory, 0755);
+    snprintf(path, path_size, "%s/%016llx.bin", directory, cl_cache_hash(key, strlen(key)));
+    return 1;
+}
+
+// Binary stored under the key, NULL when there is none or it belongs to
+// another key
+static unsigned char *cl_cache_load(const char *path, const char *key, size_t *binary_size)
+{
+    char line[CL_CACHE_KEY + 2];
+    unsigned char *binary;
+    unsigned long size;
+    FILE *file;
+
+    file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    if ((fgets(line, sizeof(line), file) == NULL) || (strcmp(line, CL_CACHE_MAGIC) != 0) ||
+        (fgets(line, sizeof(line), file) == NULL) || (strncmp(line, key, strlen(key)) != 0) ||
+        (line[strlen(key)] != '\n') || (fscanf(file, "%lu\n", &size) != 1) || (size == 0))
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    binary = malloc(size);
+    if ((binary != NULL) && (fread(binary, 1, size, file) != size))
+    {
+        free(binary);
+        binary = NULL;
+    }
+    fclose(file);
+
+    *binary_size = size;
+    return binary;
+}
+
+// Written under another name and renamed, so render jobs starting together
+// never read half a file
+static void cl_cache_save(const char *path, const char *key, cl_program program)
+{
+    char temporary[CL_CACHE_PATH + 32];
+    unsigned char *binary;
+    size_t size = 0;
+    FILE *file;
+
+    if ((clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, NULL) != CL_SUCCESS) || (size == 0))
+        return;
+
+    binary = malloc(size);
+    if (binary == NULL)
+        return;
+
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(binary), &binary, NULL) == CL_SUCCESS)
+    {
+        snprintf(temporary, sizeof(temporary), "%s.%d", path, (int) getpid());
+        file = fopen(temporary, "wb");
+        if (file != NULL)
+        {
+            fprintf(file, "%s%s\n%lu\n", CL_CACHE_MAGIC, key, (unsigned long) size);
+            if ((fwrite(binary, 1, size, file) == size) && (fclose(file) == 0))
+                rename(temporary, path);
+            else
+                remove(temporary);
+        }
+    }
+
+    free(binary);
+}
+
+int cl_cache_build(cl_context context, cl_device_id device_id, const char *source_str, size_t source_size,
+                   const char *options, cl_program *program)
+{
+    char key[CL_CACHE_KEY], path[CL_CACHE_PATH];
+    const unsigned char *binary;
+    size_t binary_size = 0;
+    int cached;
+    cl_int ret, status;
+
+    cl_cache_key(device_id, source_str, source_size, options, key, sizeof(key));
+    cached = cl_cache_path(key, path, sizeof(path));
+
+    // A binary the driver turns down (say it was updated without changing
+    // its version) is built again from the source
+    binary = cached ? cl_cache_load(path, key, &binary_size) : NULL;
+    if (binary != NULL)
+    {
+        *program = clCreateProgramWithBinary(context, 1, &device_id, &binary_size, &binary, &status, &ret);
+        free((void *) binary);
+
+        if ((ret == CL_SUCCESS) && (status == CL_SUCCESS) &&
+            (clBuildProgram(*program, 1, &device_id, options, NULL, NULL) == CL_SUCCESS))
+        {
+            printf("program loaded from %s\n", path);
+            return 0;
+        }
+        if (ret == CL_SUCCESS)
+            clReleaseProgram(*program);
+    }
+
+    // Create a program from the kernel source and build it
+    *program = clCreateProgramWithSource(context, 1, &source_str, &source_size, &ret);
+
+    ret = clBuildProgram(*program, 1, &device_id, options, NULL, NULL);
+
+    if (ret != CL_SUCCESS)
+    {
+        char *build_log;
+        size_t ret_val_size;
+
+        printf("Program build failed, error code: %d\n", ret);
+        clGetProgramBuildInfo(*program, device_id, CL_PROGRAM_BUILD_LOG, 0, NULL, &ret_val_size);
+
+        build_log = (char *) malloc((ret_val_size + 1) * sizeof(char));
+        if (build_log != NULL)
+        {
+            clGetProgramBuildInfo(*program, device_id, CL_PROGRAM_BUILD_LOG, ret_val_size, build_log, NULL);
+            build_log[ret_val_size] = '\0';
+            printf("BUILD LOG: \n %s", build_log);
+            free(build_log);
+        }
+        clReleaseProgram(*program);
+        return 1;
+    }
+
+    printf("program built\n");
+
+    if (cached)
+        cl_cache_save(path, key, *program);
+
+    return 0;
+}
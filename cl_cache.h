@@ -0,0 +1,22 @@
+#ifndef CL_CACHE_H
+#define CL_CACHE_H
+
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// Program binaries are kept in $CLFRACT_CACHE, or ~/.cache/clfract when
+// it is not set. Setting it empty turns the cache off.
+#define CL_CACHE_VARIABLE "CLFRACT_CACHE"
+#define CL_CACHE_DIRECTORY ".cache/clfract"
+
+// Builds the program of a device, from the binary of an earlier build when
+// one is in the cache for the same device, driver, source and options,
+// from the source otherwise (and the binary is stored for the next time).
+// Prints the build log when the source does not build.
+int cl_cache_build(cl_context context, cl_device_id device_id, const char *source_str, size_t source_size,
+                   const char *options, cl_program *program);
+
+#endif
@@ -0,0 +1,853 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cl_render.h"
+#include "cl_cache.h"
+
+static int cl_render_build(cl_render *render, cl_render_device *device, cl_render_variant *variant, int max_iteration)
+{
+    char options[CL_RENDER_OPTIONS_SIZE + 32];
+    cl_int ret;
+
+    if (max_iteration > 0)
+        snprintf(options, sizeof(options), "%s -D MAX_ITERATION=%d", device->options, max_iteration);
+    else
+        snprintf(options, sizeof(options), "%s", device->options);
+
+    if (cl_cache_build(device->context, device->device_id, render->source_str, render->source_size,
+                       options, &variant->program) != 0)
+        return 1;
+
+    variant->kernel = clCreateKernel(variant->program, "fractal_point", &ret);
+    if (ret != CL_SUCCESS)
+    {
+        clReleaseProgram(variant->program);
+        printf("Error when loading the kernel: %d\n", ret);
+        return 1;
+    }
+    variant->samples_kernel = clCreateKernel(variant->program, "fractal_samples", &ret);
+    if (ret != CL_SUCCESS)
+    {
+        clReleaseKernel(variant->kernel);
+        clReleaseProgram(variant->program);
+        printf("Error when loading the kernel: %d\n", ret);
+        return 1;
+    }
+
+    variant->max_iteration = max_iteration;
+    variant->used = render->sequence;
+    return 0;
+}
+
+// Program of the device for a cap, built the first time the cap comes.
+// Without constant caps, or when the build fails, the first program does
+// it with the cap as an argument.
+static cl_render_variant *cl_render_variant_for(cl_render *render, cl_render_device *device, int max_iteration)
+{
+    cl_render_variant *variant, *oldest = NULL;
+    int index;
+
+    if (!render->options.constant_iterations)
+        return &device->variants[0];
+
+    for (index = 1; index < device->number_variants; index++)
+    {
+        variant = &device->variants[index];
+        if (variant->max_iteration == max_iteration)
+        {
+            variant->used = render->sequence;
+            return variant;
+        }
+        if ((oldest == NULL) || (variant->used < oldest->used))
+            oldest = variant;
+    }
+
+    // Kernels still queued are kept by the runtime until done
+    if (device->number_variants < CL_RENDER_MAX_VARIANTS)
+        variant = &device->variants[device->number_variants++];
+    else
+    {
+        variant = oldest;
+        clReleaseKernel(variant->kernel);
+        clReleaseKernel(variant->samples_kernel);
+        clReleaseProgram(variant->program);
+    }
+
+    if (cl_render_build(render, device, variant, max_iteration) != 0)
+    {
+        *variant = device->variants[--device->number_variants];
+        return &device->variants[0];
+    }
+
+    return variant;
+}
+
+// Context, queue, first program and buffers of one device. On failure
+// the caller closes what was made and goes on without it.
+static int cl_render_open(cl_render *render, cl_render_device *device)
+{
+    cl_queue_properties properties[] = { CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0 };
+    cl_uint compute_units = 0;
+    cl_int ret;
+    int batch, slot;
+
+    device->context = NULL;
+    device->command_queue = NULL;
+    for (slot = 0; slot < CL_RENDER_BUFFERS; slot++)
+        device->graph_mem_obj[slot] = NULL;
+    device->points_mem_obj = NULL;
+    device->samples_mem_obj = NULL;
+    device->samples_capacity = 0;
+    device->number_variants = 0;
+    device->throughput = 0.0;
+    device->samples = 0.0;
+    for (batch = 0; batch < CL_RENDER_IN_FLIGHT; batch++)
+        device->batches[batch].busy = 0;
+
+    clGetDeviceInfo(device->device_id, CL_DEVICE_NAME, sizeof(device->name), device->name, NULL);
+    device->name[sizeof(device->name) - 1] = '\0';
+    clGetDeviceInfo(device->device_id, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(compute_units), &compute_units, NULL);
+    printf("OpenCL device %d: %s, %u compute units\n", render->number_devices, device->name, compute_units);
+
+    // Doubles where the device has them
+    device->double_precision = 0;
+    if (render->options.double_precision)
+    {
+        cl_device_fp_config fp64 = 0;
+
+        clGetDeviceInfo(device->device_id, CL_DEVICE_DOUBLE_FP_CONFIG, sizeof(fp64), &fp64, NULL);
+        device->double_precision = (fp64 != 0);
+        if (!device->double_precision)
+            printf("No double precision on %s, single precision there\n", device->name);
+    }
+
+    snprintf(device->options, sizeof(device->options), "%s -D FRACTAL=%d -D UNROLL=%d -D JULIA_X=%.17g -D JULIA_Y=%.17g%s",
+             CL_RENDER_BUILD_OPTIONS, render->options.fractal, render->options.unroll,
+             render->options.julia_x, render->options.julia_y, device->double_precision ? " -D REAL_DOUBLE" : "");
+
+    // Create an OpenCL context and its command queue, profiled to measure
+    // the kernels
+    device->context = clCreateContext(NULL, 1, &device->device_id, NULL, NULL, &ret);
+    if (ret != CL_SUCCESS)
+    {
+        fprintf(stderr, "Could not create a context, error code %d\n", ret);
+        return 1;
+    }
+    device->command_queue = clCreateCommandQueueWithProperties(device->context, device->device_id, properties, &ret);
+    if (ret != CL_SUCCESS)
+    {
+        fprintf(stderr, "Could not create a command queue, error code %d\n", ret);
+        return 1;
+    }
+
+    // Output buffers, in host visible memory so mapping the rows of a
+    // batch costs nothing on CPUs and integrated GPUs
+    for (slot = 0; slot < CL_RENDER_BUFFERS; slot++)
+    {
+        device->graph_mem_obj[slot] = clCreateBuffer(device->context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR,
+                render->res_x * render->res_y * sizeof(int), NULL, &ret);
+        if (ret != CL_SUCCESS)
+        {
+            device->graph_mem_obj[slot] = NULL;
+            fprintf(stderr, "Could not allocate the output buffers, error code %d\n", ret);
+            return 2;
+        }
+    }
+
+    if (cl_render_build(render, device, &device->variants[0], 0) != 0)
+        return 1;
+    device->number_variants = 1;
+
+    return 0;
+}
+
+static void cl_render_close(cl_render_device *device)
+{
+    int slot, index;
+
+    for (index = 0; index < device->number_variants; index++)
+    {
+        clReleaseKernel(device->variants[index].kernel);
+        clReleaseKernel(device->variants[index].samples_kernel);
+        clReleaseProgram(device->variants[index].program);
+    }
+    for (slot = 0; slot < CL_RENDER_BUFFERS; slot++)
+        if (device->graph_mem_obj[slot] != NULL)
+            clReleaseMemObject(device->graph_mem_obj[slot]);
+    if (device->points_mem_obj != NULL)
+        clReleaseMemObject(device->points_mem_obj);
+    if (device->samples_mem_obj != NULL)
+        clReleaseMemObject(device->samples_mem_obj);
+    if (device->command_queue != NULL)
+        clReleaseCommandQueue(device->command_queue);
+    if (device->context != NULL)
+        clReleaseContext(device->context);
+    clReleaseDevice(device->device_id);
+}
+
+// Cuts a device into sub-devices of equal compute units. Gives how many
+// were made in ids, 0 when the device can not be cut that way.
+static cl_uint cl_render_split(cl_device_id device_id, int subdevices, cl_device_id *ids, cl_uint room)
+{
+    cl_device_partition_property properties[3];
+    cl_device_partition_property supported[8];
+    size_t supported_size = 0;
+    cl_uint compute_units = 0, made = 0, count;
+    int equally = 0;
+
+    clGetDeviceInfo(device_id, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(compute_units), &compute_units, NULL);
+    if (clGetDeviceInfo(device_id, CL_DEVICE_PARTITION_PROPERTIES, sizeof(supported), supported, &supported_size) != CL_SUCCESS)
+        return 0;
+
+    for (count = 0; count < supported_size / sizeof(cl_device_partition_property); count++)
+        equally |= (supported[count] == CL_DEVICE_PARTITION_EQUALLY);
+    if ((!equally) || (compute_units < (cl_uint) subdevices))
+        return 0;
+
+    properties[0] = CL_DEVICE_PARTITION_EQUALLY;
+    properties[1] = compute_units / subdevices;
+    properties[2] = 0;
+    if (clCreateSubDevices(device_id, properties, room, ids, &made) != CL_SUCCESS)
+        return 0;
+
+    return (made < room) ? made : room;
+}
+
+// Mandelbrot or Julia as the kernel does them by default
+void cl_render_defaults(cl_render_options *options, int fractal)
+{
+    options->fractal = fractal;
+    options->double_precision = 0;
+    options->julia_x = 0.353;
+    options->julia_y = 0.288;
+    options->unroll = 4;
+    options->constant_iterations = 0;
+}
+
+// Opens every device of every platform. With subdevices > 1 the devices
+// that can be cut in that many parts are used as their parts instead. A
+// device that fails to open is left out, the others go on without it.
+int cl_render_init(cl_render *render, const cl_render_options *options, int res_x, int res_y, int subdevices)
+{
+    FILE *fp;
+    long source_size;
+    cl_platform_id platforms[CL_RENDER_MAX_DEVICES];
+    cl_device_id ids[CL_RENDER_MAX_DEVICES], parts[CL_RENDER_MAX_DEVICES];
+    cl_uint number_platforms = 0, number_ids, number_parts, platform, id, part;
+    cl_int status;
+    int slot, ret;
+
+    render->res_x = res_x;
+    render->res_y = res_y;
+    render->options = *options;
+    render->number_devices = 0;
+    render->number_passes = 0;
+    render->sequence = 0;
+    render->single_points = NULL;
+    render->single_capacity = 0;
+
+    for (slot = 0; slot < CL_RENDER_BUFFERS; slot++)
+    {
+        render->frames[slot] = calloc(res_x * res_y, sizeof(int));
+        if (render->frames[slot] == NULL)
+        {
+            fprintf(stderr, "Bad luck, out of memory\n");
+            return 2;
+        }
+    }
+
+    // Load the kernel source code into the array source_str
+    fp = fopen(CL_RENDER_KERNEL, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "Failed to load kernel.\n");
+        return 1;
+    }
+    fseek(fp, 0, SEEK_END);
+    source_size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    render->source_str = (char*)malloc(source_size + 1);
+    if (render->source_str == NULL)
+    {
+        fclose(fp);
+        fprintf(stderr, "Bad luck, out of memory\n");
+        return 2;
+    }
+    render->source_size = fread(render->source_str, 1, source_size, fp);
+    render->source_str[render->source_size] = '\0';
+    fclose(fp);
+
+    // Get platform and device information
+    status = clGetPlatformIDs(CL_RENDER_MAX_DEVICES, platforms, &number_platforms);
+    if ((status != CL_SUCCESS) || (number_platforms == 0))
+    {
+        fprintf(stderr, "No OpenCL platform found, error code %d. Is an OpenCL driver (ICD) installed?\n", status);
+        return 1;
+    }
+    if (number_platforms > CL_RENDER_MAX_DEVICES)
+        number_platforms = CL_RENDER_MAX_DEVICES;
+
+    for (platform = 0; platform < number_platforms; platform++)
+    {
+        number_ids = 0;
+        if (clGetDeviceIDs(platforms[platform], CL_DEVICE_TYPE_ALL, CL_RENDER_MAX_DEVICES, ids, &number_ids) != CL_SUCCESS)
+            continue;
+        if (number_ids > CL_RENDER_MAX_DEVICES)
+            number_ids = CL_RENDER_MAX_DEVICES;
+
+        for (id = 0; id < number_ids; id++)
+        {
+            number_parts = 0;
+            if (subdevices > 1)
+                number_parts = cl_render_split(ids[id], subdevices, parts,
+                                               CL_RENDER_MAX_DEVICES - render->number_devices);
+            if (number_parts == 0)
+            {
+                parts[0] = ids[id];
+                number_parts = 1;
+            }
+
+            for (part = 0; (part < number_parts) && (render->number_devices < CL_RENDER_MAX_DEVICES); part++)
+            {
+                render->devices[render->number_devices].device_id = parts[part];
+                ret = cl_render_open(render, &render->devices[render->number_devices]);
+                if (ret != 0)
+                {
+                    fprintf(stderr, "Leaving out %s\n", render->devices[render->number_devices].name);
+                    cl_render_close(&render->devices[render->number_devices]);
+                    continue;
+                }
+                render->number_devices++;
+            }
+        }
+    }
+
+    if (render->number_devices == 0)
+    {
+        fprintf(stderr, "No usable OpenCL device on %u platforms\n", number_platforms);
+        return 1;
+    }
+
+    return 0;
+}
+
+// Rows of the oldest pass for the next batch of a device: half its share
+// of the rows left by throughput, so the batches shrink towards the end
+// of the pass and the devices finish together. Devices not measured yet
+// count as the average of the others. No more than the device does in
+// CL_RENDER_BATCH_TIME, nor less than a work group.
+static int cl_render_batch_rows(const cl_render *render, const cl_render_device *device)
+{
+    const cl_render_pass_work *pass = &render->passes[0];
+    double total = 0.0, mine;
+    int number, measured = 0, rows;
+
+    for (number = 0; number < render->number_devices; number++)
+    {
+        if (render->devices[number].throughput > 0.0)
+        {
+            total += render->devices[number].throughput;
+            measured++;
+        }
+    }
+
+    if (measured == 0)
+        rows = pass->rows / (2 * render->number_devices);
+    else
+    {
+        mine = (device->throughput > 0.0) ? device->throughput : total / measured;
+        total += (render->number_devices - measured) * total / measured;
+        rows = (int) (pass->rows * mine / (2.0 * total));
+        if ((device->throughput > 0.0) && (rows > device->throughput * CL_RENDER_BATCH_TIME / pass->columns))
+            rows = (int) (device->throughput * CL_RENDER_BATCH_TIME / pass->columns);
+    }
+
+    rows = (rows / CL_GROUP_Y) * CL_GROUP_Y;
+    if (rows < CL_GROUP_Y)
+        rows = CL_GROUP_Y;
+
+    return (rows > pass->rows) ? pass->rows : rows;
+}
+
+// Hands the top rows of the oldest pass to a free batch of the device.
+// The kernel is queued with a non-blocking map of its image rows right
+// behind it. The batches of a slot share the output buffer of the device:
+// rows still mapped by one of them are not written again before it is
+// back, which only waits when progressive passes follow each other.
+static int cl_render_dispatch(cl_render *render, cl_render_device *device, cl_render_batch *batch)
+{
+    cl_render_pass_work *pass = &render->passes[0];
+    cl_render_batch *other;
+    size_t global_item_size[2], local_item_size[2] = { CL_GROUP_X, CL_GROUP_Y };
+    size_t global_item_offset[2];
+    float single[3];
+    int rows, top, bottom, last_column, last_row, index;
+    cl_kernel kernel;
+    cl_int ret;
+
+    rows = cl_render_batch_rows(render, device);
+    top = pass->first_row * pass->step;
+    bottom = (pass->first_row + rows - 1) * pass->step;
+    for (index = 0; index < CL_RENDER_IN_FLIGHT; index++)
+    {
+        other = &device->batches[index];
+        if (other->busy && (other->slot == pass->slot) && (other->first_row * other->step <= bottom) &&
+            ((other->first_row + other->rows - 1) * other->step >= top))
+            return 0;
+    }
+
+    kernel = cl_render_variant_for(render, device, pass->max_iteration)->kernel;
+
+    batch->busy = 1;
+    batch->slot = pass->slot;
+    batch->step = pass->step;
+    batch->coarse = pass->coarse;
+    batch->first_column = pass->first_column;
+    batch->columns = pass->columns;
+    batch->first_row = pass->first_row;
+    batch->rows = rows;
+    batch->sequence = render->sequence++;
+
+    global_item_offset[0] = pass->first_column;
+    global_item_offset[1] = pass->first_row;
+    global_item_size[0] = ((pass->columns + CL_GROUP_X - 1) / CL_GROUP_X) * CL_GROUP_X;
+    global_item_size[1] = ((rows + CL_GROUP_Y - 1) / CL_GROUP_Y) * CL_GROUP_Y;
+
+    // The items the rounding adds stay out of the rows of other batches
+    last_column = pass->first_column + pass->columns - 1;
+    last_row = pass->first_row + rows - 1;
+
+    clSetKernelArg(kernel, 0, sizeof(cl_mem), (void *) &device->graph_mem_obj[pass->slot]);
+    clSetKernelArg(kernel, 1, sizeof(int), &render->res_x);
+    clSetKernelArg(kernel, 2, sizeof(int), &render->res_y);
+    if (device->double_precision)
+    {
+        clSetKernelArg(kernel, 3, sizeof(double), &pass->zoom);
+        clSetKernelArg(kernel, 4, sizeof(double), &pass->center_x);
+        clSetKernelArg(kernel, 5, sizeof(double), &pass->center_y);
+    }
+    else
+    {
+        single[0] = pass->zoom;
+        single[1] = pass->center_x;
+        single[2] = pass->center_y;
+        clSetKernelArg(kernel, 3, sizeof(float), &single[0]);
+        clSetKernelArg(kernel, 4, sizeof(float), &single[1]);
+        clSetKernelArg(kernel, 5, sizeof(float), &single[2]);
+    }
+    clSetKernelArg(kernel, 6, sizeof(int), &pass->max_iteration);
+    clSetKernelArg(kernel, 7, sizeof(int), &pass->step);
+    clSetKernelArg(kernel, 8, sizeof(int), &pass->coarse);
+    clSetKernelArg(kernel, 9, sizeof(int), &last_column);
+    clSetKernelArg(kernel, 10, sizeof(int), &last_row);
+
+    ret = clEnqueueNDRangeKernel(device->command_queue, kernel, 2, global_item_offset,
+            global_item_size, local_item_size, 0, NULL, &batch->kernel_done);
+
+    if (ret != CL_SUCCESS)
+    {
+        batch->busy = 0;
+        printf("Error while executing kernel\n");
+        printf("Error code %d\n", ret);
+        return 1;
+    }
+
+    // The queue is in order, the map waits for the kernel by itself
+    batch->mapped = clEnqueueMapBuffer(device->command_queue, device->graph_mem_obj[pass->slot], CL_FALSE, CL_MAP_READ,
+            (size_t) top * render->res_x * sizeof(int), (size_t) (bottom - top + 1) * render->res_x * sizeof(int),
+            0, NULL, &batch->map_done, &ret);
+
+    if (ret != CL_SUCCESS)
+    {
+        batch->busy = 0;
+        clReleaseEvent(batch->kernel_done);
+        printf("Error while mapping results buffer\n");
+        return 1;
+    }
+
+    clFlush(device->command_queue);
+
+    // What is left of the pass, gone once all its rows are handed out
+    pass->first_row += rows;
+    pass->rows -= rows;
+    if (pass->rows == 0)
+    {
+        render->number_passes--;
+        memmove(&render->passes[0], &render->passes[1], render->number_passes * sizeof(cl_render_pass_work));
+    }
+
+    return 0;
+}
+
+// A batch is back: its samples go from the mapped rows into the frame,
+// its kernel time into the throughput of the device
+static void cl_render_collect(cl_render *render, cl_render_device *device, cl_render_batch *batch)
+{
+    cl_ulong start = 0, end = 0;
+    double samples = (double) batch->rows * batch->columns;
+    int *frame = render->frames[batch->slot];
+    const int *mapped = batch->mapped;
+    int top = batch->first_row * batch->step;
+    int row, column, x, y, left, right;
+
+    if ((batch->step == 1) && (batch->coarse == 0))
+    {
+        // Whole rows of a full pass, from the first column of the batch to
+        // the last one in the image
+        left = batch->first_column;
+        right = (batch->first_column + batch->columns < render->res_x) ? batch->first_column + batch->columns : render->res_x;
+        for (y = batch->first_row; y < batch->first_row + batch->rows; y++)
+            memcpy(&frame[left + y * render->res_x], &mapped[left + (y - top) * render->res_x], (right - left) * sizeof(int));
+    }
+    else
+    {
+        // Only the samples of the pass, the rows hold those of the others
+        for (row = batch->first_row; row < batch->first_row + batch->rows; row++)
+        {
+            y = row * batch->step;
+            for (column = batch->first_column; column < batch->first_column + batch->columns; column++)
+            {
+                x = column * batch->step;
+                if (x >= render->res_x)
+                    break;
+                if ((batch->coarse > 0) && (x % batch->coarse == 0) && (y % batch->coarse == 0))
+                    continue;
+                frame[x + y * render->res_x] = mapped[x + (y - top) * render->res_x];
+            }
+        }
+    }
+
+    clEnqueueUnmapMemObject(device->command_queue, device->graph_mem_obj[batch->slot], batch->mapped, 0, NULL, NULL);
+    clFlush(device->command_queue);
+
+    if ((clGetEventProfilingInfo(batch->kernel_done, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL) == CL_SUCCESS) &&
+        (clGetEventProfilingInfo(batch->kernel_done, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL) == CL_SUCCESS) &&
+        (end > start))
+    {
+        if (device->throughput > 0.0)
+            device->throughput = 0.75 * device->throughput + 0.25 * samples / ((end - start) * 1e-9);
+        else
+            device->throughput = samples / ((end - start) * 1e-9);
+    }
+    device->samples += samples;
+
+    clReleaseEvent(batch->kernel_done);
+    clReleaseEvent(batch->map_done);
+    batch->busy = 0;
+}
+
+// Collects the batches done and hands out work to the free ones. When
+// blocking, waits for the oldest batch out and does it again until
+// nothing of the slot (any slot for -1) is left.
+static int cl_render_drive(cl_render *render, int slot, int block)
+{
+    cl_render_device *device;
+    cl_render_batch *batch, *oldest;
+    cl_int status;
+    int number, index, pending;
+
+    while (1)
+    {
+        pending = 0;
+        oldest = NULL;
+
+        for (number = 0; number < render->number_devices; number++)
+        {
+            device = &render->devices[number];
+            for (index = 0; index < CL_RENDER_IN_FLIGHT; index++)
+            {
+                batch = &device->batches[index];
+                if (batch->busy)
+                {
+                    clGetEventInfo(batch->map_done, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, NULL);
+                    if (status < 0)
+                    {
+                        printf("Error while rendering on %s, error code %d\n", device->name, status);
+                        return 1;
+                    }
+                    if (status == CL_COMPLETE)
+                        cl_render_collect(render, device, batch);
+                }
+
+                if ((!batch->busy) && (render->number_passes > 0) && (cl_render_dispatch(render, device, batch) != 0))
+                    return 1;
+
+                if (batch->busy && ((slot < 0) || (batch->slot == slot)))
+                    pending = 1;
+                if (batch->busy && ((oldest == NULL) || (batch->sequence < oldest->sequence)))
+                    oldest = batch;
+            }
+        }
+
+        for (index = 0; index < render->number_passes; index++)
+            if ((slot < 0) || (render->passes[index].slot == slot))
+                pending = 1;
+
+        if ((!block) || (!pending) || (oldest == NULL))
+            return 0;
+
+        if (clWaitForEvents(1, &oldest->map_done) != CL_SUCCESS)
+        {
+            printf("Error while waiting for the devices\n");
+            return 1;
+        }
+    }
+}
+
+// Queues part of a pass into the frame of a slot: the samples every step
+// pixels, a rectangle of columns x rows of them from (first_column,
+// first_row). Those also on the grid of coarse (0 for none) are left as
+// they are. Returns once the devices have their first batches.
+int cl_render_pass(cl_render *render, int slot, double zoom, double center_x, double center_y, int max_iteration,
+                   int step, int coarse, int first_column, int first_row, int columns, int rows)
+{
+    cl_render_pass_work *pass;
+    int last_row = (render->res_y - 1) / step;
+
+    // Rows out of the image are not mapped
+    if (first_row + rows > last_row + 1)
+        rows = last_row + 1 - first_row;
+    if ((rows <= 0) || (columns <= 0))
+        return 0;
+
+    // Wait for room
+    while (render->number_passes == CL_RENDER_MAX_PASSES)
+        if (cl_render_drive(render, render->passes[0].slot, 1) != 0)
+            return 1;
+
+    pass = &render->passes[render->number_passes++];
+    pass->slot = slot;
+    pass->zoom = zoom;
+    pass->center_x = center_x;
+    pass->center_y = center_y;
+    pass->max_iteration = max_iteration;
+    pass->step = step;
+    pass->coarse = coarse;
+    pass->first_column = first_column;
+    pass->columns = columns;
+    pass->first_row = first_row;
+    pass->rows = rows;
+
+    return cl_render_drive(render, slot, 0);
+}
+
+// Blocks until everything queued is in the frames
+int cl_render_finish(cl_render *render)
+{
+    return cl_render_drive(render, -1, 1);
+}
+
+// Queues a whole frame into the slot. Returns at once.
+int cl_render_submit(cl_render *render, int slot, double zoom, double center_x, double center_y, int max_iteration)
+{
+    return cl_render_pass(render, slot, zoom, center_x, center_y, max_iteration, 1, 0,
+                          0, 0, render->res_x, render->res_y);
+}
+
+// Blocks until the frame of the slot is complete, gives its iterations.
+// They stay there until the slot is queued again.
+int *cl_render_wait(cl_render *render, int slot)
+{
+    if (cl_render_drive(render, slot, 1) != 0)
+        return NULL;
+
+    return render->frames[slot];
+}
+
+// Synchronous frame into out (res_x * res_y iterations)
+int cl_render_frame(cl_render *render, double zoom, double center_x, double center_y, int max_iteration, int *out)
+{
+    int *frame;
+
+    if ((cl_render_submit(render, 0, zoom, center_x, center_y, max_iteration) != 0) ||
+        ((frame = cl_render_wait(render, 0)) == NULL))
+        return 1;
+
+    memcpy(out, frame, render->res_x * render->res_y * sizeof(int));
+    return 0;
+}
+
+// Room on the device for a list of count points and their counts
+static int cl_render_reserve(cl_render_device *device, int count)
+{
+    cl_int ret;
+
+    if (count <= device->samples_capacity)
+        return 0;
+
+    // Buffers still used by queued commands are kept by the runtime
+    if (device->points_mem_obj != NULL)
+        clReleaseMemObject(device->points_mem_obj);
+    if (device->samples_mem_obj != NULL)
+        clReleaseMemObject(device->samples_mem_obj);
+    device->samples_mem_obj = NULL;
+    device->samples_capacity = 0;
+
+    device->points_mem_obj = clCreateBuffer(device->context, CL_MEM_READ_ONLY,
+            2 * count * (device->double_precision ? sizeof(double) : sizeof(float)), NULL, &ret);
+    if (ret != CL_SUCCESS)
+    {
+        device->points_mem_obj = NULL;
+        fprintf(stderr, "Could not allocate the point buffers, error code %d\n", ret);
+        return 2;
+    }
+    device->samples_mem_obj = clCreateBuffer(device->context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR,
+            count * sizeof(int), NULL, &ret);
+    if (ret != CL_SUCCESS)
+    {
+        device->samples_mem_obj = NULL;
+        fprintf(stderr, "Could not allocate the point buffers, error code %d\n", ret);
+        return 2;
+    }
+
+    device->samples_capacity = count;
+    return 0;
+}
+
+// Counts of a list of points of the plane into out, x and y of point i at
+// points[2 * i] and points[2 * i + 1]. zoom is only used by Julia, see
+// the kernel. The list is cut among the devices by throughput, behind the
+// batches they already have queued. Blocks until every count is back.
+int cl_render_samples(cl_render *render, const double *points, int count, double zoom, int max_iteration, int *out)
+{
+    cl_render_device *device;
+    cl_kernel kernel;
+    cl_event read_done[CL_RENDER_MAX_DEVICES];
+    size_t global_item_size, local_item_size = CL_GROUP_X * CL_GROUP_Y;
+    double total = 0.0, average = 0.0, weight;
+    float single;
+    int number, measured = 0, first = 0, part, index, waiting = 0, ret = 0;
+
+    if (count <= 0)
+        return 0;
+
+    if (2 * count > render->single_capacity)
+    {
+        free(render->single_points);
+        render->single_points = malloc(2 * count * sizeof(float));
+        render->single_capacity = (render->single_points != NULL) ? 2 * count : 0;
+        if (render->single_points == NULL)
+        {
+            fprintf(stderr, "Bad luck, out of memory\n");
+            return 2;
+        }
+    }
+    for (index = 0; index < 2 * count; index++)
+        render->single_points[index] = points[index];
+
+    // Devices not measured yet count as the average of the others
+    for (number = 0; number < render->number_devices; number++)
+    {
+        if (render->devices[number].throughput > 0.0)
+        {
+            average += render->devices[number].throughput;
+            measured++;
+        }
+    }
+    average = (measured > 0) ? average / measured : 1.0;
+    for (number = 0; number < render->number_devices; number++)
+        total += (render->devices[number].throughput > 0.0) ? render->devices[number].throughput : average;
+
+    for (number = 0; (number < render->number_devices) && (first < count); number++)
+    {
+        device = &render->devices[number];
+        weight = (device->throughput > 0.0) ? device->throughput : average;
+        part = (number == render->number_devices - 1) ? count - first : (int) (count * weight / total);
+        if (part <= 0)
+            continue;
+
+        if (cl_render_reserve(device, part) != 0)
+        {
+            ret = 2;
+            break;
+        }
+
+        if (device->double_precision)
+            ret = clEnqueueWriteBuffer(device->command_queue, device->points_mem_obj, CL_FALSE, 0,
+                                       2 * part * sizeof(double), &points[2 * first], 0, NULL, NULL);
+        else
+            ret = clEnqueueWriteBuffer(device->command_queue, device->points_mem_obj, CL_FALSE, 0,
+                                       2 * part * sizeof(float), &render->single_points[2 * first], 0, NULL, NULL);
+        if (ret != CL_SUCCESS)
+        {
+            printf("Error while writing the points, error code %d\n", ret);
+            ret = 1;
+            break;
+        }
+
+        kernel = cl_render_variant_for(render, device, max_iteration)->samples_kernel;
+        clSetKernelArg(kernel, 0, sizeof(cl_mem), (void *) &device->samples_mem_obj);
+        clSetKernelArg(kernel, 1, sizeof(cl_mem), (void *) &device->points_mem_obj);
+        clSetKernelArg(kernel, 2, sizeof(int), &part);
+        if (device->double_precision)
+            clSetKernelArg(kernel, 3, sizeof(double), &zoom);
+        else
+        {
+            single = zoom;
+            clSetKernelArg(kernel, 3, sizeof(float), &single);
+        }
+        clSetKernelArg(kernel, 4, sizeof(int), &max_iteration);
+
+        global_item_size = ((part + local_item_size - 1) / local_item_size) * local_item_size;
+        ret = clEnqueueNDRangeKernel(device->command_queue, kernel, 1, NULL, &global_item_size, &local_item_size,
+                                     0, NULL, NULL);
+        if (ret == CL_SUCCESS)
+            ret = clEnqueueReadBuffer(device->command_queue, device->samples_mem_obj, CL_FALSE, 0,
+                                      part * sizeof(int), &out[first], 0, NULL, &read_done[waiting]);
+        if (ret != CL_SUCCESS)
+        {
+            printf("Error while computing the points, error code %d\n", ret);
+            ret = 1;
+            break;
+        }
+
+        clFlush(device->command_queue);
+        waiting++;
+        first += part;
+    }
+
+    // Even after an error, the points and out are used until these are done
+    if ((waiting > 0) && (clWaitForEvents(waiting, read_done) != CL_SUCCESS) && (ret == 0))
+    {
+        printf("Error while waiting for the devices\n");
+        ret = 1;
+    }
+    for (index = 0; index < waiting; index++)
+        clReleaseEvent(read_done[index]);
+
+    return ret;
+}
+
+// Share of the samples each device computed, and its last throughput
+void cl_render_report(const cl_render *render, FILE *file)
+{
+    double total = 0.0;
+    int number;
+
+    for (number = 0; number < render->number_devices; number++)
+        total += render->devices[number].samples;
+
+    for (number = 0; number < render->number_devices; number++)
+        fprintf(file, "Device %d %s: %.1f%% of the samples, %.1f Msamples/s\n", number, render->devices[number].name,
+                (total > 0.0) ? 100.0 * render->devices[number].samples / total : 0.0,
+                render->devices[number].throughput * 1e-6);
+}
+
+void cl_render_release(cl_render *render)
+{
+    int number, slot;
+
+    cl_render_finish(render);
+
+    for (number = 0; number < render->number_devices; number++)
+    {
+        clFinish(render->devices[number].command_queue);
+        cl_render_close(&render->devices[number]);
+    }
+
+    for (slot = 0; slot < CL_RENDER_BUFFERS; slot++)
+        free(render->frames[slot]);
+    free(render->source_str);
+    free(render->single_points);
+}
@@ -0,0 +1,176 @@
+#ifndef CL_RENDER_H
+#define CL_RENDER_H
+
+#include <stdio.h>
+
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// Kernel source of every fractal, and options every program of it is
+// built with
+#define CL_RENDER_KERNEL "fractal_kernel.cl"
+#define CL_RENDER_BUILD_OPTIONS ""
+
+// Formulas of the kernel
+#define CL_FRACTAL_MANDELBROT 0
+#define CL_FRACTAL_JULIA 1
+
+// Programs a device keeps built, one per cap when the cap is a constant
+// of the kernel. The least used one goes when a new cap comes.
+#define CL_RENDER_MAX_VARIANTS 8
+#define CL_RENDER_OPTIONS_SIZE 256
+
+// Frames in flight. While the host colorizes one frame the devices work
+// on the next one.
+#define CL_RENDER_BUFFERS 2
+
+// Limits of the device list and of the work queued at once
+#define CL_RENDER_MAX_DEVICES 16
+#define CL_RENDER_MAX_PASSES 8
+
+// Batches a device may have queued at once, so it has the next one at
+// hand when it is done with the current one
+#define CL_RENDER_IN_FLIGHT 2
+
+// A batch is sized to keep its device busy for about this many seconds,
+// from the throughput measured on the batches before
+#define CL_RENDER_BATCH_TIME 0.004
+
+// Work group of the launches, batches are whole groups of rows
+#define CL_GROUP_X 16
+#define CL_GROUP_Y 16
+
+// What the kernel is specialized for when it is built. All but the cap
+// are fixed for the lifetime of the render.
+typedef struct cl_render_options cl_render_options;
+struct cl_render_options
+{
+    int fractal;
+    int double_precision;
+    double julia_x;
+    double julia_y;
+    int unroll;
+
+    // A program per cap, with the cap a constant of the kernel. Suits
+    // renders whose cap seldom changes, building one takes a while.
+    int constant_iterations;
+};
+
+// Program of a device for one cap (0 when the cap is an argument), with
+// its kernels for frames and for lists of points
+typedef struct cl_render_variant cl_render_variant;
+struct cl_render_variant
+{
+    int max_iteration;
+    cl_program program;
+    cl_kernel kernel;
+    cl_kernel samples_kernel;
+    unsigned long used;
+};
+
+// Part of a pass handed to a device: sample rows first_row to first_row +
+// rows - 1 of it. The image rows they span are mapped once the kernel is
+// done, its samples go from there into the frame and the rows are
+// unmapped.
+typedef struct cl_render_batch cl_render_batch;
+struct cl_render_batch
+{
+    int busy;
+    int slot;
+    int step;
+    int coarse;
+    int first_column;
+    int columns;
+    int first_row;
+    int rows;
+    unsigned long sequence;
+    cl_event kernel_done;
+    cl_event map_done;
+    int *mapped;
+};
+
+// Every device has its own context, programs and an output buffer per
+// slot, in host visible memory. Its first program takes the cap as an
+// argument and stays, the others are built as the caps come. The throughput (samples per second) is measured from the profiling of its
+// kernels and sizes the batches it gets.
+typedef struct cl_render_device cl_render_device;
+struct cl_render_device
+{
+    cl_device_id device_id;
+    char name[64];
+    cl_context context;
+    cl_command_queue command_queue;
+    int double_precision;
+    char options[CL_RENDER_OPTIONS_SIZE];
+    cl_render_variant variants[CL_RENDER_MAX_VARIANTS];
+    int number_variants;
+    cl_mem graph_mem_obj[CL_RENDER_BUFFERS];
+    cl_mem points_mem_obj;
+    cl_mem samples_mem_obj;
+    int samples_capacity;
+    double throughput;
+    double samples;
+    cl_render_batch batches[CL_RENDER_IN_FLIGHT];
+};
+
+// Work queued and not yet handed out: a rectangle of samples of a pass,
+// rows are taken off its top as batches go
+typedef struct cl_render_pass_work cl_render_pass_work;
+struct cl_render_pass_work
+{
+    int slot;
+    double zoom;
+    double center_x;
+    double center_y;
+    int max_iteration;
+    int step;
+    int coarse;
+    int first_column;
+    int columns;
+    int first_row;
+    int rows;
+};
+
+// OpenCL host side shared by clfract, clfractinteractive and the benchmark.
+// Every device of every platform takes part, CPU ones too, optionally cut
+// into sub-devices. A frame is split in batches of rows handed out to the
+// devices as they get done with the ones before, in the frame buffer of
+// its slot on the host.
+typedef struct cl_render cl_render;
+struct cl_render
+{
+    int res_x;
+    int res_y;
+    cl_render_options options;
+    char *source_str;
+    size_t source_size;
+    int number_devices;
+    cl_render_device devices[CL_RENDER_MAX_DEVICES];
+    int *frames[CL_RENDER_BUFFERS];
+
+    // Lists of points in single precision, for the devices without doubles
+    float *single_points;
+    int single_capacity;
+
+    // Passes waiting to be handed out, oldest first
+    cl_render_pass_work passes[CL_RENDER_MAX_PASSES];
+    int number_passes;
+    unsigned long sequence;
+};
+
+void cl_render_defaults(cl_render_options *options, int fractal);
+int cl_render_init(cl_render *render, const cl_render_options *options, int res_x, int res_y, int subdevices);
+int cl_render_pass(cl_render *render, int slot, double zoom, double center_x, double center_y, int max_iteration,
+                   int step, int coarse, int first_column, int first_row, int columns, int rows);
+int cl_render_finish(cl_render *render);
+int cl_render_submit(cl_render *render, int slot, double zoom, double center_x, double center_y, int max_iteration);
+int *cl_render_wait(cl_render *render, int slot);
+int cl_render_frame(cl_render *render, double zoom, double center_x, double center_y, int max_iteration, int *out);
+int cl_render_samples(cl_render *render, const double *points, int count, double zoom, int max_iteration, int *out);
+void cl_render_report(const cl_render *render, FILE *file);
+void cl_render_release(cl_render *render);
+
+#endif
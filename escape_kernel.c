@@ -0,0 +1,490 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "escape_kernel.h"
+#include "fractal_engine.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ESCAPE_X86
+#include <immintrin.h>
+#endif
+
+// Main cardioid and period-2 bulb check, points inside never escape
+int escape_in_bulbs(float pos_x, float pos_y)
+{
+    return fractal_in_bulbs_float(pos_x, pos_y);
+}
+
+// Points that never escape are reported as 0, like the other renderers.
+// z is where the orbit stopped, with c it gives the normalized count.
+static inline void escape_store(const escape_job *job, int pixel, int iteration, float zx, float zy, float cx, float cy)
+{
+    int i = pixel % job->width;
+    int j = pixel / job->width;
+    int value = (iteration < job->max_iteration) ? iteration : 0;
+    double normalized;
+
+    if ((job->fraction != NULL) && (value > 0))
+    {
+        // Kept within the escaped counts
+        normalized = fractal_normalized_float(job->power, iteration, zx, zy, cx, cy);
+        if (normalized < 1.0)
+            normalized = 1.0;
+        if (normalized >= job->max_iteration - 1)
+            normalized = job->max_iteration - 1;
+        value = (int) normalized;
+        job->fraction[i + j * job->stride] = (normalized - value) * ESCAPE_FRACTION_ONE;
+    }
+    else if (job->fraction != NULL)
+        job->fraction[i + j * job->stride] = 0;
+
+    job->out[i + j * job->stride] = value;
+}
+
+// Moves to the next pixel of the job that needs iterating and loads its
+// starting point. Returns 0 when the job has no pixels left.
+static inline int escape_refill(const escape_job *job, int *next, int *pixel,
+                                float *cx, float *cy, float *zx, float *zy)
+{
+    int total = job->width * job->height;
+    float pos_x, pos_y;
+
+    while (*next < total)
+    {
+        *pixel = (*next)++;
+        pos_x = job->pos_x[*pixel % job->width];
+        pos_y = job->pos_y[job->paired ? *pixel : *pixel / job->width];
+
+        if (job->julia_mode)
+        {
+            *zx = pos_x;
+            *zy = pos_y;
+            *cx = job->julia_x;
+            *cy = job->julia_y;
+            return 1;
+        }
+
+        if (escape_in_bulbs(pos_x, pos_y))
+        {
+            escape_store(job, *pixel, job->max_iteration, 0.0, 0.0, 0.0, 0.0);
+            continue;
+        }
+
+        *zx = 0.0;
+        *zy = 0.0;
+        *cx = pos_x;
+        *cy = pos_y;
+        return 1;
+    }
+
+    return 0;
+}
+
+// Scalar loop over the job for one formula and power, always called
+// with constants so each caller below gets its own specialized copy
+FRACTAL_INLINE void escape_tile_formula(const escape_job *job, int formula, int power)
+{
+    int total = job->width * job->height, pixel, iteration;
+    int features = FRACTAL_PERIOD | FRACTAL_BULBS;
+    float pos_x, pos_y, zx, zy, cx, cy;
+
+    for (pixel = 0; pixel < total; pixel++)
+    {
+        pos_x = job->pos_x[pixel % job->width];
+        pos_y = job->pos_y[job->paired ? pixel : pixel / job->width];
+
+        iteration = job->max_iteration;
+        if (fractal_start_float(formula, power, features, pos_x, pos_y, job->julia_x, job->julia_y, &zx, &zy, &cx, &cy))
+            iteration = fractal_escape_float(power, features, &zx, &zy, cx, cy, 0, job->max_iteration);
+        escape_store(job, pixel, iteration, zx, zy, cx, cy);
+    }
+}
+
+static void escape_tile_mandelbrot(const escape_job *job)
+{
+    escape_tile_formula(job, FRACTAL_MANDELBROT, 2);
+}
+
+static void escape_tile_julia(const escape_job *job)
+{
+    escape_tile_formula(job, FRACTAL_JULIA, 2);
+}
+
+static void escape_tile_multibrot(const escape_job *job)
+{
+    escape_tile_formula(job, FRACTAL_MANDELBROT, job->power);
+}
+
+static void escape_tile_multijulia(const escape_job *job)
+{
+    escape_tile_formula(job, FRACTAL_JULIA, job->power);
+}
+
+// The formula is picked once for the whole job
+void escape_tile_scalar(const escape_job *job)
+{
+    if (job->power != 2)
+    {
+        if (job->julia_mode)
+            escape_tile_multijulia(job);
+        else
+            escape_tile_multibrot(job);
+    }
+    else if (job->julia_mode)
+        escape_tile_julia(job);
+    else
+        escape_tile_mandelbrot(job);
+}
+
+#ifdef ESCAPE_X86
+
+// The vector versions keep one pixel per lane. As soon as any lane escapes,
+// falls in a cycle or hits max_iteration the lanes are spilled, the finished ones are stored
+// and refilled with the next pixels, and iteration resumes. Lanes left
+// without work iterate z = 0, c = 0 and are ignored.
+
+__attribute__((target("sse2")))
+static void escape_tile_sse2(const escape_job *job)
+{
+    float cx[4] __attribute__((aligned(16)));
+    float cy[4] __attribute__((aligned(16)));
+    float zx[4] __attribute__((aligned(16)));
+    float zy[4] __attribute__((aligned(16)));
+    float sx[4] __attribute__((aligned(16)));
+    float sy[4] __attribute__((aligned(16)));
+    int it[4] __attribute__((aligned(16)));
+    int save_at[4] __attribute__((aligned(16)));
+    int on[4] __attribute__((aligned(16)));
+    int pixel[4];
+    int next = 0, lane, done, escapes, cycled, active = 0;
+
+    // Lanes only square z
+    if (job->power != 2)
+    {
+        escape_tile_scalar(job);
+        return;
+    }
+
+    for (lane = 0; lane < 4; lane++)
+    {
+        it[lane] = 0;
+        on[lane] = 0;
+        save_at[lane] = 1;
+        sx[lane] = sy[lane] = ESCAPE_PERIOD_UNSET;
+        if (escape_refill(job, &next, &pixel[lane], &cx[lane], &cy[lane], &zx[lane], &zy[lane]))
+        {
+            on[lane] = -1;
+            active++;
+        }
+        else
+            cx[lane] = cy[lane] = zx[lane] = zy[lane] = 0.0;
+    }
+
+    const __m128 four = _mm_set1_ps(4.0f);
+    const __m128 tolerance = _mm_set1_ps(ESCAPE_PERIOD_TOLERANCE);
+    const __m128i max_iteration = _mm_set1_epi32(job->max_iteration);
+    const __m128i one = _mm_set1_epi32(1);
+
+    while (active > 0)
+    {
+        __m128 vcx = _mm_load_ps(cx), vcy = _mm_load_ps(cy);
+        __m128 vzx = _mm_load_ps(zx), vzy = _mm_load_ps(zy);
+        __m128 vsx = _mm_load_ps(sx), vsy = _mm_load_ps(sy);
+        __m128i vit = _mm_load_si128((__m128i *) it);
+        __m128i vsave = _mm_load_si128((__m128i *) save_at);
+        __m128 von = _mm_castsi128_ps(_mm_load_si128((__m128i *) on));
+        __m128 escaped, periodic;
+
+        while (1)
+        {
+            __m128 xx = _mm_mul_ps(vzx, vzx);
+            __m128 yy = _mm_mul_ps(vzy, vzy);
+            escaped = _mm_cmpgt_ps(_mm_add_ps(xx, yy), four);
+            __m128 running = _mm_castsi128_ps(_mm_cmplt_epi32(vit, max_iteration));
+            __m128 dx = _mm_sub_ps(vzx, vsx);
+            __m128 dy = _mm_sub_ps(vzy, vsy);
+            periodic = _mm_cmplt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), tolerance);
+            __m128 finished = _mm_and_ps(von, _mm_or_ps(_mm_or_ps(escaped, periodic), _mm_andnot_ps(running, von)));
+
+            done = _mm_movemask_ps(finished);
+            if (done) break;
+
+            // Brent: the orbit is saved when the count reaches save_at,
+            // which then doubles
+            __m128 saving = _mm_castsi128_ps(_mm_cmpeq_epi32(vit, vsave));
+            vsx = _mm_or_ps(_mm_and_ps(saving, vzx), _mm_andnot_ps(saving, vsx));
+            vsy = _mm_or_ps(_mm_and_ps(saving, vzy), _mm_andnot_ps(saving, vsy));
+            vsave = _mm_add_epi32(vsave, _mm_and_si128(_mm_castps_si128(saving), vsave));
+
+            __m128 xplusy = _mm_add_ps(vzx, vzy);
+            vzy = _mm_add_ps(_mm_sub_ps(_mm_sub_ps(_mm_mul_ps(xplusy, xplusy), xx), yy), vcy);
+            vzx = _mm_add_ps(_mm_sub_ps(xx, yy), vcx);
+            vit = _mm_add_epi32(vit, one);
+        }
+
+        _mm_store_ps(zx, vzx);
+        _mm_store_ps(zy, vzy);
+        _mm_store_ps(sx, vsx);
+        _mm_store_ps(sy, vsy);
+        _mm_store_si128((__m128i *) it, vit);
+        _mm_store_si128((__m128i *) save_at, vsave);
+        escapes = _mm_movemask_ps(escaped);
+        cycled = _mm_movemask_ps(periodic) & ~escapes;
+
+        for (lane = 0; lane < 4; lane++)
+        {
+            if (!(done & (1 << lane)))
+                continue;
+
+            escape_store(job, pixel[lane], (cycled & (1 << lane)) ? job->max_iteration : it[lane], zx[lane], zy[lane],
+                         cx[lane], cy[lane]);
+            it[lane] = 0;
+            save_at[lane] = 1;
+            sx[lane] = sy[lane] = ESCAPE_PERIOD_UNSET;
+            if (!escape_refill(job, &next, &pixel[lane], &cx[lane], &cy[lane], &zx[lane], &zy[lane]))
+            {
+                on[lane] = 0;
+                cx[lane] = cy[lane] = zx[lane] = zy[lane] = 0.0;
+                active--;
+            }
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void escape_tile_avx2(const escape_job *job)
+{
+    float cx[8] __attribute__((aligned(32)));
+    float cy[8] __attribute__((aligned(32)));
+    float zx[8] __attribute__((aligned(32)));
+    float zy[8] __attribute__((aligned(32)));
+    float sx[8] __attribute__((aligned(32)));
+    float sy[8] __attribute__((aligned(32)));
+    int it[8] __attribute__((aligned(32)));
+    int save_at[8] __attribute__((aligned(32)));
+    int on[8] __attribute__((aligned(32)));
+    int pixel[8];
+    int next = 0, lane, done, escapes, cycled, active = 0;
+
+    // Lanes only square z
+    if (job->power != 2)
+    {
+        escape_tile_scalar(job);
+        return;
+    }
+
+    for (lane = 0; lane < 8; lane++)
+    {
+        it[lane] = 0;
+        on[lane] = 0;
+        save_at[lane] = 1;
+        sx[lane] = sy[lane] = ESCAPE_PERIOD_UNSET;
+        if (escape_refill(job, &next, &pixel[lane], &cx[lane], &cy[lane], &zx[lane], &zy[lane]))
+        {
+            on[lane] = -1;
+            active++;
+        }
+        else
+            cx[lane] = cy[lane] = zx[lane] = zy[lane] = 0.0;
+    }
+
+    const __m256 four = _mm256_set1_ps(4.0f);
+    const __m256 tolerance = _mm256_set1_ps(ESCAPE_PERIOD_TOLERANCE);
+    const __m256i max_iteration = _mm256_set1_epi32(job->max_iteration);
+    const __m256i one = _mm256_set1_epi32(1);
+
+    while (active > 0)
+    {
+        __m256 vcx = _mm256_load_ps(cx), vcy = _mm256_load_ps(cy);
+        __m256 vzx = _mm256_load_ps(zx), vzy = _mm256_load_ps(zy);
+        __m256 vsx = _mm256_load_ps(sx), vsy = _mm256_load_ps(sy);
+        __m256i vit = _mm256_load_si256((__m256i *) it);
+        __m256i vsave = _mm256_load_si256((__m256i *) save_at);
+        __m256 von = _mm256_castsi256_ps(_mm256_load_si256((__m256i *) on));
+        __m256 escaped, periodic;
+
+        while (1)
+        {
+            __m256 xx = _mm256_mul_ps(vzx, vzx);
+            __m256 yy = _mm256_mul_ps(vzy, vzy);
+            escaped = _mm256_cmp_ps(_mm256_add_ps(xx, yy), four, _CMP_GT_OQ);
+            __m256 maxed = _mm256_castsi256_ps(_mm256_cmpgt_epi32(one, _mm256_sub_epi32(max_iteration, vit)));
+            __m256 dx = _mm256_sub_ps(vzx, vsx);
+            __m256 dy = _mm256_sub_ps(vzy, vsy);
+            periodic = _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), tolerance, _CMP_LT_OQ);
+            __m256 finished = _mm256_and_ps(von, _mm256_or_ps(_mm256_or_ps(escaped, periodic), maxed));
+
+            done = _mm256_movemask_ps(finished);
+            if (done) break;
+
+            __m256 saving = _mm256_castsi256_ps(_mm256_cmpeq_epi32(vit, vsave));
+            vsx = _mm256_blendv_ps(vsx, vzx, saving);
+            vsy = _mm256_blendv_ps(vsy, vzy, saving);
+            vsave = _mm256_add_epi32(vsave, _mm256_and_si256(_mm256_castps_si256(saving), vsave));
+
+            __m256 xplusy = _mm256_add_ps(vzx, vzy);
+            vzy = _mm256_add_ps(_mm256_sub_ps(_mm256_sub_ps(_mm256_mul_ps(xplusy, xplusy), xx), yy), vcy);
+            vzx = _mm256_add_ps(_mm256_sub_ps(xx, yy), vcx);
+            vit = _mm256_add_epi32(vit, one);
+        }
+
+        _mm256_store_ps(zx, vzx);
+        _mm256_store_ps(zy, vzy);
+        _mm256_store_ps(sx, vsx);
+        _mm256_store_ps(sy, vsy);
+        _mm256_store_si256((__m256i *) it, vit);
+        _mm256_store_si256((__m256i *) save_at, vsave);
+        escapes = _mm256_movemask_ps(escaped);
+        cycled = _mm256_movemask_ps(periodic) & ~escapes;
+
+        for (lane = 0; lane < 8; lane++)
+        {
+            if (!(done & (1 << lane)))
+                continue;
+
+            escape_store(job, pixel[lane], (cycled & (1 << lane)) ? job->max_iteration : it[lane], zx[lane], zy[lane],
+                         cx[lane], cy[lane]);
+            it[lane] = 0;
+            save_at[lane] = 1;
+            sx[lane] = sy[lane] = ESCAPE_PERIOD_UNSET;
+            if (!escape_refill(job, &next, &pixel[lane], &cx[lane], &cy[lane], &zx[lane], &zy[lane]))
+            {
+                on[lane] = 0;
+                cx[lane] = cy[lane] = zx[lane] = zy[lane] = 0.0;
+                active--;
+            }
+        }
+    }
+}
+
+// AVX-512 brings FMA along, keep it from fusing the multiplies so the
+// results match the scalar code bit for bit
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+static void escape_tile_avx512(const escape_job *job)
+{
+    float cx[16] __attribute__((aligned(64)));
+    float cy[16] __attribute__((aligned(64)));
+    float zx[16] __attribute__((aligned(64)));
+    float zy[16] __attribute__((aligned(64)));
+    float sx[16] __attribute__((aligned(64)));
+    float sy[16] __attribute__((aligned(64)));
+    int it[16] __attribute__((aligned(64)));
+    int save_at[16] __attribute__((aligned(64)));
+    int pixel[16];
+    int next = 0, lane;
+    __mmask16 on = 0, done, escaped, cycled;
+
+    // Lanes only square z
+    if (job->power != 2)
+    {
+        escape_tile_scalar(job);
+        return;
+    }
+
+    for (lane = 0; lane < 16; lane++)
+    {
+        it[lane] = 0;
+        save_at[lane] = 1;
+        sx[lane] = sy[lane] = ESCAPE_PERIOD_UNSET;
+        if (escape_refill(job, &next, &pixel[lane], &cx[lane], &cy[lane], &zx[lane], &zy[lane]))
+            on |= (1 << lane);
+        else
+            cx[lane] = cy[lane] = zx[lane] = zy[lane] = 0.0;
+    }
+
+    const __m512 four = _mm512_set1_ps(4.0f);
+    const __m512 tolerance = _mm512_set1_ps(ESCAPE_PERIOD_TOLERANCE);
+    const __m512i max_iteration = _mm512_set1_epi32(job->max_iteration);
+    const __m512i one = _mm512_set1_epi32(1);
+
+    while (on)
+    {
+        __m512 vcx = _mm512_load_ps(cx), vcy = _mm512_load_ps(cy);
+        __m512 vzx = _mm512_load_ps(zx), vzy = _mm512_load_ps(zy);
+        __m512 vsx = _mm512_load_ps(sx), vsy = _mm512_load_ps(sy);
+        __m512i vit = _mm512_load_si512((__m512i *) it);
+        __m512i vsave = _mm512_load_si512((__m512i *) save_at);
+
+        while (1)
+        {
+            __m512 xx = _mm512_mul_ps(vzx, vzx);
+            __m512 yy = _mm512_mul_ps(vzy, vzy);
+            escaped = _mm512_cmp_ps_mask(_mm512_add_ps(xx, yy), four, _CMP_GT_OQ);
+            __mmask16 maxed = _mm512_cmpge_epi32_mask(vit, max_iteration);
+            __m512 dx = _mm512_sub_ps(vzx, vsx);
+            __m512 dy = _mm512_sub_ps(vzy, vsy);
+            cycled = _mm512_cmp_ps_mask(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)), tolerance, _CMP_LT_OQ);
+
+            done = (escaped | maxed | cycled) & on;
+            if (done) break;
+
+            __mmask16 saving = _mm512_cmpeq_epi32_mask(vit, vsave);
+            vsx = _mm512_mask_mov_ps(vsx, saving, vzx);
+            vsy = _mm512_mask_mov_ps(vsy, saving, vzy);
+            vsave = _mm512_mask_add_epi32(vsave, saving, vsave, vsave);
+
+            __m512 xplusy = _mm512_add_ps(vzx, vzy);
+            vzy = _mm512_add_ps(_mm512_sub_ps(_mm512_sub_ps(_mm512_mul_ps(xplusy, xplusy), xx), yy), vcy);
+            vzx = _mm512_add_ps(_mm512_sub_ps(xx, yy), vcx);
+            vit = _mm512_add_epi32(vit, one);
+        }
+
+        _mm512_store_ps(zx, vzx);
+        _mm512_store_ps(zy, vzy);
+        _mm512_store_ps(sx, vsx);
+        _mm512_store_ps(sy, vsy);
+        _mm512_store_si512((__m512i *) it, vit);
+        _mm512_store_si512((__m512i *) save_at, vsave);
+        cycled &= ~escaped;
+
+        for (lane = 0; lane < 16; lane++)
+        {
+            if (!(done & (1 << lane)))
+                continue;
+
+            escape_store(job, pixel[lane], (cycled & (1 << lane)) ? job->max_iteration : it[lane], zx[lane], zy[lane],
+                         cx[lane], cy[lane]);
+            it[lane] = 0;
+            save_at[lane] = 1;
+            sx[lane] = sy[lane] = ESCAPE_PERIOD_UNSET;
+            if (!escape_refill(job, &next, &pixel[lane], &cx[lane], &cy[lane], &zx[lane], &zy[lane]))
+            {
+                on &= ~(1 << lane);
+                cx[lane] = cy[lane] = zx[lane] = zy[lane] = 0.0;
+            }
+        }
+    }
+}
+
+#endif
+
+// Picks the widest instruction set the CPU supports, or the one asked
+// for in isa ("scalar", "sse2", "avx2", "avx512") when it is available
+escape_tile_fn escape_kernel_select(const char *isa, const char **name)
+{
+#ifdef ESCAPE_X86
+    __builtin_cpu_init();
+
+    if (((isa == NULL) || (strcmp(isa, "avx512") == 0)) && __builtin_cpu_supports("avx512f"))
+    {
+        *name = "avx512";
+        return escape_tile_avx512;
+    }
+    if (((isa == NULL) || (strcmp(isa, "avx2") == 0)) && __builtin_cpu_supports("avx2"))
+    {
+        *name = "avx2";
+        return escape_tile_avx2;
+    }
+    if (((isa == NULL) || (strcmp(isa, "sse2") == 0)) && __builtin_cpu_supports("sse2"))
+    {
+        *name = "sse2";
+        return escape_tile_sse2;
+    }
+#endif
+
+    if ((isa != NULL) && (strcmp(isa, "scalar") != 0))
+        fprintf(stderr, "Instruction set %s not available, using scalar code\n", isa);
+
+    *name = "scalar";
+    return escape_tile_scalar;
+}
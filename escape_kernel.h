@@ -0,0 +1,52 @@
+#ifndef ESCAPE_KERNEL_H
+#define ESCAPE_KERNEL_H
+
+// A rectangle of pixels to iterate. Coordinates are separable, so the
+// complex plane position of pixel (i, j) is (pos_x[i], pos_y[j]). With
+// paired set it is a list of width scattered points instead, point i at
+// (pos_x[i], pos_y[i]) with its result in out[i], height must be 1.
+// Power is the exponent of z, 2 for the classic sets; only the scalar
+// kernel does the others, the vector ones hand such jobs to it. With
+// fraction set, escaped pixels get the normalized count instead, whole
+// part in out and fractional part there in 1/256ths with the same stride
+// (0 for the pixels that do not escape). It can be a count off the plain
+// one, never 0 or the cap.
+typedef struct escape_job escape_job;
+struct escape_job
+{
+    int *out;
+    unsigned char *fraction;
+    int stride;
+    const float *pos_x;
+    int width;
+    const float *pos_y;
+    int height;
+    int julia_mode;
+    float julia_x;
+    float julia_y;
+    int power;
+    int max_iteration;
+    int paired;
+};
+
+// Brent cycle detection. The orbit is saved at iterations 1, 2, 4, 8...
+// and if it comes back closer than this (squared distance) to the saved
+// point it is caught in an attracting cycle, so the point is inside the
+// set. A few float ulps around |z| = 1, and a few double ulps for the
+// double precision engine, like the kernel with REAL_DOUBLE.
+#define ESCAPE_PERIOD_TOLERANCE 1.0e-12f
+#define ESCAPE_PERIOD_TOLERANCE_DOUBLE 1.0e-24
+
+// Saved point of a fresh orbit, nothing comes back to it
+#define ESCAPE_PERIOD_UNSET 1.0e6f
+
+// A fraction of 1.0, stored ones stay below it
+#define ESCAPE_FRACTION_ONE 256
+
+typedef void (*escape_tile_fn)(const escape_job *job);
+
+int escape_in_bulbs(float pos_x, float pos_y);
+void escape_tile_scalar(const escape_job *job);
+escape_tile_fn escape_kernel_select(const char *isa, const char **name);
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef FLOATEXP_H
+#define FLOATEXP_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Extended range number: mantissa * 2^exponent, with the mantissa in
+// [0.5, 1) or zero. The exponent is an integer of its own, so values far
+// beyond the double range (1e-308) keep full double precision.
+typedef struct floatexp floatexp;
+struct floatexp
+{
+    double mantissa;
+    int64_t exponent;
+};
+
+// Exponent given to zero so it loses every comparison of magnitudes
+#define FLOATEXP_ZERO_EXPONENT (INT64_MIN / 4)
+
+// 2^power for power in [-1022, 1023], straight from the bits
+static inline double floatexp_pow2(int64_t power)
+{
+    uint64_t bits = (uint64_t) (power + 1023) << 52;
+    double value;
+
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Builds a normalized value from any normal double times 2^exponent
+static inline floatexp floatexp_make(double mantissa, int64_t exponent)
+{
+    floatexp r;
+    uint64_t bits;
+
+    if (mantissa == 0.0)
+    {
+        r.mantissa = 0.0;
+        r.exponent = FLOATEXP_ZERO_EXPONENT;
+        return r;
+    }
+
+    memcpy(&bits, &mantissa, sizeof(bits));
+    r.exponent = exponent + (int64_t) ((bits >> 52) & 0x7ff) - 1022;
+    bits = (bits & 0x800fffffffffffffULL) | (1022ULL << 52);
+    memcpy(&r.mantissa, &bits, sizeof(bits));
+
+    return r;
+}
+
+static inline floatexp floatexp_from_double(double value)
+{
+    int exponent;
+
+    // frexp also copes with subnormals
+    value = frexp(value, &exponent);
+    return floatexp_make(value, exponent);
+}
+
+static inline double floatexp_to_double(floatexp a)
+{
+    if (a.exponent > 1024)
+        return (a.mantissa < 0.0) ? -HUGE_VAL : HUGE_VAL;
+    if (a.exponent < -1074)
+        return 0.0;
+
+    return ldexp(a.mantissa, (int) a.exponent);
+}
+
+static inline floatexp floatexp_mul(floatexp a, floatexp b)
+{
+    return floatexp_make(a.mantissa * b.mantissa, a.exponent + b.exponent);
+}
+
+static inline floatexp floatexp_mul_double(floatexp a, double b)
+{
+    return floatexp_make(a.mantissa * b, a.exponent);
+}
+
+static inline floatexp floatexp_sqr(floatexp a)
+{
+    return floatexp_make(a.mantissa * a.mantissa, 2 * a.exponent);
+}
+
+// Times 2^power, no rounding involved
+static inline floatexp floatexp_ldexp(floatexp a, int64_t power)
+{
+    if (a.mantissa != 0.0)
+        a.exponent += power;
+    return a;
+}
+
+static inline floatexp floatexp_div(floatexp a, floatexp b)
+{
+    return floatexp_make(a.mantissa / b.mantissa, a.exponent - b.exponent);
+}
+
+static inline floatexp floatexp_neg(floatexp a)
+{
+    a.mantissa = -a.mantissa;
+    return a;
+}
+
+static inline floatexp floatexp_add(floatexp a, floatexp b)
+{
+    int64_t shift;
+
+    if (a.exponent < b.exponent)
+    {
+        floatexp swap = a;
+        a = b;
+        b = swap;
+    }
+
+    // Past 64 bits the smaller one cannot change the result
+    shift = a.exponent - b.exponent;
+    if (shift > 64)
+        return a;
+
+    return floatexp_make(a.mantissa + b.mantissa * floatexp_pow2(-shift), a.exponent);
+}
+
+static inline floatexp floatexp_sub(floatexp a, floatexp b)
+{
+    return floatexp_add(a, floatexp_neg(b));
+}
+
+// -1, 0 or 1 like a comparison of a and b
+static inline int floatexp_compare(floatexp a, floatexp b)
+{
+    floatexp difference = floatexp_sub(a, b);
+
+    return (difference.mantissa > 0.0) - (difference.mantissa < 0.0);
+}
+
+// Reads numbers like "1e-400" that strtod would flush to zero
+static inline floatexp floatexp_parse(const char *text)
+{
+    char mantissa_text[64];
+    const char *mark = strpbrk(text, "eE");
+    size_t length = mark ? (size_t) (mark - text) : strlen(text);
+    double power, whole;
+
+    if (length >= sizeof(mantissa_text))
+        length = sizeof(mantissa_text) - 1;
+    memcpy(mantissa_text, text, length);
+    mantissa_text[length] = '\0';
+
+    // 10^e = 2^(e log2(10)), split in an exact power of two and a rest
+    power = mark ? strtol(mark + 1, NULL, 10) * log2(10.0) : 0.0;
+    whole = floor(power);
+
+    return floatexp_make(strtod(mantissa_text, NULL) * exp2(power - whole), (int64_t) whole);
+}
+
+// Base 2 logarithm of |a|, fine for sizing and printing
+static inline double floatexp_log2(floatexp a)
+{
+    return log2(fabs(a.mantissa)) + (double) a.exponent;
+}
+
+#endif
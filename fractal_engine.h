@@ -0,0 +1,181 @@
+#ifndef FRACTAL_ENGINE_H
+#define FRACTAL_ENGINE_H
+
+#include <math.h>
+
+#include "escape_kernel.h"
+
+// The escape loop of the CPU renderers, written once. FRACTAL_ENGINE
+// below defines it for a scalar type and the cycle tolerance that goes
+// with it, and is instantiated for float and double at the end of this
+// header. Formula, power and features are plain arguments of functions
+// always inlined: a caller passing constants gets a loop with nothing of
+// the other cases in it, so the mode is picked once per tile by calling
+// the right specialized function (see escape_tile_scalar), not once per
+// pixel.
+
+// Where an orbit starts: z = 0 and c = the point for Mandelbrot (a
+// multibrot with a power other than 2), z = the point and c the Julia
+// constant for Julia
+#define FRACTAL_MANDELBROT 0
+#define FRACTAL_JULIA 1
+
+// Features, or-ed together. The bulb check only holds for z^2 + c
+// Mandelbrot, the others ignore it.
+#define FRACTAL_BULBS 1
+#define FRACTAL_PERIOD 2
+
+// Highest power of z the engine iterates
+#define FRACTAL_MAX_POWER 8
+
+// Squared radius normalized counts are measured at
+#define FRACTAL_FAR 1.0e6
+
+#if defined(__GNUC__)
+#define FRACTAL_INLINE static inline __attribute__((always_inline))
+#else
+#define FRACTAL_INLINE static inline
+#endif
+
+#define FRACTAL_ENGINE(real, suffix, tolerance) \
+\
+/* Main cardioid and period-2 bulb check, points inside never escape */ \
+FRACTAL_INLINE int fractal_in_bulbs_##suffix(real pos_x, real pos_y) \
+{ \
+    real q, x_term, pos_y2; \
+\
+    x_term = pos_x + 1.0; \
+    pos_y2 = pos_y * pos_y; \
+    if ((x_term * x_term + pos_y2) < 0.0625) return 1; \
+\
+    x_term = pos_x - 0.25; \
+    q = x_term * x_term + pos_y2; \
+    q = q * (q + x_term); \
+    if (q < (0.25 * pos_y2)) return 1; \
+\
+    return 0; \
+} \
+\
+/* Starting z and c of the point. Returns 0 when it is known to be */ \
+/* inside without iterating. */ \
+FRACTAL_INLINE int fractal_start_##suffix(int formula, int power, int features, real pos_x, real pos_y, \
+                                          real julia_x, real julia_y, real *zx, real *zy, real *cx, real *cy) \
+{ \
+    if (formula == FRACTAL_JULIA) \
+    { \
+        *zx = pos_x; \
+        *zy = pos_y; \
+        *cx = julia_x; \
+        *cy = julia_y; \
+        return 1; \
+    } \
+\
+    if ((features & FRACTAL_BULBS) && (power == 2) && fractal_in_bulbs_##suffix(pos_x, pos_y)) \
+        return 0; \
+\
+    *zx = 0.0; \
+    *zy = 0.0; \
+    *cx = pos_x; \
+    *cy = pos_y; \
+    return 1; \
+} \
+\
+/* Iterates z = z^power + c from iteration on. Returns the iteration the */ \
+/* orbit escaped at, max_iteration when it did not or fell in a cycle. z */ \
+/* is left where it stopped, an orbit not escaped can be resumed from it. */ \
+FRACTAL_INLINE int fractal_escape_##suffix(int power, int features, real *zx, real *zy, real cx, real cy, \
+                                           int iteration, int max_iteration) \
+{ \
+    real x = *zx, y = *zy; \
+    real xx, yy, xplusy, dx, dy, px, py, ptemp; \
+    real saved_x = ESCAPE_PERIOD_UNSET, saved_y = ESCAPE_PERIOD_UNSET; \
+    int save_at = 1, factor; \
+\
+    /* A resumed orbit saves its first point at the next power of two */ \
+    while (save_at < iteration) \
+        save_at += save_at; \
+\
+    while (iteration < max_iteration) \
+    { \
+        xx = x * x; \
+        yy = y * y; \
+        if ((xx) + (yy) > (4.0)) break; \
+\
+        /* Brent cycle detection, see escape_kernel.h */ \
+        if (features & FRACTAL_PERIOD) \
+        { \
+            dx = x - saved_x; \
+            dy = y - saved_y; \
+            if (dx * dx + dy * dy < (tolerance)) \
+            { \
+                iteration = max_iteration; \
+                break; \
+            } \
+            if (iteration == save_at) \
+            { \
+                saved_x = x; \
+                saved_y = y; \
+                save_at += save_at; \
+            } \
+        } \
+\
+        if (power == 2) \
+        { \
+            xplusy = x + y; \
+            y = xplusy * xplusy - xx - yy; \
+            y = y + cy; \
+            x = xx - yy + cx; \
+        } \
+        else \
+        { \
+            /* Repeated products, pow() would go through polar form */ \
+            px = x; \
+            py = y; \
+            for (factor = 1; factor < power; factor++) \
+            { \
+                ptemp = px * x - py * y; \
+                py = px * y + py * x; \
+                px = ptemp; \
+            } \
+            x = px + cx; \
+            y = py + cy; \
+        } \
+        iteration++; \
+    } \
+\
+    *zx = x; \
+    *zy = y; \
+    return iteration; \
+} \
+\
+/* Normalized count of an orbit escaped at z after iteration steps: */ \
+/* steps + 1 - log_power(log2|z|) taken far out, where it no longer */ \
+/* depends on the radius, so it is continuous across the bands of the */ \
+/* counts. The orbit is followed there first, each step adding one. */ \
+FRACTAL_INLINE double fractal_normalized_##suffix(int power, int iteration, real zx, real zy, real cx, real cy) \
+{ \
+    double x = zx, y = zy, px, py, ptemp; \
+    int factor; \
+\
+    while (x * x + y * y < FRACTAL_FAR) \
+    { \
+        px = x; \
+        py = y; \
+        for (factor = 1; factor < power; factor++) \
+        { \
+            ptemp = px * x - py * y; \
+            py = px * y + py * x; \
+            px = ptemp; \
+        } \
+        x = px + cx; \
+        y = py + cy; \
+        iteration++; \
+    } \
+\
+    return iteration + 1.0 - log2(0.5 * log2(x * x + y * y)) / log2((double) power); \
+}
+
+FRACTAL_ENGINE(float, float, ESCAPE_PERIOD_TOLERANCE)
+FRACTAL_ENGINE(double, double, ESCAPE_PERIOD_TOLERANCE_DOUBLE)
+
+#endif
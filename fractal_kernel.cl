@@ -0,0 +1,224 @@
+// Every fractal of the OpenCL renderers, specialized when the program is
+// built (cl_render.c passes these with -D):
+//   FRACTAL        0 Mandelbrot, 1 Julia
+//   MAX_ITERATION  the cap as a constant, else the max_iteration argument
+//   REAL_DOUBLE    double precision, on devices with cl_khr_fp64
+//   JULIA_X/Y      the Julia constant, zoom is added to its real part
+//   UNROLL         iterations between two checks of the cap
+#define FRACTAL_MANDELBROT 0
+#define FRACTAL_JULIA 1
+
+#ifndef FRACTAL
+#define FRACTAL FRACTAL_MANDELBROT
+#endif
+
+#ifndef JULIA_X
+#define JULIA_X 0.353
+#endif
+
+#ifndef JULIA_Y
+#define JULIA_Y 0.288
+#endif
+
+#ifndef UNROLL
+#define UNROLL 1
+#endif
+
+#ifdef MAX_ITERATION
+#define CAP MAX_ITERATION
+#else
+#define CAP max_iteration
+#endif
+
+// Brent cycle detection: the orbit is saved at iterations 1, 2, 4, 8...
+// and coming back this close (squared distance) to the saved point means
+// an attracting cycle, the point is inside. A few ulps, like the CPU
+// kernels.
+#ifdef REAL_DOUBLE
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+typedef double real;
+#define PERIOD_TOLERANCE 1.0e-24
+#else
+typedef float real;
+#define PERIOD_TOLERANCE 1.0e-12f
+#endif
+
+#define ORBIT_RUNNING 0
+#define ORBIT_ESCAPED 1
+#define ORBIT_CAUGHT 2
+
+typedef struct orbit
+{
+    real x;
+    real y;
+    real c_x;
+    real c_y;
+    real saved_x;
+    real saved_y;
+    int save_at;
+} orbit;
+
+real map_x(int x, int width, real zoom, real center_x)
+{
+    return (((real)x / (real)width) * (3.5 * zoom)) - center_x;
+}
+
+real map_y(int y, int height, real zoom, real center_y)
+{
+    return (((real)y / (real)height) * (2.0 * zoom)) - center_y;
+}
+
+// One iteration, unless the orbit escaped or came back to the saved point
+int orbit_step(orbit *z, int iteration)
+{
+    real xx = z->x * z->x;
+    real yy = z->y * z->y;
+    real dx, dy;
+
+    if (xx + yy > 4.0)
+        return ORBIT_ESCAPED;
+
+    dx = z->x - z->saved_x;
+    dy = z->y - z->saved_y;
+    if (dx * dx + dy * dy < PERIOD_TOLERANCE)
+        return ORBIT_CAUGHT;
+    if (iteration == z->save_at)
+    {
+        z->saved_x = z->x;
+        z->saved_y = z->y;
+        z->save_at += z->save_at;
+    }
+
+#if FRACTAL == FRACTAL_JULIA
+    z->y = 2.0 * z->x * z->y + z->c_y;
+#else
+    z->y = (z->x + z->y) * (z->x + z->y) - xx - yy + z->c_y;
+#endif
+    z->x = xx - yy + z->c_x;
+    return ORBIT_RUNNING;
+}
+
+// Count of a point of the plane: c for Mandelbrot, where z starts for
+// Julia, whose constant then has zoom added to its real part
+int fractal_escape(real pos_x, real pos_y, real zoom, int max_iteration)
+{
+    orbit z;
+
+#if FRACTAL == FRACTAL_JULIA
+    z.x = pos_x;
+    z.y = pos_y;
+    z.c_x = JULIA_X + zoom;
+    z.c_y = JULIA_Y;
+#else
+    real q, x_term;
+
+    z.x = 0.0;
+    z.y = 0.0;
+    z.c_x = pos_x;
+    z.c_y = pos_y;
+
+    // Period-2 bulb check
+    if (((z.c_x + 1.0) * (z.c_x + 1.0) + z.c_y * z.c_y) < 0.0625)
+        return 0;
+
+    // Cardioid check
+    x_term = z.c_x - 0.25;
+    q = x_term * x_term + z.c_y * z.c_y;
+    q = q * (q + x_term);
+    if (q < (0.25 * z.c_y * z.c_y))
+        return 0;
+#endif
+
+    z.saved_x = 1.0e6f;
+    z.saved_y = 1.0e6f;
+    z.save_at = 1;
+
+    int iteration = 0, unrolled;
+    int state = ORBIT_RUNNING;
+
+    // Runs of UNROLL iterations check the cap once, the rest one by one
+    while ((state == ORBIT_RUNNING) && (iteration <= CAP - UNROLL))
+    {
+        for (unrolled = 0; unrolled < UNROLL; unrolled++)
+        {
+            state = orbit_step(&z, iteration);
+            if (state != ORBIT_RUNNING)
+                break;
+            iteration++;
+        }
+    }
+
+    while ((state == ORBIT_RUNNING) && (iteration < CAP))
+    {
+        state = orbit_step(&z, iteration);
+        if (state == ORBIT_RUNNING)
+            iteration++;
+    }
+
+    // The orbit came back to the saved point, it never escapes
+    if (state == ORBIT_CAUGHT)
+        iteration = CAP;
+
+    return iteration;
+}
+
+// One work item per sample of a pass, every step-th pixel across and down
+// (step 1 is the whole frame). Samples also on the grid of the coarse pass
+// before are in the buffer already. The global size is rounded up to the
+// work group size, items past the last sample column or row of the batch
+// or out of the image do nothing: other batches may own those pixels.
+//
+// Mandelbrot maps x to x / res_x * 3.5 * zoom - center_x. Julia always
+// shows the whole plane and zoom moves c instead.
+__kernel void fractal_point(__global int *graph,
+                               const int res_x,
+                               const int res_y,
+                               const real zoom,
+                               const real center_x,
+                               const real center_y,
+                               const int max_iteration,
+                               const int step,
+                               const int coarse,
+                               const int last_column,
+                               const int last_row)
+{
+    // Get the pixel of the current sample
+    int column = get_global_id(0);
+    int row = get_global_id(1);
+    int image_x = column * step;
+    int image_y = row * step;
+
+    if ((column > last_column) || (row > last_row))
+        return;
+
+    if ((image_x >= res_x) || (image_y >= res_y))
+        return;
+
+    if ((coarse > 0) && (image_x % coarse == 0) && (image_y % coarse == 0))
+        return;
+
+#if FRACTAL == FRACTAL_JULIA
+    graph[image_x + image_y * res_x] = fractal_escape(map_x(image_x, res_x, 1.0, 1.75), map_y(image_y, res_y, 1.0, 1.00001),
+                                                      zoom, max_iteration);
+#else
+    graph[image_x + image_y * res_x] = fractal_escape(map_x(image_x, res_x, zoom, center_x), map_y(image_y, res_y, zoom, center_y),
+                                                      zoom, max_iteration);
+#endif
+}
+
+// One work item per point of a list, x and y of point i at points[2 * i]
+// and points[2 * i + 1]: the extra samples of adaptive antialiasing,
+// which the host places within the pixels. Items past count do nothing.
+__kernel void fractal_samples(__global int *samples,
+                              __global const real *points,
+                              const int count,
+                              const real zoom,
+                              const int max_iteration)
+{
+    int index = get_global_id(0);
+
+    if (index >= count)
+        return;
+
+    samples[index] = fractal_escape(points[2 * index], points[2 * index + 1], zoom, max_iteration);
+}
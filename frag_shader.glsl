@@ -8,9 +8,13 @@ void main(void)
 
     int iteration = 0;
 	float normal_iter = 0.0;
-    int max_iteration = 255;
     float xtemp;
 
+    // Deeper views need more iterations, the same floor as the CPU and
+    // OpenCL renderers: 100 + 150 * decades^1.5
+    float depth = max(-log(max(zoom, 1.0e-6)) / log(10.0), 0.0);
+    int max_iteration = int(100.0 + 150.0 * pow(depth, 1.5));
+
     while (iteration < max_iteration)
     {
        xtemp = x * x - y * y + pos_x;
@@ -25,14 +29,14 @@ void main(void)
     {
 		gl_FragColor = vec4(0.0,0.0,0.0,1.0);
     }
-    else if (iteration < 128)
+    else if (iteration < max_iteration / 2)
     {
-		normal_iter = float(iteration) / 255.0;
+		normal_iter = float(iteration) / float(max_iteration);
         gl_FragColor = vec4(0,0.1 + normal_iter,normal_iter,1.0);
     }
 	else
 	{
-		normal_iter = float(iteration) / 255.0;
+		normal_iter = float(iteration) / float(max_iteration);
 		gl_FragColor = vec4(1.0 - normal_iter, 1.0, 1.0 - normal_iter, 1.0);
 	}
 }
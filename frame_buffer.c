@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "frame_buffer.h"
+
+// Bytes per sample holding every count up to the cap. Counts are never
+// negative by the time they are stored (perturbation clears its glitch
+// marks first), the small samples are unsigned to hold the whole range.
+static int frame_buffer_depth(int max_iteration)
+{
+    if (max_iteration <= UINT8_MAX)
+        return 1;
+    if (max_iteration <= UINT16_MAX)
+        return 2;
+    return 4;
+}
+
+// Block of the tile the piece starts in
+static unsigned char *frame_buffer_block(const frame_buffer *frame, const tile *piece)
+{
+    int index = (piece->y / TILE_SIZE) * frame->tiles_x + piece->x / TILE_SIZE;
+
+    return frame->data + index * frame->tile_bytes;
+}
+
+// minimum_depth is 1, 2 or 4 bytes, the samples never get smaller
+int frame_buffer_init(frame_buffer *frame, int res_x, int res_y, int minimum_depth, int smooth)
+{
+    frame->res_x = res_x;
+    frame->res_y = res_y;
+    frame->tiles_x = (res_x + TILE_SIZE - 1) / TILE_SIZE;
+    frame->tiles_y = (res_y + TILE_SIZE - 1) / TILE_SIZE;
+    frame->minimum_depth = minimum_depth;
+    frame->depth = 0;
+    frame->tile_bytes = 0;
+    frame->capacity = 0;
+    frame->data = NULL;
+    frame->smooth = smooth;
+    frame->fractions = NULL;
+
+    return 0;
+}
+
+// Sets the depth for a frame rendered with this cap, growing the storage
+// when it needs more. What was stored is lost when the depth changes.
+int frame_buffer_prepare(frame_buffer *frame, int max_iteration)
+{
+    int depth = frame_buffer_depth(max_iteration);
+    size_t tile_bytes, needed;
+
+    if (depth < frame->minimum_depth)
+        depth = frame->minimum_depth;
+
+    // A byte per pixel whatever the cap, TILE_SIZE^2 is whole cache lines
+    if (frame->smooth && (frame->fractions == NULL))
+    {
+        frame->fractions = aligned_alloc(FRAME_BUFFER_ALIGN, (size_t) TILE_SIZE * TILE_SIZE * frame->tiles_x * frame->tiles_y);
+        if (frame->fractions == NULL)
+        {
+            fprintf(stderr, "Bad luck, out of memory\n");
+            return 2;
+        }
+    }
+
+    if (depth == frame->depth)
+        return 0;
+
+    tile_bytes = TILE_SIZE * TILE_SIZE * depth;
+    tile_bytes = (tile_bytes + FRAME_BUFFER_ALIGN - 1) / FRAME_BUFFER_ALIGN * FRAME_BUFFER_ALIGN;
+    needed = tile_bytes * frame->tiles_x * frame->tiles_y;
+
+    if (needed > frame->capacity)
+    {
+        free(frame->data);
+        frame->data = aligned_alloc(FRAME_BUFFER_ALIGN, needed);
+        frame->capacity = (frame->data != NULL) ? needed : 0;
+        if (frame->data == NULL)
+        {
+            frame->depth = 0;
+            fprintf(stderr, "Bad luck, out of memory\n");
+            return 2;
+        }
+    }
+
+    frame->depth = depth;
+    frame->tile_bytes = tile_bytes;
+    return 0;
+}
+
+// Keeps the samples of a rendered tile, samples[x + y * stride] for the
+// pixel (piece->x + x, piece->y + y)
+void frame_buffer_store(frame_buffer *frame, const tile *piece, const int *samples, int stride)
+{
+    unsigned char *block = frame_buffer_block(frame, piece);
+    int x, y;
+
+    for (y = 0; y < piece->height; y++, samples += stride)
+    {
+        if (frame->depth == 1)
+        {
+            uint8_t *line = (uint8_t *) block + y * TILE_SIZE;
+            for (x = 0; x < piece->width; x++)
+                line[x] = samples[x];
+        }
+        else if (frame->depth == 2)
+        {
+            uint16_t *line = (uint16_t *) block + y * TILE_SIZE;
+            for (x = 0; x < piece->width; x++)
+                line[x] = samples[x];
+        }
+        else
+        {
+            int32_t *line = (int32_t *) block + y * TILE_SIZE;
+            for (x = 0; x < piece->width; x++)
+                line[x] = samples[x];
+        }
+    }
+}
+
+// The other way around. With stride res_x into a frame of ints this is
+// the row-major layout the outputs take.
+void frame_buffer_load(const frame_buffer *frame, const tile *piece, int *samples, int stride)
+{
+    const unsigned char *block = frame_buffer_block(frame, piece);
+    int x, y;
+
+    for (y = 0; y < piece->height; y++, samples += stride)
+    {
+        if (frame->depth == 1)
+        {
+            const uint8_t *line = (const uint8_t *) block + y * TILE_SIZE;
+            for (x = 0; x < piece->width; x++)
+                samples[x] = line[x];
+        }
+        else if (frame->depth == 2)
+        {
+            const uint16_t *line = (const uint16_t *) block + y * TILE_SIZE;
+            for (x = 0; x < piece->width; x++)
+                samples[x] = line[x];
+        }
+        else
+        {
+            const int32_t *line = (const int32_t *) block + y * TILE_SIZE;
+            for (x = 0; x < piece->width; x++)
+                samples[x] = line[x];
+        }
+    }
+}
+
+// Sample of one pixel, for the few read outside of their tile
+int frame_buffer_get(const frame_buffer *frame, int x, int y)
+{
+    size_t index = (size_t) ((y / TILE_SIZE) * frame->tiles_x + x / TILE_SIZE) * frame->tile_bytes;
+    int offset = (x % TILE_SIZE) + (y % TILE_SIZE) * TILE_SIZE;
+
+    if (frame->depth == 1)
+        return ((const uint8_t *) (frame->data + index))[offset];
+    if (frame->depth == 2)
+        return ((const uint16_t *) (frame->data + index))[offset];
+    return ((const int32_t *) (frame->data + index))[offset];
+}
+
+// The fractions of a smooth frame, like the samples
+void frame_buffer_store_fractions(frame_buffer *frame, const tile *piece, const unsigned char *fractions, int stride)
+{
+    unsigned char *block = frame->fractions + (size_t) ((piece->y / TILE_SIZE) * frame->tiles_x + piece->x / TILE_SIZE) * TILE_SIZE * TILE_SIZE;
+    int y;
+
+    for (y = 0; y < piece->height; y++)
+        memcpy(&block[y * TILE_SIZE], &fractions[y * stride], piece->width);
+}
+
+void frame_buffer_load_fractions(const frame_buffer *frame, const tile *piece, unsigned char *fractions, int stride)
+{
+    const unsigned char *block = frame->fractions + (size_t) ((piece->y / TILE_SIZE) * frame->tiles_x + piece->x / TILE_SIZE) * TILE_SIZE * TILE_SIZE;
+    int y;
+
+    for (y = 0; y < piece->height; y++)
+        memcpy(&fractions[y * stride], &block[y * TILE_SIZE], piece->width);
+}
+
+// Pool jobs, a tile between the frame and row-major ints
+void frame_buffer_linearize_tile(void *copy, const tile *piece, int worker)
+{
+    frame_buffer_copy *args = (frame_buffer_copy *) copy;
+
+    frame_buffer_load(args->frame, piece, &args->linear[piece->x + piece->y * args->frame->res_x], args->frame->res_x);
+}
+
+void frame_buffer_import_tile(void *copy, const tile *piece, int worker)
+{
+    frame_buffer_copy *args = (frame_buffer_copy *) copy;
+
+    frame_buffer_store(args->frame, piece, &args->linear[piece->x + piece->y * args->frame->res_x], args->frame->res_x);
+}
+
+// Whole frame to row-major ints, for outputs that need them
+void frame_buffer_linearize(frame_buffer *frame, int *out, worker_pool *pool)
+{
+    frame_buffer_copy copy;
+
+    copy.frame = frame;
+    copy.linear = out;
+    worker_pool_render(pool, frame_buffer_linearize_tile, (void *) &copy);
+}
+
+// Whole frame from row-major ints, for renderers that make them
+void frame_buffer_import(frame_buffer *frame, int *in, worker_pool *pool)
+{
+    frame_buffer_copy copy;
+
+    copy.frame = frame;
+    copy.linear = in;
+    worker_pool_render(pool, frame_buffer_import_tile, (void *) &copy);
+}
+
+// Pixels with different counts in two frames of the same size
+unsigned long frame_buffer_differences(const frame_buffer *a, const frame_buffer *b)
+{
+    int first[TILE_SIZE * TILE_SIZE], second[TILE_SIZE * TILE_SIZE];
+    unsigned long differences = 0;
+    tile piece;
+    int count;
+
+    for (piece.y = 0; piece.y < a->res_y; piece.y += TILE_SIZE)
+    {
+        for (piece.x = 0; piece.x < a->res_x; piece.x += TILE_SIZE)
+        {
+            piece.width = (a->res_x - piece.x < TILE_SIZE) ? a->res_x - piece.x : TILE_SIZE;
+            piece.height = (a->res_y - piece.y < TILE_SIZE) ? a->res_y - piece.y : TILE_SIZE;
+            frame_buffer_load(a, &piece, first, TILE_SIZE);
+            frame_buffer_load(b, &piece, second, TILE_SIZE);
+
+            for (count = 0; count < piece.height * TILE_SIZE; count++)
+                differences += ((count % TILE_SIZE < piece.width) && (first[count] != second[count]));
+        }
+    }
+
+    return differences;
+}
+
+void frame_buffer_release(frame_buffer *frame)
+{
+    free(frame->data);
+    free(frame->fractions);
+    frame->data = NULL;
+    frame->fractions = NULL;
+    frame->capacity = 0;
+    frame->depth = 0;
+}
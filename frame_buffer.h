@@ -0,0 +1,58 @@
+#ifndef FRAME_BUFFER_H
+#define FRAME_BUFFER_H
+
+#include <stddef.h>
+
+#include "tile_queue.h"
+#include "worker_pool.h"
+
+// Every tile starts on its own cache line, so workers writing their tiles
+// never share one
+#define FRAME_BUFFER_ALIGN 64
+
+// Iterations of a frame stored tile by tile. Each TILE_SIZE square of the
+// frame is one contiguous block of samples (the edge tiles use part of
+// theirs), in 1 or 2 byte unsigned or 4 byte signed samples: the least
+// that holds the cap unless a larger depth is asked for. Row-major ints are only made when
+// some output needs them. A smooth frame also keeps the fractions of the
+// normalized counts (see escape_job), a byte per pixel in blocks laid
+// out like the samples.
+typedef struct frame_buffer frame_buffer;
+struct frame_buffer
+{
+    int res_x;
+    int res_y;
+    int tiles_x;
+    int tiles_y;
+    int minimum_depth;
+    int depth;
+    size_t tile_bytes;
+    size_t capacity;
+    unsigned char *data;
+    int smooth;
+    unsigned char *fractions;
+};
+
+// For the pool, when moving a whole frame to or from row-major ints
+typedef struct frame_buffer_copy frame_buffer_copy;
+struct frame_buffer_copy
+{
+    frame_buffer *frame;
+    int *linear;
+};
+
+int frame_buffer_init(frame_buffer *frame, int res_x, int res_y, int minimum_depth, int smooth);
+int frame_buffer_prepare(frame_buffer *frame, int max_iteration);
+void frame_buffer_store(frame_buffer *frame, const tile *piece, const int *samples, int stride);
+void frame_buffer_load(const frame_buffer *frame, const tile *piece, int *samples, int stride);
+int frame_buffer_get(const frame_buffer *frame, int x, int y);
+void frame_buffer_store_fractions(frame_buffer *frame, const tile *piece, const unsigned char *fractions, int stride);
+void frame_buffer_load_fractions(const frame_buffer *frame, const tile *piece, unsigned char *fractions, int stride);
+void frame_buffer_linearize_tile(void *copy, const tile *piece, int worker);
+void frame_buffer_import_tile(void *copy, const tile *piece, int worker);
+void frame_buffer_linearize(frame_buffer *frame, int *out, worker_pool *pool);
+void frame_buffer_import(frame_buffer *frame, int *in, worker_pool *pool);
+unsigned long frame_buffer_differences(const frame_buffer *a, const frame_buffer *b);
+void frame_buffer_release(frame_buffer *frame);
+
+#endif
@@ -0,0 +1,350 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "image_output.h"
+
+static int ends_with(const char *text, const char *suffix)
+{
+    size_t length = strlen(text), suffix_length = strlen(suffix);
+
+    return (length >= suffix_length) && (strcmp(text + length - suffix_length, suffix) == 0);
+}
+
+// The pattern goes to snprintf as the format: it takes at most one
+// integer conversion (%d, %05d...) for the frame number, and %% for a
+// percent sign. Returns 0 for anything else.
+int image_pattern_valid(const char *pattern)
+{
+    int conversions = 0;
+
+    while (*pattern != '\0')
+    {
+        if (*pattern++ != '%')
+            continue;
+
+        if (*pattern == '%')
+        {
+            pattern++;
+            continue;
+        }
+
+        // Zero padding and a width, then d or i
+        if (*pattern == '0')
+            pattern++;
+        while ((*pattern >= '0') && (*pattern <= '9'))
+            pattern++;
+        if ((*pattern != 'd') && (*pattern != 'i'))
+            return 0;
+        pattern++;
+
+        if (++conversions > 1)
+            return 0;
+    }
+
+    return 1;
+}
+
+int image_writer_open(image_writer *writer, const char *pattern, int width, int height)
+{
+    writer->pattern = pattern;
+    writer->width = width;
+    writer->height = height;
+    writer->frame = 0;
+    writer->stream = NULL;
+
+    if (!image_pattern_valid(pattern))
+    {
+        fprintf(stderr, "Bad file name %s, it takes one %%d for the frame number at most\n", pattern);
+        return 1;
+    }
+
+    if ((strcmp(pattern, "-") == 0) || ends_with(pattern, ".y4m"))
+        writer->format = IMAGE_Y4M;
+    else if (ends_with(pattern, ".png"))
+        writer->format = IMAGE_PNG;
+    else
+        writer->format = IMAGE_PPM;
+
+    if (writer->format != IMAGE_Y4M)
+        return 0;
+
+    if (strcmp(pattern, "-") == 0)
+    {
+        // Keep the real stdout for the stream and send every printf of
+        // the program to stderr, so the logs do not corrupt the video
+        fflush(stdout);
+        writer->stream = fdopen(dup(STDOUT_FILENO), "wb");
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+    else
+        writer->stream = fopen(pattern, "wb");
+
+    if (writer->stream == NULL)
+    {
+        fprintf(stderr, "Could not open %s for writing\n", pattern);
+        return 1;
+    }
+
+    fprintf(writer->stream, "YUV4MPEG2 W%d H%d F30:1 Ip A1:1 C444\n", width, height);
+    return 0;
+}
+
+// These return 1 when the file could not be written, 2 out of memory
+static int write_ppm(FILE *file, const uint32_t *argb, int width, int height)
+{
+    unsigned char *row = malloc(width * 3);
+    int x, y, failed = 0;
+
+    if (row == NULL)
+        return 2;
+
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    for (y = 0; y < height; y++)
+    {
+        for (x = 0; x < width; x++)
+        {
+            uint32_t color = argb[x + y * width];
+            row[x * 3] = (color >> 16) & 0xff;
+            row[x * 3 + 1] = (color >> 8) & 0xff;
+            row[x * 3 + 2] = color & 0xff;
+        }
+        if (fwrite(row, 1, width * 3, file) != (size_t) width * 3)
+        {
+            failed = 1;
+            break;
+        }
+    }
+
+    free(row);
+    return failed;
+}
+
+// PNG without a compression library: the zlib stream uses stored
+// (uncompressed) deflate blocks, which every decoder understands
+typedef struct png_stream png_stream;
+struct png_stream
+{
+    FILE *file;
+    uint32_t crc;
+    uint32_t adler_a;
+    uint32_t adler_b;
+    int block_left;
+    int failed;
+};
+
+static uint32_t crc_table[256];
+
+static void crc_table_init(void)
+{
+    uint32_t value;
+    int count, bit;
+
+    if (crc_table[1] != 0)
+        return;
+
+    for (count = 0; count < 256; count++)
+    {
+        value = count;
+        for (bit = 0; bit < 8; bit++)
+            value = (value & 1) ? 0xedb88320u ^ (value >> 1) : value >> 1;
+        crc_table[count] = value;
+    }
+}
+
+static void png_bytes(png_stream *png, const unsigned char *bytes, int length)
+{
+    int count;
+
+    for (count = 0; count < length; count++)
+        png->crc = crc_table[(png->crc ^ bytes[count]) & 0xff] ^ (png->crc >> 8);
+    if (fwrite(bytes, 1, length, png->file) != (size_t) length)
+        png->failed = 1;
+}
+
+static void png_u32(png_stream *png, uint32_t value)
+{
+    unsigned char bytes[4] = { value >> 24, value >> 16, value >> 8, value };
+    png_bytes(png, bytes, 4);
+}
+
+static void png_chunk_start(png_stream *png, const char *type, uint32_t length)
+{
+    png_u32(png, length);
+    png->crc = 0xffffffffu;
+    png_bytes(png, (const unsigned char *) type, 4);
+}
+
+static void png_chunk_end(png_stream *png)
+{
+    png_u32(png, png->crc ^ 0xffffffffu);
+}
+
+// Image data goes through here, split in stored blocks of up to 65535 bytes
+static void png_data(png_stream *png, const unsigned char *bytes, int length, int remaining)
+{
+    int count, piece;
+
+    while (length > 0)
+    {
+        if (png->block_left == 0)
+        {
+            int block = (remaining > 65535) ? 65535 : remaining;
+            unsigned char header[5] = { (remaining == block), block & 0xff, block >> 8,
+                                        ~block & 0xff, (~block >> 8) & 0xff };
+            png_bytes(png, header, 5);
+            png->block_left = block;
+        }
+
+        piece = (length < png->block_left) ? length : png->block_left;
+        for (count = 0; count < piece; count++)
+        {
+            png->adler_a = (png->adler_a + bytes[count]) % 65521;
+            png->adler_b = (png->adler_b + png->adler_a) % 65521;
+        }
+        png_bytes(png, bytes, piece);
+
+        png->block_left -= piece;
+        remaining -= piece;
+        bytes += piece;
+        length -= piece;
+    }
+}
+
+static int write_png(FILE *file, const uint32_t *argb, int width, int height)
+{
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    unsigned char header[13] = { 0, 0, 0, 0, 0, 0, 0, 0, 8, 2, 0, 0, 0 };
+    unsigned char zlib_header[2] = { 0x78, 0x01 };
+    unsigned char *row = malloc(1 + width * 3);
+    int raw_size = height * (1 + width * 3);
+    int blocks = (raw_size + 65534) / 65535;
+    int x, y, remaining;
+    png_stream png;
+
+    if (row == NULL)
+        return 2;
+
+    crc_table_init();
+    png.file = file;
+    png.adler_a = 1;
+    png.adler_b = 0;
+    png.block_left = 0;
+    png.failed = (fwrite(signature, 1, 8, file) != 8);
+
+    header[0] = width >> 24; header[1] = width >> 16; header[2] = width >> 8; header[3] = width;
+    header[4] = height >> 24; header[5] = height >> 16; header[6] = height >> 8; header[7] = height;
+    png_chunk_start(&png, "IHDR", 13);
+    png_bytes(&png, header, 13);
+    png_chunk_end(&png);
+
+    png_chunk_start(&png, "IDAT", 2 + blocks * 5 + raw_size + 4);
+    png_bytes(&png, zlib_header, 2);
+    remaining = raw_size;
+    for (y = 0; y < height; y++)
+    {
+        row[0] = 0;
+        for (x = 0; x < width; x++)
+        {
+            uint32_t color = argb[x + y * width];
+            row[1 + x * 3] = (color >> 16) & 0xff;
+            row[2 + x * 3] = (color >> 8) & 0xff;
+            row[3 + x * 3] = color & 0xff;
+        }
+        png_data(&png, row, 1 + width * 3, remaining);
+        remaining -= 1 + width * 3;
+    }
+    png_u32(&png, (png.adler_b << 16) | png.adler_a);
+    png_chunk_end(&png);
+
+    png_chunk_start(&png, "IEND", 0);
+    png_chunk_end(&png);
+
+    free(row);
+    return png.failed;
+}
+
+// Full range BT.601, planar 4:4:4
+static int write_y4m(FILE *file, const uint32_t *argb, int width, int height)
+{
+    unsigned char *plane = malloc(width * height);
+    int pixel, channel, count = width * height;
+    int red, green, blue, value, failed = 0;
+
+    if (plane == NULL)
+        return 2;
+
+    fputs("FRAME\n", file);
+    for (channel = 0; channel < 3; channel++)
+    {
+        for (pixel = 0; pixel < count; pixel++)
+        {
+            red = (argb[pixel] >> 16) & 0xff;
+            green = (argb[pixel] >> 8) & 0xff;
+            blue = argb[pixel] & 0xff;
+
+            if (channel == 0)
+                value = (77 * red + 150 * green + 29 * blue + 128) >> 8;
+            else if (channel == 1)
+                value = ((-43 * red - 85 * green + 128 * blue + 128) >> 8) + 128;
+            else
+                value = ((128 * red - 107 * green - 21 * blue + 128) >> 8) + 128;
+
+            plane[pixel] = (value < 0) ? 0 : ((value > 255) ? 255 : value);
+        }
+        if (fwrite(plane, 1, count, file) != (size_t) count)
+        {
+            failed = 1;
+            break;
+        }
+    }
+
+    free(plane);
+    return failed;
+}
+
+int image_writer_frame(image_writer *writer, const uint32_t *argb)
+{
+    char path[4096];
+    FILE *file;
+    int result;
+
+    if (writer->format == IMAGE_Y4M)
+    {
+        result = write_y4m(writer->stream, argb, writer->width, writer->height);
+        if (((fflush(writer->stream) != 0) || ferror(writer->stream)) && (result == 0))
+            result = 1;
+        if (result == 1)
+            fprintf(stderr, "Could not write %s\n", writer->pattern);
+        writer->frame++;
+        return result;
+    }
+
+    snprintf(path, sizeof(path), writer->pattern, writer->frame);
+    file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Could not open %s for writing\n", path);
+        return 1;
+    }
+
+    if (writer->format == IMAGE_PNG)
+        result = write_png(file, argb, writer->width, writer->height);
+    else
+        result = write_ppm(file, argb, writer->width, writer->height);
+
+    if ((fclose(file) != 0) && (result == 0))
+        result = 1;
+    if (result == 1)
+        fprintf(stderr, "Could not write %s\n", path);
+    writer->frame++;
+    return result;
+}
+
+void image_writer_close(image_writer *writer)
+{
+    if (writer->stream != NULL)
+        fclose(writer->stream);
+    writer->stream = NULL;
+}
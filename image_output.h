@@ -0,0 +1,37 @@
+#ifndef IMAGE_OUTPUT_H
+#define IMAGE_OUTPUT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+typedef enum image_format image_format;
+enum image_format
+{
+    IMAGE_PPM,
+    IMAGE_PNG,
+    IMAGE_Y4M
+};
+
+// Writes rendered frames without going through SDL. The pattern is a
+// printf style file name taking the frame number ("zoom_%05d.png"); the
+// extension picks the format. "-" or a .y4m name makes a single YUV4MPEG2
+// stream, "-" being stdout: open it before printing anything, from then
+// on the program's stdout goes to stderr. The frame number is the only
+// conversion a pattern may have, see image_pattern_valid.
+typedef struct image_writer image_writer;
+struct image_writer
+{
+    image_format format;
+    const char *pattern;
+    FILE *stream;
+    int width;
+    int height;
+    int frame;
+};
+
+int image_pattern_valid(const char *pattern);
+int image_writer_open(image_writer *writer, const char *pattern, int width, int height);
+int image_writer_frame(image_writer *writer, const uint32_t *argb);
+void image_writer_close(image_writer *writer);
+
+#endif
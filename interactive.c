@@ -1,19 +1,36 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
-
-#include <time.h>
-
-#ifdef __APPLE__
-#include <OpenCL/opencl.h>
-#else
-#include <CL/cl.h>
-#endif
+#include <unistd.h>
 
 #include <SDL.h>
 #include <SDL_ttf.h>
 
-#define MAX_SOURCE_SIZE (0x100000)
+#include "cl_render.h"
+#include "tile_queue.h"
+#include "worker_pool.h"
+#include "image_output.h"
+#include "palette.h"
+#include "iter_control.h"
+#include "progressive.h"
+#include "wall_clock.h"
+
+// Passes are queued in bands of this many sample rows, a multiple of the
+// work group height. Input is checked between two bands.
+#define PROGRESSIVE_BAND 64
+
+// While a button is held the view moves on once this many seconds went
+// into its passes, the first one is always shown
+#define PROGRESSIVE_BUDGET 0.016
+
+// Pixels an arrow key pans by, and milliseconds between two steps of the
+// color cycling
+#define INTERACTIVE_PAN 32
+#define INTERACTIVE_CYCLE 20
+
+// Key presses looked at for a pan while a view is being computed
+#define INTERACTIVE_PEEK 16
 
 float map_x_mandelbrot(float x, int width, float zoom)
 {
@@ -32,159 +49,195 @@ float map_y(float y, int height, float zoom)
     return ((y / (float)height) * (2.0 * zoom));
 }
 
-int main(int argn, char **argv) {
-    
-    // Init SDL
-    if(SDL_Init(SDL_INIT_VIDEO) != 0)
-        fprintf(stderr, "Could not initialize SDL: %s\n", SDL_GetError());
+// A click, quit or an arrow of the Mandelbrot view waiting in the queue
+// makes the rest of the view useless. Keys are only peeked at, the event
+// loop still gets them.
+static int progressive_interrupted(int julia_mode)
+{
+    SDL_Event keys[INTERACTIVE_PEEK];
+    SDL_Keycode sym;
+    int count, key;
+
+    SDL_PumpEvents();
+    if (SDL_HasEvent(SDL_MOUSEBUTTONDOWN) || SDL_HasEvent(SDL_QUIT))
+        return 1;
+    if (julia_mode)
+        return 0;
+
+    count = SDL_PeepEvents(keys, INTERACTIVE_PEEK, SDL_PEEKEVENT, SDL_KEYDOWN, SDL_KEYDOWN);
+    for (key = 0; key < count; key++)
+    {
+        sym = keys[key].key.keysym.sym;
+        if ((sym == SDLK_LEFT) || (sym == SDLK_RIGHT) || (sym == SDLK_UP) || (sym == SDLK_DOWN))
+            return 1;
+    }
 
-    printf("SDL Initialized\n");
+    return 0;
+}
 
-    // Create screen surface
-    SDL_Surface *screen, *message;
+int main(int argn, char **argv) {
+    
+    SDL_Surface *screen = NULL, *message;
+    SDL_Window *window = NULL;
+    SDL_Renderer *renderer = NULL;
+    SDL_Texture *texture_screen = NULL;
+    TTF_Font *font = NULL;
     int res_x = 800;
     int res_y = 600;
-    int current_line = 0;
     int julia_mode = 0;
-
-    if (argn == 1)
+    const char *output = NULL;
+    const char *view_text = NULL;
+    const char *view_x = NULL, *view_y = NULL;
+    image_writer writer;
+    uint32_t *frame_pixels;
+    palette lut = { NULL, 0, 0, 0 };
+    int scheme = PALETTE_CLASSIC;
+    int cycling = 0;
+    int fixed_iterations = 0;
+    int subdevices = 0;
+    int double_precision = 0;
+    int arg;
+
+    for (arg = 1; arg < argn; arg++)
     {
-        julia_mode = 0;
+        if (strcmp(argv[arg], "-julia") == 0)
+            julia_mode = 1;
+        else if ((strcmp(argv[arg], "-headless") == 0) && (arg + 1 < argn) && image_pattern_valid(argv[arg + 1]))
+            output = argv[++arg];
+        else if ((strcmp(argv[arg], "-view") == 0) && (arg + 1 < argn))
+            view_text = argv[++arg];
+        else if ((strcmp(argv[arg], "-center") == 0) && (arg + 2 < argn))
+        {
+            view_x = argv[++arg];
+            view_y = argv[++arg];
+        }
+        else if ((strcmp(argv[arg], "-palette") == 0) && (arg + 1 < argn) &&
+                 ((scheme = palette_find(argv[arg + 1])) >= 0))
+            arg++;
+        else if ((strcmp(argv[arg], "-iterations") == 0) && (arg + 1 < argn))
+            fixed_iterations = atoi(argv[++arg]);
+        else if ((strcmp(argv[arg], "-subdevices") == 0) && (arg + 1 < argn))
+            subdevices = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "-double") == 0)
+            double_precision = 1;
+        else
+        {
+            fprintf(stderr, "Usage: %s [-julia] [-palette classic|fire|ocean|gray] [-iterations N] [-subdevices N] [-double]\n"
+                            "       [-headless file.ppm|file.png|file.y4m|- [-view ZOOM] [-center X Y]]\n", argv[0]);
+            return 1;
+        }
     }
-    else if ((argn == 2) && (strcmp(argv[1], "-julia") == 0))
-    {
-        julia_mode = 1;
+
+    // Headless renders the starting view once and quits. Opened before any
+    // printf, as the Y4M stream on stdout moves them to stderr.
+    if ((output != NULL) && (image_writer_open(&writer, output, res_x, res_y) != 0))
+        return 1;
+
+    if (julia_mode)
         printf("Julia mode activated...\n");
-    }
 
-    SDL_Window *window = SDL_CreateWindow("MandelClassic",
-                                           SDL_WINDOWPOS_UNDEFINED,
-                                           SDL_WINDOWPOS_UNDEFINED,
-                                           res_x, res_y, 0);
+    if (output == NULL)
+    {
+        // Init SDL
+        if(SDL_Init(SDL_INIT_VIDEO) != 0)
+            fprintf(stderr, "Could not initialize SDL: %s\n", SDL_GetError());
 
-    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, 0);
+        printf("SDL Initialized\n");
 
-    if ((!window) || (!renderer))
-	    fprintf(stderr,"Could not set video mode: %s\n",SDL_GetError());
+        window = SDL_CreateWindow("MandelClassic",
+                                  SDL_WINDOWPOS_UNDEFINED,
+                                  SDL_WINDOWPOS_UNDEFINED,
+                                  res_x, res_y, 0);
 
-    // Blank the window
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderClear(renderer);
-    SDL_RenderPresent(renderer);
+        renderer = SDL_CreateRenderer(window, -1, 0);
 
-    SDL_Texture *texture_screen = SDL_CreateTexture(renderer,
-                                                   SDL_PIXELFORMAT_ARGB8888,
-                                                   SDL_TEXTUREACCESS_STREAMING,
-                                                   res_x, res_y);
+        if ((!window) || (!renderer))
+            fprintf(stderr,"Could not set video mode: %s\n",SDL_GetError());
 
-    screen = SDL_CreateRGBSurface(0, res_x, res_y , 32, 0, 0, 0, 0);
+        // Blank the window
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+        SDL_RenderClear(renderer);
+        SDL_RenderPresent(renderer);
 
-    //Initialize SDL_ttf
-    if( TTF_Init() == -1 )
-    { 
-        printf("Error setting up TTF module.\n");
-        return 1; 
-    }
+        texture_screen = SDL_CreateTexture(renderer,
+                                           SDL_PIXELFORMAT_ARGB8888,
+                                           SDL_TEXTUREACCESS_STREAMING,
+                                           res_x, res_y);
+
+        screen = SDL_CreateRGBSurface(0, res_x, res_y , 32, 0, 0, 0, 0);
 
-    // Load a font
-    TTF_Font *font;
-    font = TTF_OpenFont("font.ttf", 24);
-    if (font == NULL)
+        //Initialize SDL_ttf
+        if( TTF_Init() == -1 )
+        { 
+            printf("Error setting up TTF module.\n");
+            return 1; 
+        }
+
+        // Load a font
+        font = TTF_OpenFont("font.ttf", 24);
+        if (font == NULL)
+        {
+            printf("TTF_OpenFont() Failed: %s", TTF_GetError());
+            SDL_Quit();
+            return 1;
+        }
+
+        frame_pixels = (uint32_t *) screen->pixels;
+    }
+    else
     {
-        printf("TTF_OpenFont() Failed: %s", TTF_GetError());
-        SDL_Quit();
-        return 1;
+        frame_pixels = malloc(res_x * res_y * sizeof(uint32_t));
+        if (frame_pixels == NULL)
+        {
+            fprintf(stderr, "Bad luck, out of memory\n");
+            return 2;
+        }
     }
 
     //The color of the font 
     SDL_Color textColor = { 255, 255, 255 };
 
     // Prepare the resolution and sizes and colors...
-    const int ITERATIONS = 256;
+    cl_render render;
+    cl_render_options options;
+    progressive_image image;
+    iter_control control;
+    tile_queue queue;
+    worker_pool pool;
+    int number_workers;
+    int max_iteration;
+
+    // The cap moves with the view, it stays an argument of the kernel
+    // unless fixed
+    cl_render_defaults(&options, (julia_mode == 0) ? CL_FRACTAL_MANDELBROT : CL_FRACTAL_JULIA);
+    options.double_precision = double_precision;
+    options.constant_iterations = (fixed_iterations > 0);
+    if (cl_render_init(&render, &options, res_x, res_y, subdevices) != 0)
+        exit(1);
 
-    // Load the kernel source code into the array source_str
-    FILE *fp;
-    char *source_str;
-    size_t source_size;
+    // The host side of a frame, its histogram and its colors, is split
+    // over the cores tile by tile
+    number_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (number_workers < 1)
+        number_workers = 1;
+    if (tile_queue_init(&queue, res_x, res_y, TILE_SIZE, number_workers) != 0)
+        return 2;
+    if (worker_pool_init(&pool, number_workers, &queue) != 0)
+        return 2;
+
+    // max_iteration follows the depth and the escapes of the last frame,
+    // unless -iterations fixes it
+    if (fixed_iterations > 0)
+    {
+        if (iter_control_init(&control, fixed_iterations, fixed_iterations, number_workers) != 0)
+            return 2;
+    }
+    else if (iter_control_init(&control, ITER_CONTROL_MINIMUM, ITER_CONTROL_MAXIMUM, number_workers) != 0)
+        return 2;
 
-    if (julia_mode == 0)
-        fp = fopen("mandelbrot_inter_kernel.cl", "r");
-    else
-        fp = fopen("julia_kernel.cl", "r");
+    if (progressive_init(&image, res_x, res_y) != 0)
+        return 2;
 
-    if (!fp) {
-        fprintf(stderr, "Failed to load kernel.\n");
-        exit(1);
-    }
-    source_str = (char*)malloc(MAX_SOURCE_SIZE);
-    source_size = fread( source_str, 1, MAX_SOURCE_SIZE, fp);
-    fclose( fp );
-
-    // Get platform and device information
-    cl_platform_id platform_id = NULL;
-    cl_device_id device_id = NULL;   
-    cl_uint ret_num_devices;
-    cl_uint ret_num_platforms;
-    cl_int ret = clGetPlatformIDs(1, &platform_id, &ret_num_platforms);
-    ret = clGetDeviceIDs( platform_id, CL_DEVICE_TYPE_GPU, 1, 
-            &device_id, &ret_num_devices);
-
-    // Create an OpenCL context
-    cl_context context = clCreateContext( NULL, 1, &device_id, NULL, NULL, &ret);
-
-    // Create a command queue
-    cl_command_queue command_queue = clCreateCommandQueue(context, device_id, 0, &ret);
-
-    // Create memory buffers on the device for returning iterations 
-    // Input parameters
-    cl_mem kernel_res_x = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-            sizeof(int), &res_x, &ret);
-    cl_mem kernel_res_y = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-            sizeof(int), &res_y, &ret);
-    cl_mem kernel_current_line = clCreateBuffer(context, CL_MEM_READ_ONLY,
-            sizeof(int), NULL, &ret);
-    cl_mem kernel_zoom_level = clCreateBuffer(context, CL_MEM_READ_ONLY,
-            sizeof(float), NULL, &ret); 
-    cl_mem kernel_center_x = clCreateBuffer(context, CL_MEM_READ_ONLY,
-            sizeof(float), NULL, &ret); 
-    cl_mem kernel_center_y = clCreateBuffer(context, CL_MEM_READ_ONLY,
-            sizeof(float), NULL, &ret); 
-
-    // Output buffer
-    cl_mem graph_mem_obj = clCreateBuffer(context, CL_MEM_WRITE_ONLY, 
-            res_x * sizeof(int), NULL, &ret);
-
-    // Create a program from the kernel source
-    cl_program program = clCreateProgramWithSource(context, 1, 
-            (const char **)&source_str, (const size_t *)&source_size, &ret);
-
-    // Build the program
-    ret = clBuildProgram(program, 1, &device_id, NULL, NULL, NULL);
-
-    // Check if it is correct
-    printf("clBuildProgram\n");
-    cl_build_status build_status;
-    ret = clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_STATUS, sizeof(cl_build_status), &build_status, NULL);
-
-    char *build_log;
-    size_t ret_val_size;
-    ret = clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, 0, NULL, &ret_val_size);
-
-    build_log = (char *) malloc((ret_val_size + 1) * sizeof(char));
-    ret = clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, ret_val_size, build_log, NULL);
-                                build_log[ret_val_size] = '\0';
-    printf("BUILD LOG: \n %s", build_log);
-    printf("program built\n");
-
-    // Create the OpenCL kernel
-    cl_kernel kernel = clCreateKernel(program, "fractal_point", &ret);
-
-    // Common kernel params
-    ret = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void *) &kernel_res_x);
-    ret = clSetKernelArg(kernel, 1, sizeof(cl_mem), (void *) &kernel_res_y);
-    ret = clSetKernelArg(kernel, 4, sizeof(cl_mem), (void *) &graph_mem_obj);
-
-    int graph_line[res_x];  // (int*)malloc(res_x * sizeof(int));
     float zoom = 1.0;             // Our current zoom level
     float stop_point;
     float center_x = 2.5;
@@ -197,105 +250,106 @@ int main(int argn, char **argv) {
     else
         stop_point = -2.5;
 
+    if (view_text != NULL)
+        zoom = atof(view_text);
+
+    // The kernel takes the offset of the top left corner, -center gives
+    // the middle of the view
+    if (view_x != NULL)
+    {
+        center_x = 1.75 * zoom - atof(view_x);
+        center_y = 1.0 * zoom - atof(view_y);
+    }
+
     SDL_Event ev;
-    int active, motion;
+    int active, motion, moving, fresh, dirty, waiting;
+    int step, done, row, rows, interrupted;
+    int pan_x, pan_y, strip_x, strip_y;
+    double view_start;
+    int *samples;
 
     active = 1;
     motion = 0;
+    fresh = 1;
+    dirty = 0;
+    step = 0;
+    done = 0;
+    view_start = 0.0;
+    progressive_zoom(&image, zoom, center_x, center_y);
 
     while(active) 
     {
-        for (current_line = 0; current_line < res_y; current_line++)
+        // A new view starts over from the coarsest pass
+        if (fresh)
         {
-            // Set the arguments of the kernel
-            ret = clEnqueueWriteBuffer(command_queue, kernel_current_line, CL_TRUE, 0,
-                    sizeof(int), &current_line, 0, NULL, NULL);
-
-            ret = clEnqueueWriteBuffer(command_queue, kernel_zoom_level, CL_TRUE, 0,
-                    sizeof(float), &zoom, 0, NULL, NULL);
-
-            ret = clEnqueueWriteBuffer(command_queue, kernel_center_x, CL_TRUE, 0,
-                    sizeof(float), &center_x, 0, NULL, NULL);
-
-            ret = clEnqueueWriteBuffer(command_queue, kernel_center_y, CL_TRUE, 0,
-                    sizeof(float), &center_y, 0, NULL, NULL);
-
-            clFinish(command_queue);
-
-            ret = clSetKernelArg(kernel, 2, sizeof(cl_mem), (void *) &kernel_current_line);
-            ret = clSetKernelArg(kernel, 3, sizeof(cl_mem), (void *) &kernel_zoom_level);
-            ret = clSetKernelArg(kernel, 5, sizeof(cl_mem), (void *) &kernel_center_x);
-            ret = clSetKernelArg(kernel, 6, sizeof(cl_mem), (void *) &kernel_center_y);
-            
-            // Execute the OpenCL kernel on the list
-            size_t global_item_size = res_x; // Process the entire line
-            size_t local_item_size = 32; // Process in groups of 64
-            ret = clEnqueueNDRangeKernel(command_queue, kernel, 1, NULL, 
-                    &global_item_size, &local_item_size, 0, NULL, NULL);
+            max_iteration = iter_control_scale(&control, julia_mode ? 0.0 : -log10(zoom));
+            step = PROGRESSIVE_STEP;
+            done = 0;
+            view_start = wall_clock_seconds();
+            fresh = 0;
+        }
 
-            if (ret != CL_SUCCESS)
+        // Next pass of the view, given up when input comes in or the view
+        // is about to move on
+        if (step > 0)
+        {
+            interrupted = 0;
+            rows = (res_y + step - 1) / step;
+            for (row = 0; row < rows; row += PROGRESSIVE_BAND)
             {
-                printf("Error while executing kernel\n");
-                printf("Error code %d\n", ret);
-            }
-
-            // Wait for the computation to finish
-            clFinish(command_queue);
-
-            // Read the memory buffer graph_mem_obj on the device to the local variable graph_dots
-            ret = clEnqueueReadBuffer(command_queue, graph_mem_obj, CL_TRUE, 0, 
-                    res_x * sizeof(int), graph_line, 0, NULL, NULL);
-
-            if (ret != CL_SUCCESS)
-                printf("Error while reading results buffer\n");
-
-            clFinish(command_queue);
+                if ((row > 0) && (output == NULL) &&
+                    (progressive_interrupted(julia_mode) ||
+                     ((motion != 0) && (done > 0) && (wall_clock_seconds() - view_start >= PROGRESSIVE_BUDGET))))
+                {
+                    interrupted = 1;
+                    break;
+                }
 
-            int line_count;
-            Uint32 *pixel;
-            // Lock surface
-            // SDL_LockSurface(screen);
-            // rank = screen->pitch/sizeof(Uint32);
-            pixel = (Uint32*)screen->pixels;
-            int iteration;
+                if (cl_render_pass(&render, 0, zoom, center_x, center_y, max_iteration, step, done,
+                                   0, row, (res_x + step - 1) / step,
+                                   (rows - row < PROGRESSIVE_BAND) ? rows - row : PROGRESSIVE_BAND) != 0)
+                    exit(1);
+                if (cl_render_finish(&render) != 0)
+                    exit(1);
+            }
 
-            for (line_count = 0; line_count < res_x; line_count++)
+            if (!interrupted)
             {
-                // int temp_val = graph_line[line_count];
-                // graph_dots[(current_line * res_x) + line_count] = temp_val;
-                // Get the iterations for the point
-                // printf("Point %d\n", i);
-                iteration = graph_line[line_count];
-                if ((iteration < 128) && (iteration > 0)) {
-                    pixel[(current_line * res_x) + line_count] = SDL_MapRGBA(screen->format,
-                                                                               0,
-                                                                               20 + iteration,
-                                                                               0,
-                                                                               255);
-                }
-                else if ((iteration >= 128) && (iteration < ITERATIONS))
-                {
-                    pixel[(current_line * res_x) + line_count] = SDL_MapRGBA(screen->format,
-                                                                               iteration,
-                                                                               148,
-                                                                               iteration,
-                                                                               255);
-                }
-                else
-                {
-                    pixel[(current_line * res_x) + line_count] = SDL_MapRGBA(screen->format,
-                                                                               0,
-                                                                               0,
-                                                                               0,
-                                                                               255);
-                } 
+                if ((samples = cl_render_wait(&render, 0)) == NULL)
+                    exit(1);
+                progressive_fill(&image, samples, step);
+                done = step;
+                step /= 2;
+                dirty = 1;
+
+                // The cap of the next view follows the last image shown
+                iter_control_update(&control, image.shown, res_x, res_y, max_iteration, &pool);
+                if ((lut.max_iteration != max_iteration) && (palette_build(&lut, scheme, max_iteration, lut.offset) != 0))
+                    return 2;
             }
         }
 
+        if (output != NULL)
+        {
+            if (step > 0)
+                continue;
+            palette_apply_pool(&lut, image.shown, frame_pixels, res_x, &pool);
+            if (image_writer_frame(&writer, frame_pixels) != 0)
+                exit(1);
+            break;
+        }
+
         // Step, iterate our zoom levels if we're doing mandelbrot or julia set
         /* Handle events */
-        while(SDL_PollEvent(&ev))
+        // Once the view is done, still and on screen, sleep until some
+        // input comes, or until the next colors when cycling
+        waiting = (step == 0) && (motion == 0) && !dirty;
+        pan_x = 0;
+        pan_y = 0;
+        while (waiting ? (cycling ? SDL_WaitEventTimeout(&ev, INTERACTIVE_CYCLE) : SDL_WaitEvent(&ev)) : SDL_PollEvent(&ev))
         {
+            waiting = 0;
+
             if(ev.type == SDL_QUIT)
                 active = 0; /* End */
 
@@ -319,9 +373,73 @@ int main(int argn, char **argv) {
             {
                 motion = 0;
             }
+            // P switches palette, C toggles color cycling
+            else if ((ev.type == SDL_KEYDOWN) && (ev.key.keysym.sym == SDLK_p))
+            {
+                scheme = (scheme + 1) % PALETTE_SCHEMES;
+                palette_build(&lut, scheme, lut.max_iteration, lut.offset);
+                dirty = 1;
+            }
+            else if ((ev.type == SDL_KEYDOWN) && (ev.key.keysym.sym == SDLK_c))
+            {
+                cycling = !cycling;
+            }
+            // The arrows pan the Mandelbrot view, the Julia one never moves
+            else if ((ev.type == SDL_KEYDOWN) && (julia_mode == 0))
+            {
+                if (ev.key.keysym.sym == SDLK_LEFT)
+                    pan_x -= INTERACTIVE_PAN;
+                else if (ev.key.keysym.sym == SDLK_RIGHT)
+                    pan_x += INTERACTIVE_PAN;
+                else if (ev.key.keysym.sym == SDLK_UP)
+                    pan_y -= INTERACTIVE_PAN;
+                else if (ev.key.keysym.sym == SDLK_DOWN)
+                    pan_y += INTERACTIVE_PAN;
+            }
         }
 
-        if (motion > 0)
+        if (cycling)
+        {
+            palette_build(&lut, scheme, lut.max_iteration, lut.offset + 1);
+            dirty = 1;
+        }
+
+        // A pan by whole pixels keeps what stays on screen as it is. Once
+        // the view is done only the strips coming in are computed.
+        if ((pan_x != 0) || (pan_y != 0))
+        {
+            center_x -= pan_x * 3.5 * zoom / res_x;
+            center_y -= pan_y * 2.0 * zoom / res_y;
+            progressive_shift(&image, pan_x, pan_y, center_x, center_y);
+            dirty = 1;
+
+            if ((step > 0) || (abs(pan_x) >= res_x) || (abs(pan_y) >= res_y))
+                fresh = 1;
+            else
+            {
+                strip_x = (pan_x > 0) ? res_x - pan_x : 0;
+                strip_y = (pan_y > 0) ? res_y - pan_y : 0;
+
+                if ((pan_x != 0) &&
+                    (cl_render_pass(&render, 0, zoom, center_x, center_y, max_iteration, 1, 0,
+                                    strip_x, 0, abs(pan_x), res_y) != 0))
+                    exit(1);
+                if ((pan_y != 0) &&
+                    (cl_render_pass(&render, 0, zoom, center_x, center_y, max_iteration, 1, 0,
+                                    0, strip_y, res_x, abs(pan_y)) != 0))
+                    exit(1);
+                if ((samples = cl_render_wait(&render, 0)) == NULL)
+                    exit(1);
+                progressive_copy(&image, samples, strip_x, 0, abs(pan_x), res_y);
+                progressive_copy(&image, samples, 0, strip_y, res_x, abs(pan_y));
+            }
+        }
+
+        // While a button is held the view moves once it is done or out
+        // of time
+        moving = (motion != 0) && ((step == 0) || (wall_clock_seconds() - view_start >= PROGRESSIVE_BUDGET));
+
+        if (moving && (motion > 0))
         {
             if (julia_mode == 0)
                 zoom = zoom * 0.98;
@@ -329,7 +447,7 @@ int main(int argn, char **argv) {
             else
                 zoom -= 0.01;
         }
-        else if (motion < 0)
+        else if (moving && (motion < 0))
         {
             if (julia_mode == 0)
                 zoom = zoom / 0.98;
@@ -338,7 +456,7 @@ int main(int argn, char **argv) {
                 zoom += 0.01;
         }
 
-        if (motion != 0)
+        if (moving)
         {
             if (julia_mode == 0)
                 center_x = map_x_mandelbrot(center_x + mouse_x, res_x, zoom);
@@ -346,11 +464,28 @@ int main(int argn, char **argv) {
                 center_x = map_x_julia(center_x + mouse_x, res_x, zoom);
 
             center_y = map_y(center_y + mouse_y, res_y, zoom);
+
+            // What is still on screen stands for the new view until its
+            // passes come. The Julia views all cover the same place, zoom
+            // changes c.
+            if (julia_mode == 0)
+                progressive_zoom(&image, zoom, center_x, center_y);
+            else
+                progressive_forget(&image);
+            fresh = 1;
+            dirty = 1;
         }
 
+        // Nothing to show before the first pass
+        if ((!dirty) || (lut.colors == NULL))
+            continue;
+        dirty = 0;
+
+        palette_apply_pool(&lut, image.shown, frame_pixels, res_x, &pool);
+
         // Draw message on a corner...
         char* msg = (char *)malloc(100 * sizeof(char));
-        sprintf(msg, "Zoom level: %0.3f", zoom * 100.0);
+        sprintf(msg, "Zoom level: %0.3f  Iterations: %d", zoom * 100.0, max_iteration);
         message = TTF_RenderText_Solid( font, msg, textColor );
         free(msg);
         if (message != NULL)
@@ -358,7 +493,7 @@ int main(int argn, char **argv) {
 
         free(message);
 
-        SDL_UpdateTexture(texture_screen, NULL, (Uint32*)screen->pixels, 800 * sizeof (Uint32));
+        SDL_UpdateTexture(texture_screen, NULL, (Uint32*)screen->pixels, res_x * sizeof (Uint32));
         SDL_RenderClear(renderer);
         SDL_RenderCopy(renderer, texture_screen, NULL, NULL);
         SDL_RenderPresent(renderer);
@@ -367,20 +502,19 @@ int main(int argn, char **argv) {
     }
 
     // Clean up
-    ret = clFlush(command_queue);
-    ret = clFinish(command_queue);
-    ret = clReleaseKernel(kernel);
-    ret = clReleaseProgram(program);
-    ret = clReleaseMemObject(kernel_res_x);
-    ret = clReleaseMemObject(kernel_res_y);
-    ret = clReleaseMemObject(kernel_current_line);
-    ret = clReleaseMemObject(graph_mem_obj);
-    ret = clReleaseCommandQueue(command_queue);
-    ret = clReleaseContext(context);
-    // free(A);
-    // free(B);
-    // free(graph_dots);
-    // free(graph_line);
+    cl_render_release(&render);
+    palette_release(&lut);
+    iter_control_release(&control);
+    worker_pool_release(&pool);
+    tile_queue_release(&queue);
+    progressive_release(&image);
+
+    if (output != NULL)
+    {
+        image_writer_close(&writer);
+        free(frame_pixels);
+        return 0;
+    }
 
     while(active)
     {
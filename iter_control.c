@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "iter_control.h"
+
+// Cap of a view of the whole set, and how it grows with the depth in
+// decades: base + slope * depth^1.5
+#define ITER_CONTROL_BASE 100.0
+#define ITER_CONTROL_SLOPE 150.0
+
+// Raise when this fraction of the pixels reaching the last bin (escaping
+// there or not at all) escapes in it, and at least one pixel in so many
+// does. The unescaped ones are then likely to escape a bit further.
+#define ITER_CONTROL_TAIL 0.02
+#define ITER_CONTROL_NOISE 10000
+
+int iter_control_init(iter_control *control, int minimum, int maximum, int number_workers)
+{
+    control->minimum = minimum;
+    control->maximum = maximum;
+    control->floor = minimum;
+    control->max_iteration = minimum;
+    control->number_workers = (number_workers < 1) ? 1 : number_workers;
+    control->workers = aligned_alloc(ITER_CONTROL_LINE, control->number_workers * sizeof(iter_histogram));
+
+    if (control->workers == NULL)
+    {
+        fprintf(stderr, "Bad luck, out of memory\n");
+        return 2;
+    }
+
+    return 0;
+}
+
+// Caps are rounded up to 3 significant bits, steps of 6 to 12%. Small
+// moves of the floor then keep the cap, and with it the palette and the
+// frame reprojection.
+static int iter_control_clamp(const iter_control *control, double cap)
+{
+    int step = 1;
+
+    if (cap < control->floor)
+        cap = control->floor;
+    if (cap < control->minimum)
+        cap = control->minimum;
+    if (cap > control->maximum)
+        cap = control->maximum;
+
+    while (step * 16 <= cap)
+        step += step;
+    cap = step * ceil(cap / step);
+
+    return (cap > control->maximum) ? control->maximum : (int) cap;
+}
+
+// Sets the floor from the depth of the view, in decades below the whole
+// set (-log10(zoom) for the renderers). Returns the cap for the frame
+// about to be rendered.
+int iter_control_scale(iter_control *control, double depth)
+{
+    if (depth < 0.0)
+        depth = 0.0;
+
+    control->floor = iter_control_clamp(control, ITER_CONTROL_BASE + ITER_CONTROL_SLOPE * pow(depth, 1.5));
+    control->max_iteration = iter_control_clamp(control, control->max_iteration);
+
+    return control->max_iteration;
+}
+
+// Pool job, counts a tile into the histogram of the worker. Pixels that
+// never escaped are 0 (or negative, unresolved glitches) for the CPU
+// renderers and the cap itself for the OpenCL kernels.
+void iter_control_tile(void *frame, const tile *piece, int worker)
+{
+    iter_control *control = (iter_control *) frame;
+    iter_histogram *histogram = &control->workers[worker % control->number_workers];
+    int samples[TILE_SIZE * TILE_SIZE];
+    const int *line;
+    int x, y, value;
+
+    // A tiled frame is unpacked a tile at a time
+    if (control->tiles != NULL)
+        frame_buffer_load(control->tiles, piece, samples, TILE_SIZE);
+
+    for (y = piece->y; y < piece->y + piece->height; y++)
+    {
+        if (control->tiles != NULL)
+            line = &samples[(y - piece->y) * TILE_SIZE];
+        else
+            line = &control->iterations[piece->x + y * control->res_x];
+        for (x = 0; x < piece->width; x++)
+        {
+            value = line[x];
+            if ((value <= 0) || (value >= control->cap))
+                histogram->unescaped++;
+            else
+                histogram->bins[((long) value * ITER_CONTROL_BINS) / control->cap]++;
+        }
+    }
+}
+
+// Counts the frame set in control, rendered with cap, and picks the cap
+// of the next one. Without a pool the frame is counted by the calling
+// thread.
+static int iter_control_count(iter_control *control, int res_x, int res_y, int cap, worker_pool *pool)
+{
+    iter_histogram total;
+    unsigned long tail, pixels = (unsigned long) res_x * res_y;
+    int worker, bin, highest;
+    tile whole;
+
+    memset(control->workers, 0, control->number_workers * sizeof(iter_histogram));
+    control->res_x = res_x;
+    control->cap = cap;
+
+    if (pool != NULL)
+        worker_pool_render(pool, iter_control_tile, (void *) control);
+    else
+    {
+        whole.x = 0;
+        whole.y = 0;
+        whole.width = res_x;
+        whole.height = res_y;
+        iter_control_tile((void *) control, &whole, 0);
+    }
+
+    memset(&total, 0, sizeof(total));
+    for (worker = 0; worker < control->number_workers; worker++)
+    {
+        total.unescaped += control->workers[worker].unescaped;
+        for (bin = 0; bin < ITER_CONTROL_BINS; bin++)
+            total.bins[bin] += control->workers[worker].bins[bin];
+    }
+
+    highest = -1;
+    for (bin = 0; bin < ITER_CONTROL_BINS; bin++)
+        if (total.bins[bin] > 0)
+            highest = bin;
+
+    tail = total.bins[ITER_CONTROL_BINS - 1];
+    if ((tail > ITER_CONTROL_TAIL * (tail + total.unescaped)) && (tail * ITER_CONTROL_NOISE > pixels))
+        control->max_iteration = iter_control_clamp(control, cap * 1.5);
+    else if (highest < ITER_CONTROL_BINS / 2)
+        control->max_iteration = iter_control_clamp(control, cap * 0.75);
+    else
+        control->max_iteration = iter_control_clamp(control, cap);
+
+    return control->max_iteration;
+}
+
+// Looks at a frame of row-major ints
+int iter_control_update(iter_control *control, const int *iterations, int res_x, int res_y, int cap, worker_pool *pool)
+{
+    control->iterations = iterations;
+    control->tiles = NULL;
+    return iter_control_count(control, res_x, res_y, cap, pool);
+}
+
+// The same for a tiled frame, counted by the pool a tile at a time
+int iter_control_update_frame(iter_control *control, const frame_buffer *tiles, int cap, worker_pool *pool)
+{
+    control->iterations = NULL;
+    control->tiles = tiles;
+    return iter_control_count(control, tiles->res_x, tiles->res_y, cap, pool);
+}
+
+void iter_control_release(iter_control *control)
+{
+    free(control->workers);
+}
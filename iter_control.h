@@ -0,0 +1,59 @@
+#ifndef ITER_CONTROL_H
+#define ITER_CONTROL_H
+
+#include "tile_queue.h"
+#include "worker_pool.h"
+#include "frame_buffer.h"
+
+// Bounds of the cap when the renderers pick it themselves
+#define ITER_CONTROL_MINIMUM 64
+#define ITER_CONTROL_MAXIMUM 1000000
+
+// Escaped pixels of a frame are counted in this many bins spread over
+// 1 .. max_iteration
+#define ITER_CONTROL_BINS 32
+
+// Cache line size. The workers fill their histograms side by side, each
+// is padded to whole lines so no two of them share one.
+#define ITER_CONTROL_LINE 64
+
+typedef struct iter_histogram iter_histogram;
+struct iter_histogram
+{
+    unsigned long bins[ITER_CONTROL_BINS];
+    unsigned long unescaped;
+    char padding[ITER_CONTROL_LINE - (ITER_CONTROL_BINS + 1) * sizeof(unsigned long) % ITER_CONTROL_LINE];
+};
+
+// Picks max_iteration frame after frame. The scale of the view gives a
+// floor, deeper views need more iterations. On top of it the histogram of
+// the last frame raises the cap when pixels still escape right below it,
+// and lowers it when nothing gets near.
+typedef struct iter_control iter_control;
+struct iter_control
+{
+    int minimum;
+    int maximum;
+    int floor;
+    int max_iteration;
+
+    // One histogram per worker of the pool, merged after the frame. Sized
+    // for the pool passed to iter_control_update.
+    iter_histogram *workers;
+    int number_workers;
+
+    // The frame being counted, row-major ints or tiles
+    const int *iterations;
+    const frame_buffer *tiles;
+    int res_x;
+    int cap;
+};
+
+int iter_control_init(iter_control *control, int minimum, int maximum, int number_workers);
+int iter_control_scale(iter_control *control, double depth);
+void iter_control_tile(void *frame, const tile *piece, int worker);
+int iter_control_update(iter_control *control, const int *iterations, int res_x, int res_y, int cap, worker_pool *pool);
+int iter_control_update_frame(iter_control *control, const frame_buffer *tiles, int cap, worker_pool *pool);
+void iter_control_release(iter_control *control);
+
+#endif
@@ -1,181 +1,256 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
-
-#include <time.h>
-
-#ifdef __APPLE__
-#include <OpenCL/opencl.h>
-#else
-#include <CL/cl.h>
-#endif
+#include <unistd.h>
 
 #include <SDL.h>
 #include <SDL_ttf.h>
 
-#define MAX_SOURCE_SIZE (0x100000)
+#include "cl_render.h"
+#include "tile_queue.h"
+#include "worker_pool.h"
+#include "image_output.h"
+#include "palette.h"
+#include "iter_control.h"
+#include "antialias.h"
+#include "wall_clock.h"
+
+// Extra samples of the antialiasing sent to the devices at once
+#define ANTIALIAS_POINTS 65536
+
+// Adaptive antialiasing of a colored frame, from its counts. The samples
+// of the edge pixels are computed by the devices a list at a time and
+// averaged into their colors. zoom and the center are those the frame
+// was queued with. points, found and colors hold ANTIALIAS_POINTS, edges
+// a frame.
+static int antialias_frame(cl_render *render, antialias *aa, const palette *lut, const int *counts, uint32_t *argb,
+                           int julia_mode, double zoom, double center_x, double center_y, int max_iteration,
+                           int *edges, double *points, int *found, uint32_t *colors)
+{
+    int res_x = render->res_x, res_y = render->res_y;
+    int x, y, number_edges = 0, edge, batch, count, sample, total;
+    double scale = julia_mode ? 1.0 : zoom;
+
+    // Julia always shows the whole plane, see the kernel
+    if (julia_mode)
+    {
+        center_x = 1.75;
+        center_y = 1.00001;
+    }
 
-int main(int argn, char **argv) {
+    for (y = 0; y < res_y; y++)
+        for (x = 0; x < res_x; x++)
+            if (antialias_edge(aa, counts, res_x, res_x, res_y, x, y))
+                edges[number_edges++] = x + y * res_x;
+    antialias_count(aa, 0, res_x * res_y, number_edges);
 
-    // Init SDL
-    if(SDL_Init(SDL_INIT_VIDEO) != 0)
-        fprintf(stderr, "Could not initialize SDL: %s\n", SDL_GetError());
+    batch = ANTIALIAS_POINTS / aa->samples;
+    for (edge = 0; edge < number_edges; edge += batch)
+    {
+        count = (number_edges - edge < batch) ? number_edges - edge : batch;
+        total = 0;
+        for (x = edge; x < edge + count; x++)
+        {
+            for (sample = 0; sample < aa->samples; sample++)
+            {
+                points[2 * total] = ((edges[x] % res_x + aa->offsets[sample % aa->side]) / res_x) * (3.5 * scale) - center_x;
+                points[2 * total + 1] = ((edges[x] / res_x + aa->offsets[sample / aa->side]) / res_y) * (2.0 * scale) - center_y;
+                total++;
+            }
+        }
 
-    printf("SDL Initialized\n");
+        if (cl_render_samples(render, points, total, zoom, max_iteration, found) != 0)
+            return 1;
 
-    // Create screen surface
-    SDL_Surface *screen, *message;
+        palette_apply(lut, found, colors, total);
+        for (x = 0; x < count; x++)
+            argb[edges[edge + x]] = antialias_average(&colors[x * aa->samples], aa->samples);
+    }
+
+    return 0;
+}
+
+int main(int argn, char **argv) {
+
+    SDL_Surface *screen = NULL, *message;
+    SDL_Window *window = NULL;
+    SDL_Renderer *renderer = NULL;
+    SDL_Texture *texture_screen = NULL;
+    TTF_Font *font = NULL;
     int res_x = 800;
     int res_y = 600;
-    int current_line = 0;
     int julia_mode = 0;
-
-    if (argn == 1)
+    const char *output = NULL;
+    const char *view_text = NULL;
+    image_writer writer;
+    uint32_t *frame_pixels;
+    palette lut = { NULL, 0, 0, 0 };
+    int scheme = PALETTE_CLASSIC;
+    int fixed_iterations = 0;
+    int subdevices = 0;
+    int double_precision = 0;
+    int budget = 0;
+    int arg;
+
+    for (arg = 1; arg < argn; arg++)
     {
-        julia_mode = 0;
+        if (strcmp(argv[arg], "-julia") == 0)
+            julia_mode = 1;
+        else if ((strcmp(argv[arg], "-headless") == 0) && (arg + 1 < argn) && image_pattern_valid(argv[arg + 1]))
+            output = argv[++arg];
+        else if ((strcmp(argv[arg], "-view") == 0) && (arg + 1 < argn))
+            view_text = argv[++arg];
+        else if ((strcmp(argv[arg], "-palette") == 0) && (arg + 1 < argn) &&
+                 ((scheme = palette_find(argv[arg + 1])) >= 0))
+            arg++;
+        else if ((strcmp(argv[arg], "-iterations") == 0) && (arg + 1 < argn))
+            fixed_iterations = atoi(argv[++arg]);
+        else if ((strcmp(argv[arg], "-subdevices") == 0) && (arg + 1 < argn))
+            subdevices = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "-double") == 0)
+            double_precision = 1;
+        else if ((strcmp(argv[arg], "-antialias") == 0) && (arg + 1 < argn) &&
+                 ((budget = atoi(argv[arg + 1])) >= ANTIALIAS_MIN_SIDE * ANTIALIAS_MIN_SIDE))
+            arg++;
+        else
+        {
+            fprintf(stderr, "Usage: %s [-julia] [-headless file_%%05d.ppm|file_%%05d.png|file.y4m|-] [-view ZOOM]\n"
+                            "       [-palette classic|fire|ocean|gray] [-iterations N] [-subdevices N] [-double]\n"
+                            "       [-antialias SAMPLES]\n", argv[0]);
+            return 1;
+        }
     }
-    else if ((argn == 2) && (strcmp(argv[1], "-julia") == 0))
-    {
-        julia_mode = 1;
+
+    // Headless renders never touch SDL. Opened before any printf, as the
+    // Y4M stream on stdout moves them to stderr.
+    if ((output != NULL) && (image_writer_open(&writer, output, res_x, res_y) != 0))
+        return 1;
+
+    if (julia_mode)
         printf("Julia mode activated...\n");
-    }
 
-    SDL_Window *window = SDL_CreateWindow("CLFract",
-                                           SDL_WINDOWPOS_UNDEFINED,
-                                           SDL_WINDOWPOS_UNDEFINED,
-                                           res_x, res_y, 0);
+    if (output == NULL)
+    {
+        // Init SDL
+        if(SDL_Init(SDL_INIT_VIDEO) != 0)
+            fprintf(stderr, "Could not initialize SDL: %s\n", SDL_GetError());
 
-    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, 0);
+        printf("SDL Initialized\n");
 
-    if ((!window) || (!renderer))
-	    fprintf(stderr,"Could not set video mode: %s\n",SDL_GetError());
+        window = SDL_CreateWindow("CLFract",
+                                  SDL_WINDOWPOS_UNDEFINED,
+                                  SDL_WINDOWPOS_UNDEFINED,
+                                  res_x, res_y, 0);
 
-    // Blank the window
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderClear(renderer);
-    SDL_RenderPresent(renderer);
+        renderer = SDL_CreateRenderer(window, -1, 0);
 
-    SDL_Texture *texture_screen = SDL_CreateTexture(renderer,
-                                                   SDL_PIXELFORMAT_ARGB8888,
-                                                   SDL_TEXTUREACCESS_STREAMING,
-                                                   res_x, res_y);
+        if ((!window) || (!renderer))
+            fprintf(stderr,"Could not set video mode: %s\n",SDL_GetError());
 
-    screen = SDL_CreateRGBSurface(0, res_x, res_y , 32, 0, 0, 0, 0);
+        // Blank the window
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+        SDL_RenderClear(renderer);
+        SDL_RenderPresent(renderer);
 
-    //Initialize SDL_ttf
-    if( TTF_Init() == -1 )
-    {
-        printf("Error setting up TTF module.\n");
-        return 1;
-    }
+        texture_screen = SDL_CreateTexture(renderer,
+                                           SDL_PIXELFORMAT_ARGB8888,
+                                           SDL_TEXTUREACCESS_STREAMING,
+                                           res_x, res_y);
+
+        screen = SDL_CreateRGBSurface(0, res_x, res_y , 32, 0, 0, 0, 0);
+
+        //Initialize SDL_ttf
+        if( TTF_Init() == -1 )
+        {
+            printf("Error setting up TTF module.\n");
+            return 1;
+        }
+
+        // Load a font
+        font = TTF_OpenFont("font.ttf", 24);
+        if (font == NULL)
+        {
+            printf("TTF_OpenFont() Failed: %s", TTF_GetError());
+            SDL_Quit();
+            return 1;
+        }
 
-    // Load a font
-    TTF_Font *font;
-    font = TTF_OpenFont("font.ttf", 24);
-    if (font == NULL)
+        frame_pixels = (uint32_t *) screen->pixels;
+    }
+    else
     {
-        printf("TTF_OpenFont() Failed: %s", TTF_GetError());
-        SDL_Quit();
-        return 1;
+        frame_pixels = malloc(res_x * res_y * sizeof(uint32_t));
+        if (frame_pixels == NULL)
+        {
+            fprintf(stderr, "Bad luck, out of memory\n");
+            return 2;
+        }
     }
 
     //The color of the font
     SDL_Color textColor = { 255, 255, 255 };
 
     // Prepare the resolution and sizes and colors...
-    const int ITERATIONS = 256;
-
-    // Load the kernel source code into the array source_str
-    FILE *fp;
-    char *source_str;
-    size_t source_size;
-
-    if (julia_mode == 0)
-        fp = fopen("mandelbrot_kernel.cl", "r");
-    else
-        fp = fopen("julia_kernel.cl", "r");
-
-    if (!fp) {
-        fprintf(stderr, "Failed to load kernel.\n");
-        exit(1);
-    }
-    source_str = (char*)malloc(MAX_SOURCE_SIZE);
-    source_size = fread( source_str, 1, MAX_SOURCE_SIZE, fp);
-    fclose( fp );
-
-    // Get platform and device information
-    cl_platform_id platform_id = NULL;
-    cl_device_id device_id = NULL;
-    cl_uint ret_num_devices;
-    cl_uint ret_num_platforms;
-    cl_int ret = clGetPlatformIDs(1, &platform_id, &ret_num_platforms);
-    ret = clGetDeviceIDs( platform_id, CL_DEVICE_TYPE_GPU, 1,
-            &device_id, &ret_num_devices);
-
-    // Create an OpenCL context
-    cl_context context = clCreateContext( NULL, 1, &device_id, NULL, NULL, &ret);
-
-    // Create a command queue
-    cl_command_queue command_queue = clCreateCommandQueueWithProperties(context, device_id, 0, &ret);
-
-    // Create memory buffers on the device for returning iterations
-    // Input parameters
-    cl_mem kernel_res_x = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-            sizeof(int), &res_x, &ret);
-    cl_mem kernel_res_y = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-            sizeof(int), &res_y, &ret);
-    cl_mem kernel_current_line = clCreateBuffer(context, CL_MEM_READ_ONLY,
-            sizeof(int), NULL, &ret);
-    cl_mem kernel_zoom_level = clCreateBuffer(context, CL_MEM_READ_ONLY,
-            sizeof(float), NULL, &ret);
-    // Output buffer
-    cl_mem graph_mem_obj = clCreateBuffer(context, CL_MEM_WRITE_ONLY,
-            res_x * sizeof(int), NULL, &ret);
-
-    // Create a program from the kernel source
-    cl_program program = clCreateProgramWithSource(context, 1,
-            (const char **)&source_str, (const size_t *)&source_size, &ret);
-
-    // Build the program
-    ret = clBuildProgram(program, 1, &device_id, NULL, NULL, NULL);
-
-    if (ret != CL_SUCCESS) {
-        printf("Program build failed, error code: %d", ret);
-
-        // Check if it is correct
-        printf("clBuildProgram\n");
-        cl_build_status build_status;
-        ret = clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_STATUS, sizeof(cl_build_status), &build_status, NULL);
-
-        char *build_log;
-        size_t ret_val_size;
-        ret = clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, 0, NULL, &ret_val_size);
-
-        build_log = (char *) malloc((ret_val_size + 1) * sizeof(char));
-        ret = clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, ret_val_size, build_log, NULL);
-                                    build_log[ret_val_size] = '\0';
-
-        printf("BUILD LOG: \n %s", build_log);
+    cl_render render;
+    cl_render_options options;
+    int *graph_dots;
+    int slot = 0, more;
+    iter_control control;
+    tile_queue queue;
+    worker_pool pool;
+    int number_workers;
+    antialias aa;
+    int *aa_edges = NULL, *aa_found = NULL;
+    double *aa_points = NULL;
+    uint32_t *aa_colors = NULL;
+    int slot_iterations[CL_RENDER_BUFFERS];
+    float slot_zoom[CL_RENDER_BUFFERS];
+    int shown_iteration = 0, frame_number = 0;
+
+    // A fixed cap is built into the kernel
+    cl_render_defaults(&options, (julia_mode == 0) ? CL_FRACTAL_MANDELBROT : CL_FRACTAL_JULIA);
+    options.double_precision = double_precision;
+    options.constant_iterations = (fixed_iterations > 0);
+    if (cl_render_init(&render, &options, res_x, res_y, subdevices) != 0)
         exit(1);
 
+    // The host side of a frame, its histogram and its colors, is split
+    // over the cores tile by tile
+    number_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (number_workers < 1)
+        number_workers = 1;
+    if (tile_queue_init(&queue, res_x, res_y, TILE_SIZE, number_workers) != 0)
+        return 2;
+    if (worker_pool_init(&pool, number_workers, &queue) != 0)
+        return 2;
+
+    // max_iteration follows the depth and the escapes of the frames
+    // already back, unless -iterations fixes it
+    if (fixed_iterations > 0)
+    {
+        if (iter_control_init(&control, fixed_iterations, fixed_iterations, number_workers) != 0)
+            return 2;
     }
+    else if (iter_control_init(&control, ITER_CONTROL_MINIMUM, ITER_CONTROL_MAXIMUM, number_workers) != 0)
+        return 2;
 
-    printf("program built\n");
-
-    // Create the OpenCL kernel
-    cl_kernel kernel = clCreateKernel(program, "fractal_point", &ret);
-
-    if (ret != CL_SUCCESS) {
-        printf("Error when loading the kernel: %d", ret);
-        exit(1);
+    // Edge pixels take up to budget samples once colored
+    if (budget > 0)
+    {
+        if (antialias_init(&aa, budget, 1, 1) != 0)
+            return 2;
+        aa_edges = malloc(res_x * res_y * sizeof(int));
+        aa_points = malloc(2 * ANTIALIAS_POINTS * sizeof(double));
+        aa_found = malloc(ANTIALIAS_POINTS * sizeof(int));
+        aa_colors = malloc(ANTIALIAS_POINTS * sizeof(uint32_t));
+        if ((aa_edges == NULL) || (aa_points == NULL) || (aa_found == NULL) || (aa_colors == NULL))
+        {
+            fprintf(stderr, "Bad luck, out of memory\n");
+            return 2;
+        }
+        printf("Adaptive antialiasing, up to %d samples per pixel\n", aa.samples);
     }
 
-    // Common kernel params
-    ret = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void *) &kernel_res_x);
-    ret = clSetKernelArg(kernel, 1, sizeof(cl_mem), (void *) &kernel_res_y);
-    ret = clSetKernelArg(kernel, 4, sizeof(cl_mem), (void *) &graph_mem_obj);
-
-    int graph_line[res_x];  // (int*)malloc(res_x * sizeof(int));
     float zoom = 1.0;             // Our current zoom level
     float stop_point;
 
@@ -184,107 +259,73 @@ int main(int argn, char **argv) {
     else
         stop_point = -2.5;
 
-    clock_t start = clock();
+    // A single view is one frame at the given zoom (the c offset for Julia)
+    if (view_text != NULL)
+        zoom = atof(view_text);
 
-    while(zoom > stop_point)
-    {
-        for (current_line = 0; current_line < res_y; current_line++)
-        {
-            // Set the arguments of the kernel
-            ret = clEnqueueWriteBuffer(command_queue, kernel_current_line, CL_TRUE, 0,
-                    sizeof(int), &current_line, 0, NULL, NULL);
+    double start = wall_clock_seconds();
 
-            ret = clEnqueueWriteBuffer(command_queue, kernel_zoom_level, CL_TRUE, 0,
-                    sizeof(float), &zoom, 0, NULL, NULL);
+    // The next frame is queued before the current one is colorized and
+    // presented, the devices start on its first batches meanwhile. The
+    // Mandelbrot zoom keeps the corner of the view at -(1.5 + zoom),
+    // -(zoom + 0.00001). The Julia views ignore the center.
+    slot_iterations[slot] = iter_control_scale(&control, julia_mode ? 0.0 : -log10(zoom));
+    slot_zoom[slot] = zoom;
+    if (cl_render_submit(&render, slot, zoom, 1.5 + zoom, zoom + 0.00001, slot_iterations[slot]) != 0)
+        exit(1);
 
-            clFinish(command_queue);
+    do
+    {
+        // Step, iterate our zoom levels if we're doing mandelbrot or julia set
+        if (julia_mode == 0)
+            zoom = zoom * 0.98;
+        else
+            zoom -= 0.01;
 
-            ret = clSetKernelArg(kernel, 2, sizeof(cl_mem), (void *) &kernel_current_line);
-            if (ret != CL_SUCCESS) {
-                printf("Error setting current_line %d", ret);
-                exit(1);
-            }
-            ret = clSetKernelArg(kernel, 3, sizeof(cl_mem), (void *) &kernel_zoom_level);
-            if (ret != CL_SUCCESS) {
-                printf("Error setting zoom_level %d", ret);
+        more = (view_text == NULL) && (zoom > stop_point);
+        if (more)
+        {
+            slot_iterations[(slot + 1) % CL_RENDER_BUFFERS] = iter_control_scale(&control, julia_mode ? 0.0 : -log10(zoom));
+            slot_zoom[(slot + 1) % CL_RENDER_BUFFERS] = zoom;
+            if (cl_render_submit(&render, (slot + 1) % CL_RENDER_BUFFERS, zoom, 1.5 + zoom, zoom + 0.00001,
+                                 slot_iterations[(slot + 1) % CL_RENDER_BUFFERS]) != 0)
                 exit(1);
-            }
+        }
 
-            // Execute the OpenCL kernel on the list
-            size_t global_item_size = res_x; // Process the entire line
-            size_t local_item_size = 16; // Process in groups of 64
-            ret = clEnqueueNDRangeKernel(command_queue, kernel, 1, NULL,
-                    &global_item_size, &local_item_size, 0, NULL, NULL);
+        // This frame steers the one after the frame already queued
+        graph_dots = cl_render_wait(&render, slot);
+        if (graph_dots == NULL)
+            exit(1);
+        iter_control_update(&control, graph_dots, res_x, res_y, slot_iterations[slot], &pool);
 
-            if (ret != CL_SUCCESS)
-            {
-                printf("Error while executing kernel\n");
-                printf("Error code %d\n", ret);
+        // Headless runs log the cap of every frame, on screen only changes
+        if ((output != NULL) || (slot_iterations[slot] != shown_iteration))
+        {
+            printf("Frame %d: max_iteration %d\n", frame_number, slot_iterations[slot]);
+            shown_iteration = slot_iterations[slot];
+        }
+        frame_number++;
+
+        if ((lut.max_iteration != slot_iterations[slot]) && (palette_build(&lut, scheme, slot_iterations[slot], 0) != 0))
+            return 2;
+        palette_apply_pool(&lut, graph_dots, frame_pixels, res_x, &pool);
+        if ((budget > 0) &&
+            (antialias_frame(&render, &aa, &lut, graph_dots, frame_pixels, julia_mode, slot_zoom[slot],
+                             1.5 + slot_zoom[slot], slot_zoom[slot] + 0.00001, slot_iterations[slot],
+                             aa_edges, aa_points, aa_found, aa_colors) != 0))
+            exit(1);
+        slot = (slot + 1) % CL_RENDER_BUFFERS;
+
+        if (output != NULL)
+        {
+            if (image_writer_frame(&writer, frame_pixels) != 0)
                 exit(1);
-            }
-
-            // Wait for the computation to finish
-            clFinish(command_queue);
-
-            // Read the memory buffer graph_mem_obj on the device to the local variable graph_dots
-            ret = clEnqueueReadBuffer(command_queue, graph_mem_obj, CL_TRUE, 0,
-                    res_x * sizeof(int), graph_line, 0, NULL, NULL);
-
-            if (ret != CL_SUCCESS)
-                printf("Error while reading results buffer\n");
-
-            clFinish(command_queue);
-
-            int line_count;
-            Uint32 *pixel;
-            // Lock surface
-            // SDL_LockSurface(screen);
-            // rank = screen->pitch/sizeof(Uint32);
-            pixel = (Uint32*)screen->pixels;
-            int iteration;
-
-            for (line_count = 0; line_count < res_x; line_count++)
-            {
-                // int temp_val = graph_line[line_count];
-                // graph_dots[(current_line * res_x) + line_count] = temp_val;
-                // Get the iterations for the point
-                // printf("Point %d\n", i);
-                iteration = graph_line[line_count];
-                if ((iteration < 128) && (iteration > 0)) {
-                    pixel[(current_line * res_x) + line_count] = SDL_MapRGBA(screen->format,
-                                           0,
-                                           20 + iteration,
-                                           0,
-                                           255);
-                }
-                else if ((iteration >= 128) && (iteration < ITERATIONS))
-                {
-                    pixel[(current_line * res_x) + line_count] = SDL_MapRGBA(screen->format,
-                                           iteration,
-                                           148,
-                                           iteration,
-                                           255);
-                }
-                else
-                {
-                    pixel[(current_line * res_x) + line_count] = SDL_MapRGBA(screen->format,
-                                                       0,
-                                                       0,
-                                                       0,
-                                                       255);
-                }
-            }
+            continue;
         }
 
-        // Step, iterate our zoom levels if we're doing mandelbrot or julia set
-        if (julia_mode == 0)
-            zoom = zoom * 0.98;
-        else
-            zoom -= 0.01;
-
         // Draw message on a corner...
         char* msg = (char *)malloc(100 * sizeof(char));
-        sprintf(msg, "Zoom level: %0.3f", zoom * 100.0);
+        sprintf(msg, "Zoom level: %0.3f  Iterations: %d", zoom * 100.0, shown_iteration);
         message = TTF_RenderText_Solid( font, msg, textColor );
         free(msg);
         if (message != NULL)
@@ -292,31 +333,40 @@ int main(int argn, char **argv) {
 
         free(message);
 
-        SDL_UpdateTexture(texture_screen, NULL, (Uint32*)screen->pixels, 800 * sizeof (Uint32));
+        SDL_UpdateTexture(texture_screen, NULL, (Uint32*)screen->pixels, res_x * sizeof (Uint32));
         SDL_RenderClear(renderer);
         SDL_RenderCopy(renderer, texture_screen, NULL, NULL);
         SDL_RenderPresent(renderer);
         // Draw to the screen
         // SDL_Flip(screen);
     }
+    while (more);
 
-    printf("Time elapsed %0.5f seconds\n", ((double)clock() - start) / CLOCKS_PER_SEC);
+    printf("Time elapsed %0.5f seconds\n", wall_clock_seconds() - start);
+    cl_render_report(&render, stdout);
+    if (budget > 0)
+    {
+        antialias_report(&aa, stdout);
+        antialias_release(&aa);
+        free(aa_edges);
+        free(aa_points);
+        free(aa_found);
+        free(aa_colors);
+    }
 
     // Clean up
-    ret = clFlush(command_queue);
-    ret = clFinish(command_queue);
-    ret = clReleaseKernel(kernel);
-    ret = clReleaseProgram(program);
-    ret = clReleaseMemObject(kernel_res_x);
-    ret = clReleaseMemObject(kernel_res_y);
-    ret = clReleaseMemObject(kernel_current_line);
-    ret = clReleaseMemObject(graph_mem_obj);
-    ret = clReleaseCommandQueue(command_queue);
-    ret = clReleaseContext(context);
-    // free(A);
-    // free(B);
-    // free(graph_dots);
-    // free(graph_line);
+    cl_render_release(&render);
+    palette_release(&lut);
+    iter_control_release(&control);
+    worker_pool_release(&pool);
+    tile_queue_release(&queue);
+
+    if (output != NULL)
+    {
+        image_writer_close(&writer);
+        free(frame_pixels);
+        return 0;
+    }
 
     SDL_Event ev;
     int active;
@@ -3,21 +3,38 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <math.h>
+#include <limits.h>
 
 #include <time.h>
 
 #include <SDL.h>
 #include <SDL_ttf.h>
 
+#include "tile_queue.h"
+#include "worker_pool.h"
+#include "escape_kernel.h"
+#include "fractal_engine.h"
+#include "perturbation.h"
+#include "image_output.h"
+#include "palette.h"
+#include "orbit_cache.h"
+#include "reproject.h"
+#include "frame_buffer.h"
+#include "subdivide.h"
+#include "iter_control.h"
+#include "antialias.h"
+#include "poster.h"
+#include "wall_clock.h"
+
 #define MAX_SOURCE_SIZE (0x100000)
 
-#ifdef CACHE
-int** cached_points;
-int** cached_x;
-int** cached_y;
-#endif
+// Where the deep zoom goes when no -center is given (seahorse valley)
+#define DEEP_CENTER_X "-0.743643887037158704752191506114774"
+#define DEEP_CENTER_Y "0.131825904205311970493132056385139"
 
-int *iteration_pixels;
+frame_buffer *iteration_frame;
+escape_tile_fn escape_tile;
+orbit_cache *cache;
 
 typedef struct point_args point_args;
 struct point_args
@@ -31,18 +48,38 @@ struct point_args
     int thread_number;
 };
 
-typedef struct piece_args piece_args;
-struct piece_args
+// Frame descriptor handed to the worker pool
+typedef struct frame_args frame_args;
+struct frame_args
 {
     int res_x;
     int res_y;
     float zoom;
     int max_iteration;
-    int total_threads;
-    int thread_number;
     int julia_mode;
+    int power;
+    int subdivide;
+    int smooth;
+    reproject *reuse;
+    palette_histogram *histogram;
+    const int *deep_pixels;
+
+    // First row of the frame in the image, posters render it a strip at
+    // a time and their frames hold one strip
+    int offset_y;
+
+    // Antialiasing of the colored frame
+    antialias *aa;
+    const palette *lut;
+    uint32_t *argb;
 };
 
+// Extra samples iterated together by the antialiasing of a tile
+#define ANTIALIAS_BATCH (TILE_SIZE * TILE_SIZE)
+
+// Memory for the strips of a poster when -memory does not say, in MB
+#define POSTER_MEMORY 256
+
 
 int get_x (int linear_point, int width) 
 {
@@ -57,7 +94,6 @@ int get_y (int linear_point, int height)
 float map_x_mandelbrot(int x, int width, float zoom)
 {
     return (((float)x / (float)width) * (3.5 * zoom)) - (2.5 - (1.0 - zoom));
-    return (((float)x / (float)width) * (3.5 * zoom)) - (1.75 - (1.0 - zoom));
 }
 
 float map_x_julia(int x, int width, float zoom)
@@ -70,235 +106,483 @@ float map_y(int y, int height, float zoom)
     return (((float)y / (float)height) * (2.0 * zoom)) - (1.00001 - (1.0 - zoom));
 }
 
-#ifdef CACHE
-int cached_iteration(float pos_x, float pos_y)
+// Looks the point up in the orbit cache. Returns the final count if the
+// cache already knows it, else -1 with the orbit to resume in x, y, iteration.
+int cache_resume(const orbit_key *key, int max_iteration, float *x, float *y, int *iteration)
 {
-    float centered_x = pos_x + 2.5;
-    float centered_y = pos_y + 1.0;
-    float temp_x = floor(centered_x * 1000.0);
-    float temp_y = floor(centered_y * 1000.0);
+    orbit_state state;
 
-    int trs_pos_x = (int)temp_x;
-    int trs_pos_y = (int)temp_y;
+    if ((cache == NULL) || !orbit_cache_lookup(cache, key, &state))
+        return -1;
 
-    return cached_points[trs_pos_x][trs_pos_y];
+    if (state.escaped)
+        return (state.iteration < max_iteration) ? state.iteration : 0;
+    if (state.iteration >= max_iteration)
+        return 0;
+
+    *x = state.x;
+    *y = state.y;
+    *iteration = state.iteration;
+    return -1;
 }
 
-float get_cached_x(float pos_x, float pos_y)
+void cache_keep(const orbit_key *key, int max_iteration, float x, float y, int iteration)
 {
-    float centered_x = pos_x + 2.5;
-    float centered_y = pos_y + 1.0;
-    float temp_x = floor(centered_x * 1000.0);
-    float temp_y = floor(centered_y * 1000.0);
+    orbit_state state;
 
-    int trs_pos_x = (int)temp_x;
-    int trs_pos_y = (int)temp_y;
+    if (cache == NULL)
+        return;
 
-    return cached_x[trs_pos_x][trs_pos_y];
+    state.x = x;
+    state.y = y;
+    state.iteration = iteration;
+    state.escaped = (iteration < max_iteration);
+    orbit_cache_store(cache, key, &state);
 }
 
-float get_cached_y(float pos_x, float pos_y)
+// One pixel through the orbit cache. Inlined with a constant formula
+// into the callers below, the tile picks one of them.
+FRACTAL_INLINE int cached_point(int formula, int power, float pos_x, float pos_y, float julia_x, float julia_y, int max_iteration)
 {
-    float centered_x = pos_x + 2.5;
-    float centered_y = pos_y + 1.0;
-    float temp_x = floor(centered_x * 1000.0);
-    float temp_y = floor(centered_y * 1000.0);
+    float x, y, cx, cy;
+    int iteration = 0, known;
+    orbit_key key;
 
-    int trs_pos_x = (int)temp_x;
-    int trs_pos_y = (int)temp_y;
+    // Cardioid and period-2 bulb check
+    if (!fractal_start_float(formula, power, FRACTAL_BULBS, pos_x, pos_y, julia_x, julia_y, &x, &y, &cx, &cy))
+        return 0;
 
-    return cached_y[trs_pos_x][trs_pos_y];
-}
+    // Look up our cache, for Julia the orbit depends on c as well. A cache
+    // only ever sees one power.
+    key.pos_x = pos_x;
+    key.pos_y = pos_y;
+    key.julia_x = (formula == FRACTAL_JULIA) ? julia_x : 0.0;
+    key.julia_y = (formula == FRACTAL_JULIA) ? julia_y : 0.0;
+    key.julia = (formula == FRACTAL_JULIA);
+    known = cache_resume(&key, max_iteration, &x, &y, &iteration);
+    if (known >= 0)
+        return known;
 
-void store_iteration(float pos_x, float pos_y, int iteration, float x, float y)
-{
-    float centered_x = pos_x + 2.5;
-    float centered_y = pos_y + 1.0;
-    float temp_x = floor(centered_x * 1000.0);
-    float temp_y = floor(centered_y * 1000.0);
+    iteration = fractal_escape_float(power, FRACTAL_PERIOD, &x, &y, cx, cy, iteration, max_iteration);
 
-    int trs_pos_x = (int)temp_x;
-    int trs_pos_y = (int)temp_y;
+    cache_keep(&key, max_iteration, x, y, iteration);
 
-    cached_points[trs_pos_x][trs_pos_y] = iteration;
-    cached_x[trs_pos_x][trs_pos_y] = x;
-    cached_y[trs_pos_x][trs_pos_y] = y;
+    return (iteration >= max_iteration) ? 0 : iteration;
 }
-#endif
 
-int mandelbrot_point(int res_x, int res_y, int image_x, int image_y, float zoom, int max_iteration)
+int mandelbrot_point(int res_x, int res_y, int image_x, int image_y, float zoom, int power, int max_iteration)
 {
-    // Get the index of the current element
     float pos_x = map_x_mandelbrot(image_x, res_x, zoom);
     float pos_y = map_y(image_y, res_y, zoom);
-    float x = 0.0;
-    float y = 0.0;
-    float q, x_term, pos_y2;
-    float xtemp, xx, yy, xplusy;
-#ifdef CACHE
-    int storeable = 1;
-#endif
-    int iteration = 0;
 
-    // Period-2 bulb check 
-    x_term = pos_x + 1.0;
-    pos_y2 = pos_y * pos_y;
-    if ((x_term * x_term + pos_y2) < 0.0625) return 0;
+    if (power == 2)
+        return cached_point(FRACTAL_MANDELBROT, 2, pos_x, pos_y, 0.0, 0.0, max_iteration);
+    return cached_point(FRACTAL_MANDELBROT, power, pos_x, pos_y, 0.0, 0.0, max_iteration);
+}
 
-    // Cardioid check
-    x_term = pos_x - 0.25;
-    q = x_term * x_term + pos_y2;
-    q = q * (q + x_term);
-    if (q < (0.25 * pos_y2)) return 0; 
+int julia_point(int res_x, int res_y, int image_x, int image_y, float zoom, int power, int max_iteration)
+{
+    float pos_x = map_x_julia(image_x, res_x, 1.0);
+    float pos_y = map_y(image_y, res_y, 1.0);
 
-#ifdef CACHE
-    // Look up our cache
-    iteration = cached_iteration(pos_x, pos_y);
+    if (power == 2)
+        return cached_point(FRACTAL_JULIA, 2, pos_x, pos_y, 0.353 + zoom, 0.288, max_iteration);
+    return cached_point(FRACTAL_JULIA, power, pos_x, pos_y, 0.353 + zoom, 0.288, max_iteration);
+}
 
-    if (iteration > 0)
+// Mandelbrot zooms reusing the previous frame. The pixels it cannot give
+// are gathered over the whole tile and iterated together as one list.
+void render_reprojected(const frame_args *args, const tile *piece, int *samples)
+{
+    int y, count, stale, total;
+    int stale_x[TILE_SIZE], where[TILE_SIZE * TILE_SIZE], found[TILE_SIZE * TILE_SIZE];
+    float pos_x[TILE_SIZE * TILE_SIZE], pos_y[TILE_SIZE * TILE_SIZE];
+    int *line;
+    escape_job job;
+
+    total = 0;
+    for (y = piece->y; y < piece->y + piece->height; y++)
     {
-        x = get_cached_x(pos_x, pos_y);
-        y = get_cached_y(pos_x, pos_y);
-        yy = y * y;
+        line = &samples[(y - piece->y) * TILE_SIZE];
+        stale = reproject_row(args->reuse, y, piece->x, piece->width, line, stale_x);
+
+        for (count = 0; count < stale; count++)
+        {
+            if (cache != NULL)
+            {
+                line[stale_x[count]] = mandelbrot_point(args->res_x, args->res_y, piece->x + stale_x[count], y, args->zoom,
+                                                        args->power, args->max_iteration);
+                continue;
+            }
+            where[total] = stale_x[count] + (y - piece->y) * TILE_SIZE;
+            pos_x[total] = map_x_mandelbrot(piece->x + stale_x[count], args->res_x, args->zoom);
+            pos_y[total] = map_y(y, args->res_y, args->zoom);
+            total++;
+        }
     }
-    if (iteration < 0) storeable = 0;
-#endif
 
-    while (iteration < max_iteration)
-    {
-        xx = x * x;
-        yy = y * y;
-        xplusy = x + y;
-        if ((xx) + (yy) > (4.0)) break;
-        y = xplusy * xplusy - xx - yy;
-        y = y + pos_y;
-        xtemp = xx - yy + pos_x;
+    if (total == 0)
+        return;
+
+    job.out = found;
+    job.fraction = NULL;
+    job.stride = total;
+    job.pos_x = pos_x;
+    job.width = total;
+    job.pos_y = pos_y;
+    job.height = 1;
+    job.julia_mode = 0;
+    job.julia_x = 0.0;
+    job.julia_y = 0.0;
+    job.power = args->power;
+    job.max_iteration = args->max_iteration;
+    job.paired = 1;
+
+    escape_tile(&job);
+
+    for (count = 0; count < total; count++)
+        samples[where[count]] = found[count];
+}
 
-        x = xtemp;
-        iteration++;
-    }
+// The whole tile through the escape kernel. The mode is decided once per
+// tile and the vector kernel does the rest.
+void render_escape(const frame_args *args, const tile *piece, int *samples, unsigned char *fractions)
+{
+    int x, y;
+    float pos_x[TILE_SIZE], pos_y[TILE_SIZE];
+    escape_job job;
 
-    if (iteration >= max_iteration)
+    for (x = 0; x < piece->width; x++)
     {
-        return 0;
+        if (args->julia_mode == 0)
+            pos_x[x] = map_x_mandelbrot(piece->x + x, args->res_x, args->zoom);
+        else
+            pos_x[x] = map_x_julia(piece->x + x, args->res_x, 1.0);
     }
+    for (y = 0; y < piece->height; y++)
+        pos_y[y] = map_y(args->offset_y + piece->y + y, args->res_y, (args->julia_mode == 0) ? args->zoom : 1.0);
+
+    job.out = samples;
+    job.fraction = fractions;
+    job.stride = TILE_SIZE;
+    job.pos_x = pos_x;
+    job.width = piece->width;
+    job.pos_y = pos_y;
+    job.height = piece->height;
+    job.julia_mode = args->julia_mode;
+    job.julia_x = 0.353 + args->zoom;
+    job.julia_y = 0.288;
+    job.power = args->power;
+    job.max_iteration = args->max_iteration;
+    job.paired = 0;
+
+    if (args->subdivide)
+        subdivide_tile(&job, escape_tile);
     else
-    {
-#ifdef CACHE
-        if (storeable == 1)
-        {
-            store_iteration(pos_x, pos_y, iteration, x, y);
-        }
-#endif
-        return iteration;
-    }
+        escape_tile(&job);
 }
 
-int julia_point(int res_x, int res_y, int image_x, int image_y, float zoom, int max_iteration)
+// Called by the pool workers for every tile they take (or steal), runs
+// the corresponding algorithm over it. The tile is rendered on the stack
+// of the worker and then packed into its own block of the frame.
+void render_tile(void *frame, const tile *piece, int worker)
 {
-    // Get the index of the current element
-    float pos_x = map_x_julia(image_x, res_x, 1.0);
-    float pos_y = map_y(image_y, res_y, 1.0);
-    float x = pos_x;
-    float y = pos_y;
-    float xtemp, xx, yy;
-#ifdef CACHE
-    int storeable = 1;
-#endif
-    int iteration = 0;
+    frame_args *args;
+    args = (frame_args *) frame;
 
-#ifdef CACHE
-    // Look up our cache
-    iteration = cached_iteration(pos_x, pos_y);
+    int x, y;
+    int samples[TILE_SIZE * TILE_SIZE];
+    unsigned char fractions[TILE_SIZE * TILE_SIZE];
 
-    if (iteration > 0)
+    // Smooth frames have neither reuse nor cache, see main
+    if (args->reuse != NULL)
+        render_reprojected(args, piece, samples);
+    else if (cache == NULL)
+        render_escape(args, piece, samples, args->smooth ? fractions : NULL);
+
+    // The cache is looked up pixel by pixel, the mode picked once
+    else if (args->julia_mode == 0)
     {
-        x = get_cached_x(pos_x, pos_y);
-        y = get_cached_y(pos_x, pos_y);
-        yy = y * y;
+        for (y = 0; y < piece->height; y++)
+            for (x = 0; x < piece->width; x++)
+                samples[x + y * TILE_SIZE] = mandelbrot_point(args->res_x, args->res_y, piece->x + x, args->offset_y + piece->y + y, args->zoom,
+                                                              args->power, args->max_iteration);
     }
-    if (iteration < 0) storeable = 0;
-#endif
-
-    while (iteration < max_iteration)
+    else
     {
-        xx = x * x;
-        yy = y * y;
-        if ((xx) + (yy) > (4.0)) break;
-        y = pow((x + y), 2) - xx - yy;
-        y = y + 0.288;
-        xtemp = xx - yy + 0.353 + zoom;
-
-        x = xtemp;
-        iteration++;
+        for (y = 0; y < piece->height; y++)
+            for (x = 0; x < piece->width; x++)
+                samples[x + y * TILE_SIZE] = julia_point(args->res_x, args->res_y, piece->x + x, args->offset_y + piece->y + y, args->zoom,
+                                                         args->power, args->max_iteration);
     }
 
-    if (iteration >= max_iteration)
+    frame_buffer_store(iteration_frame, piece, samples, TILE_SIZE);
+    if (args->smooth)
+        frame_buffer_store_fractions(iteration_frame, piece, fractions, TILE_SIZE);
+
+    // Counted for the equalized palette while the tile is at hand
+    if (args->histogram != NULL)
+        palette_histogram_count(args->histogram, worker, samples, piece->width, piece->height, TILE_SIZE);
+}
+
+// Adaptive antialiasing of a colored tile. Its counts and those of the
+// pixels around it tell the edges, whose extra samples go through the
+// escape kernel as lists of points and are averaged into their pixels.
+void antialias_tile(void *frame, const tile *piece, int worker)
+{
+    frame_args *args = (frame_args *) frame;
+    const antialias *aa = args->aa;
+    int window[(TILE_SIZE + 2) * (TILE_SIZE + 2)], edges[TILE_SIZE * TILE_SIZE], found[ANTIALIAS_BATCH];
+    float pos_x[ANTIALIAS_BATCH], pos_y[ANTIALIAS_BATCH];
+    unsigned char fractions[ANTIALIAS_BATCH];
+    uint32_t colors[ANTIALIAS_BATCH];
+    int left, top, width, height, rows, x, y, number_edges, edge, batch, count, sample, total;
+    float zoom = (args->julia_mode == 0) ? args->zoom : 1.0;
+    float step_x = 3.5 * zoom / args->res_x, step_y = 2.0 * zoom / args->res_y;
+    escape_job job;
+
+    // The tile and a ring of pixels around it, where the frame has them.
+    // A poster strip may go past the bottom of the image.
+    rows = (args->res_y - args->offset_y < iteration_frame->res_y) ? args->res_y - args->offset_y : iteration_frame->res_y;
+    left = (piece->x > 0) ? piece->x - 1 : 0;
+    top = (piece->y > 0) ? piece->y - 1 : 0;
+    width = ((piece->x + piece->width < args->res_x) ? piece->x + piece->width + 1 : args->res_x) - left;
+    height = ((piece->y + piece->height < rows) ? piece->y + piece->height + 1 : rows) - top;
+    for (y = 0; y < height; y++)
     {
-        return 0;
+        for (x = 0; x < width; x++)
+        {
+            if ((y + top < piece->y) || (y + top >= piece->y + piece->height) ||
+                (x + left < piece->x) || (x + left >= piece->x + piece->width))
+                window[x + y * (TILE_SIZE + 2)] = frame_buffer_get(iteration_frame, x + left, y + top);
+        }
     }
-    else
+    frame_buffer_load(iteration_frame, piece, &window[(piece->x - left) + (piece->y - top) * (TILE_SIZE + 2)], TILE_SIZE + 2);
+
+    number_edges = 0;
+    for (y = piece->y; y < piece->y + piece->height; y++)
+        for (x = piece->x; x < piece->x + piece->width; x++)
+            if (antialias_edge(aa, window, TILE_SIZE + 2, width, height, x - left, y - top))
+                edges[number_edges++] = x + y * args->res_x;
+
+    antialias_count(args->aa, worker, piece->width * piece->height, number_edges);
+
+    job.out = found;
+    job.fraction = args->smooth ? fractions : NULL;
+    job.pos_x = pos_x;
+    job.pos_y = pos_y;
+    job.height = 1;
+    job.julia_mode = args->julia_mode;
+    job.julia_x = 0.353 + args->zoom;
+    job.julia_y = 0.288;
+    job.power = args->power;
+    job.max_iteration = args->max_iteration;
+    job.paired = 1;
+
+    // As many whole pixels as a batch holds
+    batch = ANTIALIAS_BATCH / aa->samples;
+    for (edge = 0; edge < number_edges; edge += batch)
     {
-#ifdef CACHE
-        if (storeable == 1)
+        count = (number_edges - edge < batch) ? number_edges - edge : batch;
+        total = 0;
+        for (x = edge; x < edge + count; x++)
         {
-            store_iteration(pos_x, pos_y, iteration, x, y);
+            for (sample = 0; sample < aa->samples; sample++)
+            {
+                if (args->julia_mode == 0)
+                    pos_x[total] = map_x_mandelbrot(edges[x] % args->res_x, args->res_x, args->zoom);
+                else
+                    pos_x[total] = map_x_julia(edges[x] % args->res_x, args->res_x, 1.0);
+                pos_x[total] += aa->offsets[sample % aa->side] * step_x;
+                pos_y[total] = map_y(args->offset_y + edges[x] / args->res_x, args->res_y, zoom) + aa->offsets[sample / aa->side] * step_y;
+                total++;
+            }
         }
-#endif
-        return iteration;
+
+        job.stride = total;
+        job.width = total;
+        escape_tile(&job);
+
+        if (args->smooth)
+            palette_apply_smooth(args->lut, found, fractions, colors, total);
+        else
+            palette_apply(args->lut, found, colors, total);
+        for (x = 0; x < count; x++)
+            args->argb[edges[edge + x]] = antialias_average(&colors[x * aa->samples], aa->samples);
     }
 }
 
-// Splits the image in pieces and calls the corresponding algorithm
-void *thread_launcher(void *arguments)
+// Deep frames come from perturbation as row-major ints, they are packed
+// into the tiles and counted the same way
+void import_tile(void *frame, const tile *piece, int worker)
+{
+    frame_args *args = (frame_args *) frame;
+    const int *samples = &args->deep_pixels[piece->x + piece->y * args->res_x];
+
+    frame_buffer_store(iteration_frame, piece, samples, args->res_x);
+    if (args->histogram != NULL)
+        palette_histogram_count(args->histogram, worker, samples, piece->width, piece->height, args->res_x);
+}
+
+// The tiles of a poster strip, those of the last one stop at the bottom
+// of the image
+int poster_clip(const frame_args *args, const tile *piece, tile *clipped)
 {
-    piece_args *args;
-    args = (piece_args *) arguments;
+    *clipped = *piece;
+    if (args->offset_y + clipped->y + clipped->height > args->res_y)
+        clipped->height = args->res_y - args->offset_y - clipped->y;
 
-    int x,y, small_res_x, small_res_y, init_x, init_y, limit_x, limit_y;
-    int split, piece_x, piece_y;
+    return clipped->height > 0;
+}
+
+void poster_render_tile(void *frame, const tile *piece, int worker)
+{
+    tile clipped;
+
+    if (poster_clip((const frame_args *) frame, piece, &clipped))
+        render_tile(frame, &clipped, worker);
+}
+
+void poster_antialias_tile(void *frame, const tile *piece, int worker)
+{
+    tile clipped;
+
+    if (poster_clip((const frame_args *) frame, piece, &clipped))
+        antialias_tile(frame, &clipped, worker);
+}
 
-    if(args->total_threads > 2)
+// One view far larger than memory, rendered into a PPM a strip of tile
+// rows at a time. The strip counts, its colors and the writer buffers
+// take at most memory_megabytes. The pool renders and colors a strip
+// while the writer thread saves the ones before it, the renderer only
+// waits when POSTER_BUFFERS strips are ahead of the disk. The frame
+// describes the view, the cap follows its depth alone: equalizing or
+// adapting it would need the whole image first. Antialiasing does not
+// see across the seams between strips.
+int render_poster(const char *path, frame_args *frame, int number_threads, int memory_megabytes, int scheme,
+                  int fixed_iterations, int minimum_depth, int budget)
+{
+    palette lut = { NULL, 0, 0, 0 };
+    frame_buffer strip;
+    tile_queue queue;
+    worker_pool pool;
+    iter_control control;
+    antialias aa;
+    poster_writer poster;
+    uint32_t *argb;
+    size_t row_bytes;
+    long strip_rows, limit;
+    int max_iteration, strip_y, rows, shown = 0, result;
+    double start;
+
+    // Per row of a strip: samples at their widest, fractions, writer buffers
+    row_bytes = (size_t) frame->res_x * (sizeof(int32_t) + frame->smooth) + poster_row_bytes(frame->res_x);
+    strip_rows = (long) (((size_t) memory_megabytes << 20) / row_bytes) / TILE_SIZE * TILE_SIZE;
+    if (strip_rows < TILE_SIZE)
     {
-        split = sqrt(args->total_threads);
+        printf("%d MB do not hold a row of tiles, strips of %d rows\n", memory_megabytes, TILE_SIZE);
+        strip_rows = TILE_SIZE;
     }
-    else if (args->total_threads == 2)
+
+    // No taller than the image, with pixel indexes of a strip in an int
+    limit = (frame->res_y + TILE_SIZE - 1) / TILE_SIZE * TILE_SIZE;
+    if (strip_rows > limit)
+        strip_rows = limit;
+    limit = (long) (INT_MAX / frame->res_x) / TILE_SIZE * TILE_SIZE;
+    if (strip_rows > limit)
+        strip_rows = limit;
+
+    if (fixed_iterations > 0)
     {
-        split = 2;
+        if (iter_control_init(&control, fixed_iterations, fixed_iterations, number_threads) != 0)
+            return 2;
     }
-    else
+    else if (iter_control_init(&control, ITER_CONTROL_MINIMUM, ITER_CONTROL_MAXIMUM, number_threads) != 0)
+        return 2;
+    max_iteration = iter_control_scale(&control, frame->julia_mode ? 0.0 : -log10(frame->zoom));
+    frame->max_iteration = max_iteration;
+
+    frame_buffer_init(&strip, frame->res_x, strip_rows, minimum_depth, frame->smooth);
+    if (frame_buffer_prepare(&strip, max_iteration) != 0)
+        return 2;
+    iteration_frame = &strip;
+
+    if (tile_queue_init(&queue, frame->res_x, strip_rows, TILE_SIZE, number_threads) != 0)
+        return 2;
+    if (worker_pool_init(&pool, number_threads, &queue) != 0)
+        return 2;
+    if (palette_build(&lut, scheme, max_iteration, 0) != 0)
+        return 2;
+
+    frame->aa = NULL;
+    if (budget > 0)
     {
-        split = 1;
+        if (antialias_init(&aa, budget, frame->smooth ? 2 : 1, number_threads) != 0)
+            return 2;
+        frame->aa = &aa;
+        frame->lut = &lut;
+        printf("Adaptive antialiasing, up to %d samples per pixel\n", aa.samples);
     }
 
-    if (args->thread_number > 0)
+    result = poster_open(&poster, path, frame->res_x, frame->res_y, strip_rows);
+    if (result != 0)
+        return result;
+
+    printf("Poster of %dx%d in strips of %ld rows, max_iteration %d\n", frame->res_x, frame->res_y, strip_rows, max_iteration);
+
+    start = wall_clock_seconds();
+    for (strip_y = 0; strip_y < frame->res_y; strip_y += strip_rows)
     {
-        piece_x = args->thread_number % split;
-        piece_y = floor((float)args->thread_number / (float)split);
+        rows = (frame->res_y - strip_y < strip_rows) ? frame->res_y - strip_y : strip_rows;
+
+        // The counts first, the writer may still be busy meanwhile
+        frame->offset_y = strip_y;
+        worker_pool_render(&pool, poster_render_tile, (void *) frame);
+
+        argb = poster_strip(&poster);
+        if (argb == NULL)
+            break;
+        palette_apply_frame(&lut, &strip, argb, &pool);
+        if (frame->aa != NULL)
+        {
+            frame->argb = argb;
+            worker_pool_render(&pool, poster_antialias_tile, (void *) frame);
+        }
+        poster_submit(&poster, rows);
+
+        if ((long) (strip_y + rows) * 10 / frame->res_y > shown)
+        {
+            shown = (long) (strip_y + rows) * 10 / frame->res_y;
+            printf("%d%% of the rows rendered\n", shown * 10);
+        }
     }
-    else
+
+    result = poster_close(&poster);
+    printf("Time elapsed %0.5f seconds\n", wall_clock_seconds() - start);
+    poster_report(&poster, stdout);
+
+    if (cache != NULL)
     {
-        piece_x = 0;
-        piece_y = 0;
+        unsigned long hits, misses;
+        orbit_cache_stats(cache, &hits, &misses);
+        printf("Orbit cache: %lu hits, %lu misses\n", hits, misses);
     }
 
-    small_res_x = floor((float)args->res_x / (float)split);
-    small_res_y = floor((float)args->res_y / (float)split);
-    init_x = small_res_x * piece_x;
-    init_y = small_res_y * piece_y;
-    limit_x = init_x + small_res_x;
-    limit_y = init_y + small_res_y;
-
-    for (y = init_y; y < limit_y; y++)
+    if (frame->aa != NULL)
     {
-        for (x = init_x; x < limit_x; x++)
-        {
-            if(args->julia_mode == 0)
-                iteration_pixels[x + (y * args->res_x)] = mandelbrot_point(args->res_x, args->res_y, x, y, args->zoom, args->max_iteration);
-            else
-                iteration_pixels[x + (y * args->res_x)] = julia_point(args->res_x, args->res_y, x, y, args->zoom, args->max_iteration);
-        }
+        antialias_report(&aa, stdout);
+        antialias_release(&aa);
     }
+
+    palette_release(&lut);
+    iter_control_release(&control);
+    worker_pool_release(&pool);
+    tile_queue_release(&queue);
+    frame_buffer_release(&strip);
+    if (cache != NULL)
+        orbit_cache_release(cache);
+
+    return result;
 }
 
 
@@ -312,237 +596,693 @@ int get_cpus()
 
 int main(int argn, char **argv) 
 {
-    // Init SDL
-    if(SDL_Init(SDL_INIT_VIDEO) != 0)
-        fprintf(stderr, "Could not initialize SDL2: %s\n", SDL_GetError());
-
-    printf("SDL Initialized\n");
-
-    // Create screen texture
-    SDL_Surface *screen, *message;
+    SDL_Surface *screen = NULL, *message;
+    SDL_Window *window = NULL;
+    SDL_Renderer *renderer = NULL;
+    SDL_Texture *texture_screen = NULL;
+    TTF_Font *font = NULL;
     int res_x = 800;
     int res_y = 600;
     int julia_mode = 0;
-
-    if(argn == 1)
-    {
-        julia_mode = 0;
-    } 
-    else if ((argn == 2) && (strcmp(argv[1], "-julia") == 0))
+    int deep_mode = 0;
+    int power = 2;
+    const char *center_x = DEEP_CENTER_X;
+    const char *center_y = DEEP_CENTER_Y;
+    int fixed_iterations = 0;
+    const char *stop_text = NULL;
+    int number_cores = get_cpus();
+    int number_threads = number_cores;
+    const char *isa = NULL;
+    const char *isa_name;
+    const char *output = NULL;
+    const char *view_text = NULL;
+    image_writer writer;
+    uint32_t *frame_pixels;
+    palette lut = { NULL, 0, 0, 0 };
+    int scheme = PALETTE_CLASSIC;
+    int cache_megabytes = 0;
+    int reproject_refresh = 0;
+    int subdivide = 0;
+    int verify = 0;
+    int smooth = 0;
+    int equalize = 0;
+    int budget = 0;
+    const char *poster = NULL;
+    int memory_megabytes = POSTER_MEMORY;
+    frame_buffer *brute_frame = NULL;
+    int depth = 0;
+    unsigned long verified = 0, mismatched = 0;
+    int arg;
+
+    for (arg = 1; arg < argn; arg++)
     {
-        julia_mode = 1;
-        printf("Julia mode activated.\n");
+        if (strcmp(argv[arg], "-julia") == 0)
+        {
+            julia_mode = 1;
+        }
+        else if ((strcmp(argv[arg], "-threads") == 0) && (arg + 1 < argn))
+        {
+            number_threads = atoi(argv[++arg]);
+            if (number_threads < 1)
+                number_threads = number_cores;
+        }
+        else if ((strcmp(argv[arg], "-isa") == 0) && (arg + 1 < argn))
+        {
+            isa = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "-deep") == 0)
+        {
+            deep_mode = 1;
+        }
+        else if ((strcmp(argv[arg], "-power") == 0) && (arg + 1 < argn) &&
+                 ((power = atoi(argv[arg + 1])) >= 2) && (power <= FRACTAL_MAX_POWER))
+        {
+            arg++;
+        }
+        else if ((strcmp(argv[arg], "-center") == 0) && (arg + 2 < argn))
+        {
+            center_x = argv[++arg];
+            center_y = argv[++arg];
+        }
+        else if ((strcmp(argv[arg], "-iterations") == 0) && (arg + 1 < argn))
+        {
+            fixed_iterations = atoi(argv[++arg]);
+        }
+        else if ((strcmp(argv[arg], "-depth") == 0) && (arg + 1 < argn) &&
+                 (((depth = atoi(argv[arg + 1])) == 8) || (depth == 16) || (depth == 32)))
+        {
+            arg++;
+        }
+        else if ((strcmp(argv[arg], "-stop") == 0) && (arg + 1 < argn))
+        {
+            stop_text = argv[++arg];
+        }
+        else if ((strcmp(argv[arg], "-headless") == 0) && (arg + 1 < argn) && image_pattern_valid(argv[arg + 1]))
+        {
+            output = argv[++arg];
+        }
+        else if ((strcmp(argv[arg], "-view") == 0) && (arg + 1 < argn))
+        {
+            view_text = argv[++arg];
+        }
+        else if ((strcmp(argv[arg], "-palette") == 0) && (arg + 1 < argn) &&
+                 ((scheme = palette_find(argv[arg + 1])) >= 0))
+        {
+            arg++;
+        }
+        else if ((strcmp(argv[arg], "-cache") == 0) && (arg + 1 < argn))
+        {
+            cache_megabytes = atoi(argv[++arg]);
+        }
+        else if ((strcmp(argv[arg], "-reproject") == 0) && (arg + 1 < argn))
+        {
+            reproject_refresh = atoi(argv[++arg]);
+        }
+        else if (strcmp(argv[arg], "-subdivide") == 0)
+        {
+            subdivide = 1;
+        }
+        else if (strcmp(argv[arg], "-verify") == 0)
+        {
+            verify = 1;
+        }
+        else if (strcmp(argv[arg], "-smooth") == 0)
+        {
+            smooth = 1;
+        }
+        else if (strcmp(argv[arg], "-equalize") == 0)
+        {
+            equalize = 1;
+        }
+        else if ((strcmp(argv[arg], "-antialias") == 0) && (arg + 1 < argn) &&
+                 ((budget = atoi(argv[arg + 1])) >= ANTIALIAS_MIN_SIDE * ANTIALIAS_MIN_SIDE))
+        {
+            arg++;
+        }
+        else if ((strcmp(argv[arg], "-poster") == 0) && (arg + 1 < argn))
+        {
+            poster = argv[++arg];
+        }
+        else if ((strcmp(argv[arg], "-memory") == 0) && (arg + 1 < argn) &&
+                 ((memory_megabytes = atoi(argv[arg + 1])) > 0))
+        {
+            arg++;
+        }
+        else if ((strcmp(argv[arg], "-size") == 0) && (arg + 1 < argn) &&
+                 (sscanf(argv[arg + 1], "%dx%d", &res_x, &res_y) == 2) && (res_x > 0) && (res_y > 0))
+        {
+            arg++;
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [-julia] [-power 2..%d] [-threads N] [-isa scalar|sse2|avx2|avx512]\n"
+                            "       [-deep [-center X Y] [-stop ZOOM]] [-iterations N] [-depth 8|16|32]\n"
+                            "       [-headless file_%%05d.ppm|file_%%05d.png|file.y4m|-] [-view ZOOM] [-size WxH]\n"
+                            "       [-palette classic|fire|ocean|gray] [-smooth] [-equalize] [-cache MB] [-reproject K]\n"
+                            "       [-subdivide [-verify]] [-antialias SAMPLES] [-poster file.ppm [-memory MB]]\n",
+                    argv[0], FRACTAL_MAX_POWER);
+            return 1;
+        }
     }
 
-    int number_cores = get_cpus();
-    int number_threads = number_cores * number_cores;
+    // Headless renders never touch SDL, frames go to files or stdout.
+    // Opened before any printf, the Y4M stream on stdout moves them to stderr.
+    if ((output != NULL) && (image_writer_open(&writer, output, res_x, res_y) != 0))
+        return 1;
 
     printf("Number of CPUs/cores autodetected: %d\n", number_cores);
+    if (julia_mode)
+        printf("Julia mode activated.\n");
+    if (deep_mode)
+        printf("Deep zoom mode activated.\n");
 
-#ifdef CACHE
-    // Init our cached points
-    cached_points = malloc(res_y * 1000 * sizeof(int *));
-    cached_x = malloc(res_y * 1000 * sizeof(float *));
-    cached_y = malloc(res_y * 1000 * sizeof(float *));
-    if (cached_points == NULL)
+    if (deep_mode && julia_mode)
     {
-        fprintf(stderr, "Bad luck, out of memory\n");
-        return 2;
+        fprintf(stderr, "Deep zoom is only available for the Mandelbrot set\n");
+        return 1;
     }
 
-    int count;
-    for (count = 0; count < res_y * 1000; count++)
+    // Perturbation and -headless work on whole frames
+    if ((poster != NULL) && (deep_mode || (output != NULL)))
     {
-        cached_points[count] = malloc(res_x * 1000 * sizeof(int));
-        if(cached_points[count] == NULL)
+        fprintf(stderr, "Posters are a single view of their own, without -deep or -headless\n");
+        return 1;
+    }
+
+    // z^power + c, the vector kernels only do squares
+    if (power != 2)
+    {
+        if (deep_mode)
         {
-            fprintf(stderr, "Bad luck, out of memory\n");
-            return 2;
+            fprintf(stderr, "Deep zoom only follows z^2 + c\n");
+            return 1;
         }
-        cached_x[count] = malloc(res_x * 1000 * sizeof(float));
-        cached_y[count] = malloc(res_x * 1000 * sizeof(float));
-        /*for (count2 = 0; count2 < res_x * 100; count2++)
+        printf("Power %d, scalar escape loop\n", power);
+    }
+
+    // Normalized counts come from where the escape kernels leave the
+    // orbits, the orbit cache and the reprojected pixels do not have it
+    if (smooth)
+    {
+        if (deep_mode)
+        {
+            printf("Smooth counts are not made by deep zooms, ignored\n");
+            smooth = 0;
+        }
+        else
         {
-            cached_points[count][count2] = -1;
-        }*/
+            if (cache_megabytes > 0)
+                printf("Smooth counts leave out the orbit cache\n");
+            if (reproject_refresh > 0)
+                printf("Smooth counts leave out reprojection\n");
+            cache_megabytes = 0;
+            reproject_refresh = 0;
+            printf("Smooth escape values\n");
+        }
     }
 
-    printf("Cache ready\n");
-#endif
+    printf("Using %d worker threads\n", number_threads);
 
-    // screen = SDL_SetVideoMode(res_x, res_y, 0, SDL_HWSURFACE|SDL_DOUBLEBUF);
-    // screen = SDL_SetVideoMode(res_x, res_y, 0, SDL_DOUBLEBUF);
-    SDL_Window *window = SDL_CreateWindow("MandelClassic",
-                                           SDL_WINDOWPOS_UNDEFINED,
-                                           SDL_WINDOWPOS_UNDEFINED,
-                                           res_x, res_y, 0);
+    escape_tile = escape_kernel_select(isa, &isa_name);
+    printf("Escape kernel: %s\n", isa_name);
 
-    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, 0);
+    // Orbits of already computed points, only worth it when views repeat
+    // (palette or iteration changes, the same zoom played again)
+    orbit_cache orbits;
+    if (cache_megabytes > 0)
+    {
+        if (orbit_cache_init(&orbits, (size_t) cache_megabytes << 20) != 0)
+            return 2;
+        cache = &orbits;
+        printf("Orbit cache of %d MB\n", cache_megabytes);
+    }
 
-    if ((!window) || (!renderer))
-	    fprintf(stderr,"Could not set video mode: %s\n",SDL_GetError());
+    // Posters never hold the whole image, they have a loop of their own
+    if (poster != NULL)
+    {
+        if (equalize)
+            printf("Equalized palettes need the whole image, ignored\n");
+        if (reproject_refresh > 0)
+            printf("Reprojection only follows zooms, ignored\n");
+
+        frame_args view;
+        view.res_x = res_x;
+        view.res_y = res_y;
+        view.zoom = (view_text != NULL) ? atof(view_text) : 1.0;
+        view.julia_mode = julia_mode;
+        view.power = power;
+        view.subdivide = subdivide;
+        view.smooth = smooth;
+        view.reuse = NULL;
+        view.histogram = NULL;
+        view.deep_pixels = NULL;
+        view.offset_y = 0;
+        return render_poster(poster, &view, number_threads, memory_megabytes, scheme, fixed_iterations, depth / 8, budget);
+    }
+
+    if (output == NULL)
+    {
+        // Init SDL
+        if(SDL_Init(SDL_INIT_VIDEO) != 0)
+            fprintf(stderr, "Could not initialize SDL2: %s\n", SDL_GetError());
 
-    // Blank the window
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderClear(renderer);
-    SDL_RenderPresent(renderer);
+        printf("SDL Initialized\n");
 
-    SDL_Texture *texture_screen = SDL_CreateTexture(renderer,
-                                                   SDL_PIXELFORMAT_ARGB8888,
-                                                   SDL_TEXTUREACCESS_STREAMING,
-                                                   res_x, res_y);
+        // screen = SDL_SetVideoMode(res_x, res_y, 0, SDL_HWSURFACE|SDL_DOUBLEBUF);
+        // screen = SDL_SetVideoMode(res_x, res_y, 0, SDL_DOUBLEBUF);
+        window = SDL_CreateWindow("MandelClassic",
+                                  SDL_WINDOWPOS_UNDEFINED,
+                                  SDL_WINDOWPOS_UNDEFINED,
+                                  res_x, res_y, 0);
 
-    screen = SDL_CreateRGBSurface(0, res_x, res_y , 32, 0, 0, 0, 0);
+        renderer = SDL_CreateRenderer(window, -1, 0);
 
-    //Initialize SDL_ttf
-    if( TTF_Init() == -1 )
-    { 
-        printf("Error setting up TTF module.\n");
-        return 1; 
-    }
+        if ((!window) || (!renderer))
+            fprintf(stderr,"Could not set video mode: %s\n",SDL_GetError());
 
-    // Load a font
-    TTF_Font *font;
-    font = TTF_OpenFont("font.ttf", 24);
-    if (font == NULL)
+        // Blank the window
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+        SDL_RenderClear(renderer);
+        SDL_RenderPresent(renderer);
+
+        texture_screen = SDL_CreateTexture(renderer,
+                                           SDL_PIXELFORMAT_ARGB8888,
+                                           SDL_TEXTUREACCESS_STREAMING,
+                                           res_x, res_y);
+
+        screen = SDL_CreateRGBSurface(0, res_x, res_y , 32, 0, 0, 0, 0);
+
+        //Initialize SDL_ttf
+        if( TTF_Init() == -1 )
+        { 
+            printf("Error setting up TTF module.\n");
+            return 1; 
+        }
+
+        // Load a font
+        font = TTF_OpenFont("font.ttf", 24);
+        if (font == NULL)
+        {
+            printf("TTF_OpenFont() Failed: %s", TTF_GetError());
+            SDL_Quit();
+            return 1;
+        }
+
+        // A 32 bit surface has no padding, we colorize straight into it
+        frame_pixels = (uint32_t *) screen->pixels;
+    }
+    else
     {
-        printf("TTF_OpenFont() Failed: %s", TTF_GetError());
-        SDL_Quit();
-        return 1;
+        frame_pixels = malloc(res_x * res_y * sizeof(uint32_t));
+        if (frame_pixels == NULL)
+        {
+            fprintf(stderr, "Bad luck, out of memory\n");
+            return 2;
+        }
     }
 
     //The color of the font 
     SDL_Color textColor = { 255, 255, 255 };    
 
-    // Prepare the resolution and sizes and colors, threads...
-    iteration_pixels = malloc(res_x * res_y * sizeof(int));
-    pthread_t threads[number_threads];
-    piece_args arguments[number_threads];
+    // Prepare the resolution and sizes and colors, threads... The counts
+    // take the fewest bits that hold the cap unless -depth asks for more.
+    frame_buffer iterations, brute;
+    int *deep_pixels = NULL;
+    frame_buffer_init(&iterations, res_x, res_y, depth / 8, smooth);
+    iteration_frame = &iterations;
+    frame_args frame;
+    deep_frame deep;
+    tile_queue queue;
+    worker_pool pool;
+    reproject reuse;
+    reproject_view view;
+    int reprojecting = 0;
+    iter_control control;
+    palette_histogram histogram;
+    antialias aa;
+    int max_iteration, shown_iteration = 0, frame_number = 0;
+
+    if (tile_queue_init(&queue, res_x, res_y, TILE_SIZE, number_threads) != 0)
+        return 2;
+
+    if (worker_pool_init(&pool, number_threads, &queue) != 0)
+        return 2;
+
+    // Edge pixels take up to budget samples once colored. Smooth counts
+    // step by one across every band, only steeper changes are edges.
+    frame.aa = NULL;
+    if (budget > 0)
+    {
+        if (deep_mode)
+            printf("Antialiasing does not apply to deep zooms, ignored\n");
+        else
+        {
+            if (antialias_init(&aa, budget, smooth ? 2 : 1, number_threads) != 0)
+                return 2;
+            frame.aa = &aa;
+            frame.lut = &lut;
+            frame.argb = frame_pixels;
+            printf("Adaptive antialiasing, up to %d samples per pixel\n", aa.samples);
+        }
+    }
+
+    // Equalized colors, counted by the workers as they render
+    palette_histogram_init(&histogram, number_threads);
+    frame.histogram = NULL;
+    if (equalize)
+    {
+        frame.histogram = &histogram;
+        printf("Histogram equalized palette\n");
+    }
+
+    // max_iteration follows the depth and the escapes of the last frame,
+    // unless -iterations fixes it
+    if (fixed_iterations > 0)
+    {
+        if (iter_control_init(&control, fixed_iterations, fixed_iterations, number_threads) != 0)
+            return 2;
+    }
+    else if (iter_control_init(&control, ITER_CONTROL_MINIMUM, ITER_CONTROL_MAXIMUM, number_threads) != 0)
+        return 2;
+
+    if (deep_mode)
+    {
+        // Perturbation looks at the whole frame for glitches, it keeps
+        // row-major counts
+        deep_pixels = malloc(res_x * res_y * sizeof(int));
+        if (deep_pixels == NULL)
+        {
+            fprintf(stderr, "Bad luck, out of memory\n");
+            return 2;
+        }
+        perturbation_init(&deep, res_x, res_y, deep_pixels);
+        if ((bigfix_parse(&deep.center_x, center_x, BIGFIX_MAX_LIMBS) != 0) ||
+            (bigfix_parse(&deep.center_y, center_y, BIGFIX_MAX_LIMBS) != 0))
+        {
+            fprintf(stderr, "Bad center coordinates: %s %s\n", center_x, center_y);
+            return 1;
+        }
+    }
+
+    // Zoom animations take what they can from the previous frame, with
+    // everything computed again every reproject_refresh frames
+    if (reproject_refresh > 0)
+    {
+        if (julia_mode || deep_mode)
+            printf("Reprojection only follows Mandelbrot zooms, ignored\n");
+        else
+        {
+            if (reproject_init(&reuse, res_x, res_y, reproject_refresh) != 0)
+                return 2;
+            reprojecting = 1;
+            printf("Reprojecting frames, full recompute every %d\n", reproject_refresh);
+        }
+    }
+
+    // Mariani-Silver fills the tiles, -verify renders every frame again
+    // pixel by pixel and counts the differences
+    if (subdivide)
+    {
+        if (deep_mode)
+            printf("Subdivision does not apply to deep zooms, ignored\n");
+        else
+            printf("Rectangle subdivision activated\n");
+    }
+    if (subdivide && verify && !deep_mode)
+    {
+        frame_buffer_init(&brute, res_x, res_y, depth / 8, smooth);
+        brute_frame = &brute;
+    }
 
     printf("Rendering...\n");
 
-    float zoom = 1.0;
-    float stop_point;
+    double zoom = 1.0;
+    double stop_point;
+    floatexp deep_stop;
 
     if (julia_mode == 0)
         stop_point = 0.00001;
     else
         stop_point = -2.5;
 
+    if (stop_text != NULL)
+        stop_point = atof(stop_text);
+
+    // Deep zooms keep their scale in floatexp, it can go below 1e-308
+    if (deep_mode)
+    {
+        deep.zoom = floatexp_from_double(1.0);
+        deep_stop = floatexp_parse((stop_text != NULL) ? stop_text : "1e-100");
+    }
+
+    // A single view is one frame at the given zoom (the c offset for Julia)
+    if (view_text != NULL)
+    {
+        zoom = atof(view_text);
+        if (deep_mode)
+            deep.zoom = floatexp_parse(view_text);
+    }
+
+    char msg[100] = "";
+
     // We measure the time to do the zooming
-    clock_t start = clock();
+    double start = wall_clock_seconds();
 
-    while(zoom > stop_point)
+    while((view_text != NULL) || (deep_mode ? (floatexp_compare(deep.zoom, deep_stop) > 0) : (zoom > stop_point)))
     {
-        int iteration, max_iteration, x, y, res;
-        if((zoom < -0.02) && (zoom > -1.0))
-        {
-            max_iteration = 100;
-        }
+        // Julia frames all show the whole plane, their depth is 0
+        if (deep_mode)
+            max_iteration = iter_control_scale(&control, -floatexp_log2(deep.zoom) * log10(2.0));
         else
+            max_iteration = iter_control_scale(&control, julia_mode ? 0.0 : -log10(zoom));
+
+        // Headless runs log the cap of every frame, on screen only changes
+        if ((output != NULL) || (max_iteration != shown_iteration))
         {
-            max_iteration = 170;
+            printf("Frame %d: max_iteration %d\n", frame_number, max_iteration);
+            shown_iteration = max_iteration;
         }
+        frame_number++;
 
-        int thread_count;
+        if (frame_buffer_prepare(iteration_frame, max_iteration) != 0)
+            return 2;
+        if (equalize && (palette_histogram_reset(&histogram, max_iteration) != 0))
+            return 2;
 
-        for(thread_count = 0; thread_count < number_threads; thread_count++)
+        if (deep_mode)
         {
-            arguments[thread_count].res_x = res_x;
-            arguments[thread_count].res_y = res_y;
-            arguments[thread_count].zoom = zoom;
-            arguments[thread_count].max_iteration = max_iteration;
-            arguments[thread_count].total_threads = number_threads;
-            arguments[thread_count].thread_number = thread_count;
-            arguments[thread_count].julia_mode = julia_mode;
-            pthread_create( &threads[thread_count], NULL, thread_launcher, (void*) &arguments[thread_count]);
+            // Perturbation against a high precision reference orbit
+            deep.max_iteration = max_iteration;
+            perturbation_render(&deep, &pool);
+            frame.res_x = res_x;
+            frame.deep_pixels = deep_pixels;
+            worker_pool_render(&pool, import_tile, (void *) &frame);
         }
-
-        for(thread_count = 0; thread_count < number_threads; thread_count++)
+        else
         {
-            res = pthread_join(threads[thread_count], NULL);
-            if (res != 0)
+            frame.res_x = res_x;
+            frame.res_y = res_y;
+            frame.zoom = zoom;
+            frame.max_iteration = max_iteration;
+            frame.julia_mode = julia_mode;
+            frame.power = power;
+            frame.subdivide = subdivide;
+            frame.smooth = smooth;
+            frame.reuse = NULL;
+            frame.offset_y = 0;
+
+            if (reprojecting)
             {
-                printf("Error in %d thread\n", thread_count);
+                // The same mapping as map_x_mandelbrot and map_y
+                view.origin_x = -(2.5 - (1.0 - frame.zoom));
+                view.origin_y = -(1.00001 - (1.0 - frame.zoom));
+                view.step_x = 3.5 * frame.zoom / res_x;
+                view.step_y = 2.0 * frame.zoom / res_y;
+                reproject_begin(&reuse, &view, max_iteration);
+                frame.reuse = &reuse;
             }
-        }
 
-        int rank;
-        Uint32 *pixel;
-        rank = screen->pitch/sizeof(Uint32);
-        pixel = (Uint32*)screen->pixels;
+            worker_pool_render(&pool, render_tile, (void *) &frame);
 
-        for(y = 0; y < res_y ; y++)
-        {
-            for(x = 0; x < res_x; x++)
+            if (reprojecting)
+                reproject_end(&reuse, iteration_frame, &pool);
+
+            if (brute_frame != NULL)
             {
-                iteration = iteration_pixels[x + y * res_x];
-                if ((iteration < 128) && (iteration > 0)) {
-                    pixel[x + y * rank] = SDL_MapRGBA(screen->format,
-                                                       0,
-                                                       20 + iteration,
-                                                       0,
-                                                       255);
-                }
-                else if ((iteration >= 128) && (iteration < max_iteration))
-                {
-                    pixel[x + y * rank] = SDL_MapRGBA(screen->format,
-                                                       iteration,
-                                                       148,
-                                                       iteration,
-                                                       255);
-                }
-                else
-                {
-                    pixel[x + y * rank] = SDL_MapRGBA(screen->format,
-                                                       0,
-                                                       0,
-                                                       0,
-                                                       255);
-                } 
+                if (frame_buffer_prepare(brute_frame, max_iteration) != 0)
+                    return 2;
+                iteration_frame = brute_frame;
+                frame.subdivide = 0;
+                frame.reuse = NULL;
+                frame.histogram = NULL;
+                worker_pool_render(&pool, render_tile, (void *) &frame);
+                iteration_frame = &iterations;
+                frame.histogram = equalize ? &histogram : NULL;
+
+                mismatched += frame_buffer_differences(&iterations, brute_frame);
+                verified += res_x * res_y;
             }
         }
 
-        if(julia_mode == 0)
+        iter_control_update_frame(&control, iteration_frame, max_iteration, &pool);
+
+        // The iterations stay in iteration_frame, a palette change only
+        // needs this pass again
+        if (lut.max_iteration != max_iteration)
+        {
+            if (palette_build(&lut, scheme, max_iteration, 0) != 0)
+                return 2;
+        }
+        if (equalize)
+            palette_equalize(&lut, &histogram);
+        palette_apply_frame(&lut, iteration_frame, frame_pixels, &pool);
+        if (frame.aa != NULL)
+            worker_pool_render(&pool, antialias_tile, (void *) &frame);
+
+        if (output != NULL)
+        {
+            if (image_writer_frame(&writer, frame_pixels) != 0)
+                return 1;
+            if (view_text != NULL)
+                break;
+        }
+
+        if (deep_mode)
+            deep.zoom = floatexp_mul_double(deep.zoom, 0.9);
+        else if(julia_mode == 0)
             zoom = zoom * 0.99;
         else
             zoom -= 0.01; 
 
+        if (output != NULL)
+            continue;
+
         // Draw message on a corner...
-        char* msg = (char *)malloc(100 * sizeof(char));
-        sprintf(msg, "Zoom level: %0.3f", zoom * 100.0);
+        if (deep_mode)
+        {
+            double decimal = floatexp_log2(deep.zoom) * log10(2.0) + 2.0;
+            sprintf(msg, "Zoom level: %0.3fe%d  Iterations: %d", pow(10.0, decimal - floor(decimal)), (int) floor(decimal), max_iteration);
+        }
+        else
+            sprintf(msg, "Zoom level: %0.3f  Iterations: %d", zoom * 100.0, max_iteration);
         message = TTF_RenderText_Solid( font, msg, textColor );
-        free(msg);
         if (message != NULL)
             SDL_BlitSurface(message, NULL, screen, NULL);
 
-        free(message);
+        SDL_FreeSurface(message);
 
-        SDL_UpdateTexture(texture_screen, NULL, (Uint32*)screen->pixels, 800 * sizeof (Uint32));
+        SDL_UpdateTexture(texture_screen, NULL, (Uint32*)screen->pixels, res_x * sizeof (Uint32));
         SDL_RenderClear(renderer);
         SDL_RenderCopy(renderer, texture_screen, NULL, NULL);
         SDL_RenderPresent(renderer);
 
         // SDL_Flip(screen);
+
+        if (view_text != NULL)
+            break;
+    }
+
+    printf("Time elapsed %0.5f seconds\n", wall_clock_seconds() - start);
+
+    if (cache != NULL)
+    {
+        unsigned long hits, misses;
+        orbit_cache_stats(cache, &hits, &misses);
+        printf("Orbit cache: %lu hits, %lu misses\n", hits, misses);
     }
 
-    printf("Time elapsed %0.5f seconds\n", ((double)clock() - start) / CLOCKS_PER_SEC);
+    if (brute_frame != NULL)
+    {
+        printf("Subdivision check: %lu of %lu pixels differ from brute force\n", mismatched, verified);
+        frame_buffer_release(brute_frame);
+    }
+
+    if (frame.aa != NULL)
+        antialias_report(&aa, stdout);
+
+    if (reprojecting)
+    {
+        printf("Reprojection: %lu pixels reused, %lu computed (%0.1f%%)\n", reuse.reused, reuse.computed,
+               100.0 * reuse.computed / (reuse.reused + reuse.computed));
+        reproject_release(&reuse);
+    }
 
-    SDL_Event ev;
-    int active;
+    if (deep_mode)
+        perturbation_release(&deep);
 
-    active = 1;
-    while(active)
+    if (output != NULL)
+    {
+        image_writer_close(&writer);
+        free(frame_pixels);
+    }
+    else
     {
-        /* Handle events */
-        while(SDL_PollEvent(&ev))
+        SDL_Event ev;
+        int active, cycling, redraw, offset;
+
+        // Keep the last frame on screen. P switches palette, C toggles
+        // color cycling, both only recolor the last iterations.
+        active = 1;
+        cycling = 0;
+        offset = 0;
+        while(active)
         {
-            if(ev.type == SDL_QUIT)
-                active = 0; /* End */
+            redraw = cycling;
+            if (cycling ? SDL_WaitEventTimeout(&ev, 30) : SDL_WaitEvent(&ev))
+            {
+                if(ev.type == SDL_QUIT)
+                    active = 0; /* End */
+                else if ((ev.type == SDL_KEYDOWN) && (ev.key.keysym.sym == SDLK_p))
+                {
+                    scheme = (scheme + 1) % PALETTE_SCHEMES;
+                    printf("Palette: %s\n", palette_name(scheme));
+                    redraw = 1;
+                }
+                else if ((ev.type == SDL_KEYDOWN) && (ev.key.keysym.sym == SDLK_c))
+                {
+                    cycling = !cycling;
+                    redraw = 1;
+                }
+            }
+
+            if (!active || !redraw)
+                continue;
+
+            if (cycling)
+                offset++;
+
+            palette_build(&lut, scheme, lut.max_iteration, offset);
+            if (equalize)
+                palette_equalize(&lut, &histogram);
+            palette_apply_frame(&lut, iteration_frame, frame_pixels, &pool);
+            if (frame.aa != NULL)
+                worker_pool_render(&pool, antialias_tile, (void *) &frame);
+
+            message = TTF_RenderText_Solid( font, msg, textColor );
+            if (message != NULL)
+                SDL_BlitSurface(message, NULL, screen, NULL);
+            SDL_FreeSurface(message);
+
+            SDL_UpdateTexture(texture_screen, NULL, (Uint32*)screen->pixels, res_x * sizeof (Uint32));
+            SDL_RenderClear(renderer);
+            SDL_RenderCopy(renderer, texture_screen, NULL, NULL);
+            SDL_RenderPresent(renderer);
         }
+
+        SDL_Quit();
     }
 
-    SDL_Quit();
+    palette_release(&lut);
+    if (frame.aa != NULL)
+        antialias_release(&aa);
+    palette_histogram_release(&histogram);
+    iter_control_release(&control);
+    worker_pool_release(&pool);
+    tile_queue_release(&queue);
+    frame_buffer_release(&iterations);
+    free(deep_pixels);
+    if (cache != NULL)
+        orbit_cache_release(cache);
 
     return 0;
 }
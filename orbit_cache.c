@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "orbit_cache.h"
+
+// Every entry needs its slot plus about two bucket indices
+#define ENTRY_BYTES (sizeof(orbit_entry) + 2 * sizeof(int))
+
+static uint64_t mix(uint64_t hash, double value)
+{
+    uint64_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    hash ^= bits;
+    hash *= 0x9e3779b97f4a7c15ull;
+    return hash ^ (hash >> 29);
+}
+
+static uint64_t hash_key(const orbit_key *key)
+{
+    uint64_t hash = key->julia ? 0x51afd7ed558ccd35ull : 0xc4ceb9fe1a85ec53ull;
+
+    hash = mix(hash, key->pos_x);
+    hash = mix(hash, key->pos_y);
+    if (key->julia)
+    {
+        hash = mix(hash, key->julia_x);
+        hash = mix(hash, key->julia_y);
+    }
+    return hash;
+}
+
+// Bitwise, a cached orbit is only reused for exactly the same point
+static int same_key(const orbit_key *a, const orbit_key *b)
+{
+    if ((a->julia != b->julia) ||
+        (memcmp(&a->pos_x, &b->pos_x, sizeof(double)) != 0) ||
+        (memcmp(&a->pos_y, &b->pos_y, sizeof(double)) != 0))
+        return 0;
+
+    return !a->julia || ((memcmp(&a->julia_x, &b->julia_x, sizeof(double)) == 0) &&
+                         (memcmp(&a->julia_y, &b->julia_y, sizeof(double)) == 0));
+}
+
+// The budget is split evenly among the shards
+int orbit_cache_init(orbit_cache *cache, size_t budget)
+{
+    int count, buckets;
+    size_t capacity = budget / ORBIT_CACHE_SHARDS / ENTRY_BYTES;
+
+    if (capacity < 16)
+        capacity = 16;
+    if (capacity > (1 << 28))
+        capacity = 1 << 28;
+
+    for (buckets = 16; buckets < (int) capacity; buckets <<= 1)
+        ;
+
+    for (count = 0; count < ORBIT_CACHE_SHARDS; count++)
+    {
+        orbit_shard *shard = &cache->shards[count];
+
+        pthread_mutex_init(&shard->lock, NULL);
+        shard->capacity = capacity;
+        shard->bucket_mask = buckets - 1;
+        shard->used = 0;
+        shard->newest = -1;
+        shard->oldest = -1;
+        shard->hits = 0;
+        shard->misses = 0;
+        shard->entries = malloc(capacity * sizeof(orbit_entry));
+        shard->buckets = malloc(buckets * sizeof(int));
+
+        if ((shard->entries == NULL) || (shard->buckets == NULL))
+        {
+            fprintf(stderr, "Bad luck, out of memory\n");
+            return 2;
+        }
+        memset(shard->buckets, 0xff, buckets * sizeof(int));
+    }
+
+    return 0;
+}
+
+static void lru_unlink(orbit_shard *shard, int item)
+{
+    orbit_entry *entry = &shard->entries[item];
+
+    if (entry->newer >= 0)
+        shard->entries[entry->newer].older = entry->older;
+    else
+        shard->newest = entry->older;
+
+    if (entry->older >= 0)
+        shard->entries[entry->older].newer = entry->newer;
+    else
+        shard->oldest = entry->newer;
+}
+
+static void lru_push(orbit_shard *shard, int item)
+{
+    orbit_entry *entry = &shard->entries[item];
+
+    entry->newer = -1;
+    entry->older = shard->newest;
+    if (shard->newest >= 0)
+        shard->entries[shard->newest].newer = item;
+    shard->newest = item;
+    if (shard->oldest < 0)
+        shard->oldest = item;
+}
+
+static int find(orbit_shard *shard, const orbit_key *key, uint64_t hash)
+{
+    int item = shard->buckets[hash & shard->bucket_mask];
+
+    while ((item >= 0) && !same_key(&shard->entries[item].key, key))
+        item = shard->entries[item].chain;
+
+    return item;
+}
+
+// Returns 1 and fills state if the point has a cached orbit
+int orbit_cache_lookup(orbit_cache *cache, const orbit_key *key, orbit_state *state)
+{
+    uint64_t hash = hash_key(key);
+    orbit_shard *shard = &cache->shards[hash >> 58];
+    int item;
+
+    pthread_mutex_lock(&shard->lock);
+    item = find(shard, key, hash);
+    if (item >= 0)
+    {
+        *state = shard->entries[item].state;
+        lru_unlink(shard, item);
+        lru_push(shard, item);
+        shard->hits++;
+    }
+    else
+        shard->misses++;
+    pthread_mutex_unlock(&shard->lock);
+
+    return item >= 0;
+}
+
+// Inserts or updates the orbit of a point, evicting the least recently
+// used one of the shard when it is full
+void orbit_cache_store(orbit_cache *cache, const orbit_key *key, const orbit_state *state)
+{
+    uint64_t hash = hash_key(key);
+    orbit_shard *shard = &cache->shards[hash >> 58];
+    orbit_entry *entry;
+    int item, *link;
+
+    pthread_mutex_lock(&shard->lock);
+    item = find(shard, key, hash);
+
+    if (item < 0)
+    {
+        if (shard->used < shard->capacity)
+            item = shard->used++;
+        else
+        {
+            // Take the oldest entry out of its bucket chain
+            item = shard->oldest;
+            entry = &shard->entries[item];
+            link = &shard->buckets[hash_key(&entry->key) & shard->bucket_mask];
+            while (*link != item)
+                link = &shard->entries[*link].chain;
+            *link = entry->chain;
+            lru_unlink(shard, item);
+        }
+
+        entry = &shard->entries[item];
+        entry->key = *key;
+        entry->chain = shard->buckets[hash & shard->bucket_mask];
+        shard->buckets[hash & shard->bucket_mask] = item;
+    }
+    else
+        lru_unlink(shard, item);
+
+    shard->entries[item].state = *state;
+    lru_push(shard, item);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+void orbit_cache_stats(orbit_cache *cache, unsigned long *hits, unsigned long *misses)
+{
+    int count;
+
+    *hits = 0;
+    *misses = 0;
+    for (count = 0; count < ORBIT_CACHE_SHARDS; count++)
+    {
+        pthread_mutex_lock(&cache->shards[count].lock);
+        *hits += cache->shards[count].hits;
+        *misses += cache->shards[count].misses;
+        pthread_mutex_unlock(&cache->shards[count].lock);
+    }
+}
+
+void orbit_cache_release(orbit_cache *cache)
+{
+    int count;
+
+    for (count = 0; count < ORBIT_CACHE_SHARDS; count++)
+    {
+        pthread_mutex_destroy(&cache->shards[count].lock);
+        free(cache->shards[count].entries);
+        free(cache->shards[count].buckets);
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef ORBIT_CACHE_H
+#define ORBIT_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+// Number of independently locked parts, a power of two
+#define ORBIT_CACHE_SHARDS 64
+
+// Exact complex plane point plus the Julia c when julia is set, so the
+// same pixel of two frames only matches if the orbit is really the same
+typedef struct orbit_key orbit_key;
+struct orbit_key
+{
+    double pos_x;
+    double pos_y;
+    double julia_x;
+    double julia_y;
+    int julia;
+};
+
+// Where an orbit was left: z after iteration steps. If escaped is set the
+// final count is known, otherwise iteration can resume from z.
+typedef struct orbit_state orbit_state;
+struct orbit_state
+{
+    double x;
+    double y;
+    int iteration;
+    int escaped;
+};
+
+typedef struct orbit_entry orbit_entry;
+struct orbit_entry
+{
+    orbit_key key;
+    orbit_state state;
+    int chain;
+    int newer;
+    int older;
+};
+
+// Hash table plus LRU list over a fixed pool of entries
+typedef struct orbit_shard orbit_shard;
+struct orbit_shard
+{
+    pthread_mutex_t lock;
+    orbit_entry *entries;
+    int *buckets;
+    int bucket_mask;
+    int capacity;
+    int used;
+    int newest;
+    int oldest;
+    unsigned long hits;
+    unsigned long misses;
+};
+
+typedef struct orbit_cache orbit_cache;
+struct orbit_cache
+{
+    orbit_shard shards[ORBIT_CACHE_SHARDS];
+};
+
+int orbit_cache_init(orbit_cache *cache, size_t budget);
+int orbit_cache_lookup(orbit_cache *cache, const orbit_key *key, orbit_state *state);
+void orbit_cache_store(orbit_cache *cache, const orbit_key *key, const orbit_state *state);
+void orbit_cache_stats(orbit_cache *cache, unsigned long *hits, unsigned long *misses);
+void orbit_cache_release(orbit_cache *cache);
+
+#endif
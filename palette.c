@@ -0,0 +1,322 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "palette.h"
+
+static const char *names[PALETTE_SCHEMES] = { "classic", "fire", "ocean", "gray" };
+
+// Gradient stops of the smooth schemes, repeated every 64 iterations
+static const uint32_t fire[] = { 0x000000, 0x800000, 0xff4000, 0xffc000, 0xffffc0, 0xff8000, 0x400000 };
+static const uint32_t ocean[] = { 0x000020, 0x003080, 0x00a0c0, 0xc0ffff, 0x0080a0, 0x001040 };
+static const uint32_t gray[] = { 0x101010, 0xf0f0f0, 0x101010 };
+
+#define GRADIENT_PERIOD 64
+
+// Equalized palettes spread the escaped pixels over this many colors of
+// the scheme (or the cap, when lower)
+#define EQUALIZE_SPAN 256
+
+int palette_find(const char *name)
+{
+    int scheme;
+
+    for (scheme = 0; scheme < PALETTE_SCHEMES; scheme++)
+    {
+        if (strcmp(name, names[scheme]) == 0)
+            return scheme;
+    }
+
+    return -1;
+}
+
+const char *palette_name(int scheme)
+{
+    return names[scheme];
+}
+
+// The original look of the renderers
+static uint32_t classic_color(int iteration, int max_iteration)
+{
+    uint32_t red, green, blue;
+
+    if ((iteration < 128) && (iteration > 0))
+    {
+        red = 0;
+        green = (uint8_t) (20 + iteration);
+        blue = 0;
+    }
+    else if ((iteration >= 128) && (iteration < max_iteration))
+    {
+        red = (uint8_t) iteration;
+        green = 148;
+        blue = (uint8_t) iteration;
+    }
+    else
+    {
+        red = green = blue = 0;
+    }
+
+    return (red << 16) | (green << 8) | blue;
+}
+
+static uint32_t gradient_color(const uint32_t *stops, int number_stops, int iteration)
+{
+    int position = (iteration % GRADIENT_PERIOD) * (number_stops - 1);
+    int stop = position / GRADIENT_PERIOD;
+    int weight = ((position % GRADIENT_PERIOD) * 256) / GRADIENT_PERIOD;
+    uint32_t from = stops[stop], to = stops[stop + 1], color = 0;
+    int shift, channel;
+
+    for (shift = 0; shift < 24; shift += 8)
+    {
+        channel = ((from >> shift) & 0xff) * (256 - weight) + ((to >> shift) & 0xff) * weight;
+        color |= (uint32_t) (channel >> 8) << shift;
+    }
+
+    return color;
+}
+
+// Color of an escaped count, 1 .. max_iteration - 1
+static uint32_t scheme_color(int scheme, int iteration, int max_iteration)
+{
+    if (scheme == PALETTE_FIRE)
+        return 0xff000000u | gradient_color(fire, sizeof(fire) / sizeof(fire[0]), iteration);
+    else if (scheme == PALETTE_OCEAN)
+        return 0xff000000u | gradient_color(ocean, sizeof(ocean) / sizeof(ocean[0]), iteration);
+    else if (scheme == PALETTE_GRAY)
+        return 0xff000000u | gradient_color(gray, sizeof(gray) / sizeof(gray[0]), iteration);
+    return 0xff000000u | classic_color(iteration, max_iteration);
+}
+
+int palette_build(palette *lut, int scheme, int max_iteration, int offset)
+{
+    int iteration, shifted, period;
+
+    if (max_iteration < 1)
+        max_iteration = 1;
+
+    if ((lut->colors == NULL) || (lut->max_iteration != max_iteration))
+    {
+        free(lut->colors);
+        lut->colors = malloc((max_iteration + 1) * sizeof(uint32_t));
+        if (lut->colors == NULL)
+        {
+            fprintf(stderr, "Bad luck, out of memory\n");
+            return 2;
+        }
+    }
+
+    lut->max_iteration = max_iteration;
+    lut->scheme = scheme;
+    lut->offset = offset;
+
+    // Cycling rotates within the escaped range, 1 .. max_iteration - 1
+    period = (max_iteration > 1) ? max_iteration - 1 : 1;
+
+    lut->colors[0] = 0xff000000u;
+    lut->colors[max_iteration] = 0xff000000u;
+    for (iteration = 1; iteration < max_iteration; iteration++)
+    {
+        shifted = ((iteration - 1 + offset) % period + period) % period + 1;
+        lut->colors[iteration] = scheme_color(scheme, shifted, max_iteration);
+    }
+
+    return 0;
+}
+
+// A gather per pixel. Out of range counts are clamped without a branch,
+// so the compiler is free to vectorize the loop.
+void palette_apply(const palette *lut, const int *iterations, uint32_t *argb, int count)
+{
+    const uint32_t *colors = lut->colors;
+    unsigned int top = lut->max_iteration, value;
+    int pixel;
+
+    for (pixel = 0; pixel < count; pixel++)
+    {
+        value = (unsigned int) iterations[pixel];
+        value = (value > top) ? top : value;
+        argb[pixel] = colors[value];
+    }
+}
+
+// Normalized counts, each pixel between the colors of its count and the
+// next one. Both channel pairs are blended at once in 8.8 fixed point.
+void palette_apply_smooth(const palette *lut, const int *iterations, const unsigned char *fractions, uint32_t *argb, int count)
+{
+    const uint32_t *colors = lut->colors;
+    unsigned int top = lut->max_iteration, value, next, weight;
+    uint32_t from, to;
+    int pixel;
+
+    for (pixel = 0; pixel < count; pixel++)
+    {
+        value = (unsigned int) iterations[pixel];
+        value = (value > top) ? top : value;
+        next = (value + 1 < top) ? value + 1 : value;
+        from = colors[value];
+        to = colors[next];
+        weight = fractions[pixel];
+        argb[pixel] = 0xff000000u |
+                      ((((from & 0xff00ff) * (256 - weight) + (to & 0xff00ff) * weight) >> 8) & 0xff00ff) |
+                      ((((from & 0x00ff00) * (256 - weight) + (to & 0x00ff00) * weight) >> 8) & 0x00ff00);
+    }
+}
+
+void palette_apply_tile(void *frame, const tile *piece, int worker)
+{
+    palette_frame *args = (palette_frame *) frame;
+    int samples[TILE_SIZE * TILE_SIZE];
+    unsigned char fractions[TILE_SIZE * TILE_SIZE];
+    int y, offset;
+    uint32_t *line;
+
+    // A tiled frame is unpacked a tile at a time
+    if (args->tiles != NULL)
+    {
+        frame_buffer_load(args->tiles, piece, samples, TILE_SIZE);
+        if (args->tiles->smooth)
+            frame_buffer_load_fractions(args->tiles, piece, fractions, TILE_SIZE);
+        for (y = 0; y < piece->height; y++)
+        {
+            line = &args->argb[piece->x + (piece->y + y) * args->res_x];
+            if (args->tiles->smooth)
+                palette_apply_smooth(args->lut, &samples[y * TILE_SIZE], &fractions[y * TILE_SIZE], line, piece->width);
+            else
+                palette_apply(args->lut, &samples[y * TILE_SIZE], line, piece->width);
+        }
+        return;
+    }
+
+    for (y = piece->y; y < piece->y + piece->height; y++)
+    {
+        offset = piece->x + y * args->res_x;
+        palette_apply(args->lut, &args->iterations[offset], &args->argb[offset], piece->width);
+    }
+}
+
+// Colorizes a whole frame with the tiles of the pool's queue
+void palette_apply_pool(const palette *lut, const int *iterations, uint32_t *argb, int res_x, worker_pool *pool)
+{
+    palette_frame frame;
+
+    frame.lut = lut;
+    frame.iterations = iterations;
+    frame.tiles = NULL;
+    frame.argb = argb;
+    frame.res_x = res_x;
+
+    worker_pool_render(pool, palette_apply_tile, (void *) &frame);
+}
+
+// The same from a tiled frame
+void palette_apply_frame(const palette *lut, const frame_buffer *tiles, uint32_t *argb, worker_pool *pool)
+{
+    palette_frame frame;
+
+    frame.lut = lut;
+    frame.iterations = NULL;
+    frame.tiles = tiles;
+    frame.argb = argb;
+    frame.res_x = tiles->res_x;
+
+    worker_pool_render(pool, palette_apply_tile, (void *) &frame);
+}
+
+void palette_release(palette *lut)
+{
+    free(lut->colors);
+    lut->colors = NULL;
+}
+
+int palette_histogram_init(palette_histogram *histogram, int number_workers)
+{
+    histogram->counts = NULL;
+    histogram->stride = 0;
+    histogram->number_workers = (number_workers < 1) ? 1 : number_workers;
+    histogram->max_iteration = 0;
+
+    return 0;
+}
+
+// Empties the tables for a frame rendered with this cap
+int palette_histogram_reset(palette_histogram *histogram, int max_iteration)
+{
+    int stride = (max_iteration + 1 + 15) / 16 * 16;
+
+    if ((histogram->counts == NULL) || (stride > histogram->stride))
+    {
+        free(histogram->counts);
+        histogram->counts = aligned_alloc(64, (size_t) stride * histogram->number_workers * sizeof(unsigned int));
+        if (histogram->counts == NULL)
+        {
+            fprintf(stderr, "Bad luck, out of memory\n");
+            return 2;
+        }
+        histogram->stride = stride;
+    }
+
+    histogram->max_iteration = max_iteration;
+    memset(histogram->counts, 0, (size_t) histogram->stride * histogram->number_workers * sizeof(unsigned int));
+    return 0;
+}
+
+// Counts samples[x + y * stride] into the table of the worker. Inside (0)
+// and the cap are not colored by the scheme and left out.
+void palette_histogram_count(palette_histogram *histogram, int worker, const int *samples, int width, int height, int stride)
+{
+    unsigned int *counts = &histogram->counts[(worker % histogram->number_workers) * histogram->stride];
+    unsigned int escaped = histogram->max_iteration - 1;
+    int x, y;
+
+    for (y = 0; y < height; y++, samples += stride)
+    {
+        for (x = 0; x < width; x++)
+        {
+            if ((unsigned int) samples[x] - 1 < escaped)
+                counts[samples[x]]++;
+        }
+    }
+}
+
+// Recolors the escaped counts of the palette so each color of the scheme
+// covers about as many pixels of the counted frame. Keeps the scheme and
+// the cycling offset of the last palette_build, which must have been for
+// the same cap.
+void palette_equalize(palette *lut, const palette_histogram *histogram)
+{
+    unsigned long total = 0, below, here;
+    int iteration, worker, span, shifted;
+
+    if (histogram->max_iteration != lut->max_iteration)
+        return;
+
+    for (worker = 0; worker < histogram->number_workers; worker++)
+        for (iteration = 1; iteration < lut->max_iteration; iteration++)
+            total += histogram->counts[worker * histogram->stride + iteration];
+    if (total == 0)
+        return;
+
+    span = (lut->max_iteration - 1 < EQUALIZE_SPAN) ? lut->max_iteration - 1 : EQUALIZE_SPAN;
+
+    below = 0;
+    for (iteration = 1; iteration < lut->max_iteration; iteration++)
+    {
+        here = 0;
+        for (worker = 0; worker < histogram->number_workers; worker++)
+            here += histogram->counts[worker * histogram->stride + iteration];
+
+        // Position of the middle of the count among the escaped pixels
+        shifted = (int) (((below + here / 2) * span) / total);
+        shifted = ((shifted + lut->offset) % span + span) % span + 1;
+        lut->colors[iteration] = scheme_color(lut->scheme, shifted, lut->max_iteration);
+        below += here;
+    }
+}
+
+void palette_histogram_release(palette_histogram *histogram)
+{
+    free(histogram->counts);
+    histogram->counts = NULL;
+}
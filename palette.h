@@ -0,0 +1,71 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <stdint.h>
+
+#include "tile_queue.h"
+#include "worker_pool.h"
+#include "frame_buffer.h"
+
+enum
+{
+    PALETTE_CLASSIC,
+    PALETTE_FIRE,
+    PALETTE_OCEAN,
+    PALETTE_GRAY,
+    PALETTE_SCHEMES
+};
+
+// Colors as 0xAARRGGBB indexed by iteration count, 0 .. max_iteration.
+// Iteration 0 (inside the set) and max_iteration are black. offset rotates
+// the colors of the escaped points for color cycling. Start from a zeroed
+// palette, palette_build allocates the table.
+typedef struct palette palette;
+struct palette
+{
+    uint32_t *colors;
+    int max_iteration;
+    int scheme;
+    int offset;
+};
+
+// Escaped pixels per iteration count, one table per worker so each tile
+// is counted by the worker rendering it, while it is still in its cache,
+// and without locks. palette_equalize adds the tables up once the pool
+// is done. Tables start on their own cache lines.
+typedef struct palette_histogram palette_histogram;
+struct palette_histogram
+{
+    unsigned int *counts;
+    int stride;
+    int number_workers;
+    int max_iteration;
+};
+
+// For the pool, when colorizing a whole frame in parallel
+typedef struct palette_frame palette_frame;
+struct palette_frame
+{
+    const palette *lut;
+    const int *iterations;
+    const frame_buffer *tiles;
+    uint32_t *argb;
+    int res_x;
+};
+
+int palette_find(const char *name);
+const char *palette_name(int scheme);
+int palette_build(palette *lut, int scheme, int max_iteration, int offset);
+void palette_apply(const palette *lut, const int *iterations, uint32_t *argb, int count);
+void palette_apply_smooth(const palette *lut, const int *iterations, const unsigned char *fractions, uint32_t *argb, int count);
+void palette_apply_tile(void *frame, const tile *piece, int worker);
+void palette_apply_pool(const palette *lut, const int *iterations, uint32_t *argb, int res_x, worker_pool *pool);
+void palette_apply_frame(const palette *lut, const frame_buffer *tiles, uint32_t *argb, worker_pool *pool);
+void palette_release(palette *lut);
+int palette_histogram_init(palette_histogram *histogram, int number_workers);
+int palette_histogram_reset(palette_histogram *histogram, int max_iteration);
+void palette_histogram_count(palette_histogram *histogram, int worker, const int *samples, int width, int height, int stride);
+void palette_equalize(palette *lut, const palette_histogram *histogram);
+void palette_histogram_release(palette_histogram *histogram);
+
+#endif
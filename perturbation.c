@@ -0,0 +1,365 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "perturbation.h"
+
+// Pauldelbrot's criterion, |z| dropping this far below |Z| (squared) means
+// the delta has lost its precision
+#define GLITCH_TOLERANCE 1e-6
+
+// The series is trusted while its cubic term stays this small next to the
+// linear one
+#define SERIES_TOLERANCE 1e-12
+
+// Brent cycle detection runs on the deltas. A pixel caught in the same
+// attracting cycle as the reference ends up with periodic deltas, which
+// are compared against the pixel spacing (squared), the scale the deltas
+// are accurate to. Points in the cycle at another phase are only found
+// while the spacing is well above the double resolution.
+#define PERIOD_TOLERANCE 1e-12
+
+// Pixel spacing (as a power of two) below which deltas no longer fit in a
+// double, and the delta size at which a pixel can go back to doubles
+#define EXTENDED_STEP_EXPONENT -960
+#define EXTENDED_DELTA_EXPONENT -900
+
+int perturbation_init(deep_frame *frame, int res_x, int res_y, int *out)
+{
+    frame->res_x = res_x;
+    frame->res_y = res_y;
+    frame->out = out;
+    frame->zoom = floatexp_from_double(1.0);
+    frame->max_iteration = 1000;
+    bigfix_zero(&frame->center_x, 2);
+    bigfix_zero(&frame->center_y, 2);
+
+    frame->orbit.capacity = 0;
+    frame->orbit.length = 0;
+    frame->orbit.zx = NULL;
+    frame->orbit.zy = NULL;
+
+    return 0;
+}
+
+void perturbation_release(deep_frame *frame)
+{
+    free(frame->orbit.zx);
+    free(frame->orbit.zy);
+}
+
+// Iterates the reference in full precision, this is the only place where
+// bignum arithmetic is done
+static int reference_compute(reference_orbit *orbit, const bigfix *cx, const bigfix *cy, int max_iteration)
+{
+    bigfix x, y, xx, yy, xplusy;
+    int n;
+
+    if (orbit->capacity < max_iteration)
+    {
+        free(orbit->zx);
+        free(orbit->zy);
+        orbit->zx = malloc(max_iteration * sizeof(double));
+        orbit->zy = malloc(max_iteration * sizeof(double));
+        if ((orbit->zx == NULL) || (orbit->zy == NULL))
+        {
+            fprintf(stderr, "Bad luck, out of memory\n");
+            orbit->capacity = 0;
+            return 2;
+        }
+        orbit->capacity = max_iteration;
+    }
+
+    bigfix_zero(&x, cx->limbs);
+    bigfix_zero(&y, cx->limbs);
+    orbit->escaped = 0;
+
+    for (n = 0; n < max_iteration; n++)
+    {
+        orbit->zx[n] = bigfix_to_double(&x);
+        orbit->zy[n] = bigfix_to_double(&y);
+
+        if (orbit->zx[n] * orbit->zx[n] + orbit->zy[n] * orbit->zy[n] > 4.0)
+        {
+            orbit->escaped = 1;
+            n++;
+            break;
+        }
+
+        bigfix_mul(&xx, &x, &x);
+        bigfix_mul(&yy, &y, &y);
+        bigfix_add(&xplusy, &x, &y);
+        bigfix_mul(&y, &xplusy, &xplusy);
+        bigfix_sub(&y, &y, &xx);
+        bigfix_sub(&y, &y, &yy);
+        bigfix_add(&y, &y, cy);
+        bigfix_sub(&x, &xx, &yy);
+        bigfix_add(&x, &x, cx);
+    }
+
+    orbit->length = n;
+    return 0;
+}
+
+// Complex product in floatexp, (ax + i ay) (bx + i by)
+static inline void complex_mul(floatexp *rx, floatexp *ry, floatexp ax, floatexp ay, floatexp bx, floatexp by)
+{
+    floatexp x = floatexp_sub(floatexp_mul(ax, bx), floatexp_mul(ay, by));
+
+    *ry = floatexp_add(floatexp_mul(ax, by), floatexp_mul(ay, bx));
+    *rx = x;
+}
+
+// Series approximation, dz_n ~ A_n dc + B_n dc^2 + C_n dc^3 for every pixel
+// of the frame. Finds how many of the shared first iterations can be
+// skipped for pixels up to radius away from the reference. The
+// coefficients grow like 1 / radius, so they are kept in floatexp.
+static void series_compute(deep_frame *frame, floatexp radius)
+{
+    const reference_orbit *orbit = &frame->orbit;
+    floatexp zero = floatexp_from_double(0.0), one = floatexp_from_double(1.0);
+    floatexp ax = zero, ay = zero, bx = zero, by = zero, cx = zero, cy = zero;
+    floatexp nax, nay, nbx, nby, ncx, ncy, tx, ty, zx, zy;
+    floatexp radius2 = floatexp_sqr(radius);
+    int n = 0;
+
+    while (n + 1 < orbit->length)
+    {
+        zx = floatexp_from_double(2.0 * orbit->zx[n]);
+        zy = floatexp_from_double(2.0 * orbit->zy[n]);
+
+        // A' = 2 Z A + 1, B' = 2 Z B + A^2, C' = 2 Z C + 2 A B
+        complex_mul(&nax, &nay, zx, zy, ax, ay);
+        nax = floatexp_add(nax, one);
+        complex_mul(&nbx, &nby, zx, zy, bx, by);
+        complex_mul(&tx, &ty, ax, ay, ax, ay);
+        nbx = floatexp_add(nbx, tx);
+        nby = floatexp_add(nby, ty);
+        complex_mul(&ncx, &ncy, zx, zy, cx, cy);
+        complex_mul(&tx, &ty, ax, ay, bx, by);
+        ncx = floatexp_add(ncx, floatexp_ldexp(tx, 1));
+        ncy = floatexp_add(ncy, floatexp_ldexp(ty, 1));
+
+        // |C| r^2 <= tolerance |A|, compared with squared magnitudes
+        tx = floatexp_mul(floatexp_add(floatexp_sqr(ncx), floatexp_sqr(ncy)), floatexp_sqr(radius2));
+        ty = floatexp_mul_double(floatexp_add(floatexp_sqr(nax), floatexp_sqr(nay)), SERIES_TOLERANCE * SERIES_TOLERANCE);
+        if (floatexp_compare(tx, ty) > 0)
+            break;
+
+        ax = nax; ay = nay;
+        bx = nbx; by = nby;
+        cx = ncx; cy = ncy;
+        n++;
+    }
+
+    frame->skip = n;
+    frame->series[0] = ax; frame->series[1] = ay;
+    frame->series[2] = bx; frame->series[3] = by;
+    frame->series[4] = cx; frame->series[5] = cy;
+}
+
+// Iterates a pixel as a delta against the reference:
+// dz_(n+1) = 2 Z_n dz_n + dz_n^2 + dc
+// Deltas start in floatexp when the view is past the double range and
+// move to plain doubles once they have grown enough.
+static int perturbation_point(const deep_frame *frame, floatexp fdcx, floatexp fdcy)
+{
+    const double *zx = frame->orbit.zx;
+    const double *zy = frame->orbit.zy;
+    const floatexp *s = frame->series;
+    int n = frame->skip;
+    int last = frame->orbit.escaped ? frame->orbit.length - 1 : frame->max_iteration;
+    double dx, dy, dcx, dcy, x, y, magnitude, temp, saved_x, saved_y, tolerance;
+    int save_at, window;
+    floatexp fdx, fdy, tx, ty;
+
+    // Starting delta from the series, ((C dc + B) dc + A) dc
+    complex_mul(&tx, &ty, s[4], s[5], fdcx, fdcy);
+    tx = floatexp_add(tx, s[2]);
+    ty = floatexp_add(ty, s[3]);
+    complex_mul(&tx, &ty, tx, ty, fdcx, fdcy);
+    tx = floatexp_add(tx, s[0]);
+    ty = floatexp_add(ty, s[1]);
+    complex_mul(&fdx, &fdy, tx, ty, fdcx, fdcy);
+
+    while ((frame->extended) && (n < frame->max_iteration) &&
+           (fdx.exponent < EXTENDED_DELTA_EXPONENT) && (fdy.exponent < EXTENDED_DELTA_EXPONENT))
+    {
+        x = zx[n] + floatexp_to_double(fdx);
+        y = zy[n] + floatexp_to_double(fdy);
+        magnitude = x * x + y * y;
+
+        if (magnitude > 4.0) return n;
+        if (magnitude < GLITCH_TOLERANCE * (zx[n] * zx[n] + zy[n] * zy[n])) return PERTURBATION_GLITCH;
+        if (n >= last) return PERTURBATION_GLITCH;
+
+        // 2 Z dz + dz^2 + dc
+        complex_mul(&tx, &ty, fdx, fdy, fdx, fdy);
+        tx = floatexp_add(tx, fdcx);
+        ty = floatexp_add(ty, fdcy);
+        tx = floatexp_add(tx, floatexp_sub(floatexp_mul_double(fdx, 2.0 * zx[n]), floatexp_mul_double(fdy, 2.0 * zy[n])));
+        fdy = floatexp_add(ty, floatexp_add(floatexp_mul_double(fdy, 2.0 * zx[n]), floatexp_mul_double(fdx, 2.0 * zy[n])));
+        fdx = tx;
+        n++;
+    }
+
+    dx = floatexp_to_double(fdx);
+    dy = floatexp_to_double(fdy);
+    dcx = floatexp_to_double(fdcx);
+    dcy = floatexp_to_double(fdcy);
+
+    // Saved now, then after 1, 2, 4... more iterations
+    tolerance = PERIOD_TOLERANCE * (dcx * dcx + dcy * dcy);
+    saved_x = saved_y = HUGE_VAL;
+    save_at = n;
+    window = 1;
+
+    while (n < frame->max_iteration)
+    {
+        x = zx[n] + dx;
+        y = zy[n] + dy;
+        magnitude = x * x + y * y;
+
+        if (magnitude > 4.0) return n;
+        if (magnitude < GLITCH_TOLERANCE * (zx[n] * zx[n] + zy[n] * zy[n])) return PERTURBATION_GLITCH;
+        if (n >= last) return PERTURBATION_GLITCH;
+
+        x = dx - saved_x;
+        y = dy - saved_y;
+        if (x * x + y * y < tolerance) return 0;
+        if (n == save_at)
+        {
+            saved_x = dx;
+            saved_y = dy;
+            save_at += window;
+            window += window;
+        }
+
+        temp = 2.0 * (zx[n] * dx - zy[n] * dy) + dx * dx - dy * dy + dcx;
+        dy = 2.0 * (zx[n] * dy + zy[n] * dx) + 2.0 * dx * dy + dcy;
+        dx = temp;
+        n++;
+    }
+
+    return 0;
+}
+
+// Pool job. The first pass does every pixel, the following ones only
+// those still marked as glitched.
+static void perturbation_tile(void *frame_ptr, const tile *piece, int worker)
+{
+    deep_frame *frame = (deep_frame *) frame_ptr;
+    int x, y, *pixel;
+
+    for (y = piece->y; y < piece->y + piece->height; y++)
+    {
+        for (x = piece->x; x < piece->x + piece->width; x++)
+        {
+            pixel = &frame->out[x + y * frame->res_x];
+            if ((frame->glitch_pass) && (*pixel != PERTURBATION_GLITCH))
+                continue;
+
+            *pixel = perturbation_point(frame,
+                                        floatexp_mul_double(frame->step_x, x - frame->ref_x),
+                                        floatexp_mul_double(frame->step_y, y - frame->ref_y));
+        }
+    }
+}
+
+// Picks the middle one of the glitched pixels as the next reference.
+// Returns how many pixels are glitched.
+static int glitch_pick(const deep_frame *frame, int *pick_x, int *pick_y)
+{
+    int count, glitched = 0, total = frame->res_x * frame->res_y;
+
+    for (count = 0; count < total; count++)
+        if (frame->out[count] == PERTURBATION_GLITCH)
+            glitched++;
+
+    if (glitched == 0)
+        return 0;
+
+    int wanted = glitched / 2;
+    for (count = 0; count < total; count++)
+    {
+        if ((frame->out[count] == PERTURBATION_GLITCH) && (wanted-- == 0))
+        {
+            *pick_x = count % frame->res_x;
+            *pick_y = count / frame->res_x;
+            break;
+        }
+    }
+
+    return glitched;
+}
+
+// Renders the view in frame->out. The first reference is the center,
+// glitched pixels are redone against references picked among them.
+void perturbation_render(deep_frame *frame, worker_pool *pool)
+{
+    bigfix ref_x, ref_y, offset;
+    int limbs, count, pick_x, pick_y, total = frame->res_x * frame->res_y;
+    floatexp radius, step;
+
+    frame->step_x = floatexp_mul_double(frame->zoom, 3.5 / frame->res_x);
+    frame->step_y = floatexp_mul_double(frame->zoom, 2.0 / frame->res_y);
+    step = (floatexp_compare(frame->step_x, frame->step_y) < 0) ? frame->step_x : frame->step_y;
+    limbs = bigfix_limbs_for_scale(floatexp_log2(step));
+    frame->extended = (floatexp_log2(step) < EXTENDED_STEP_EXPONENT);
+
+    ref_x = frame->center_x;
+    ref_y = frame->center_y;
+    bigfix_set_limbs(&ref_x, limbs);
+    bigfix_set_limbs(&ref_y, limbs);
+
+    frame->ref_x = frame->res_x / 2;
+    frame->ref_y = frame->res_y / 2;
+    if (reference_compute(&frame->orbit, &ref_x, &ref_y, frame->max_iteration) != 0)
+        return;
+
+    // Half the diagonal, the farthest a pixel gets from the reference
+    radius = floatexp_mul_double(frame->zoom, hypot(1.75, 1.0));
+    series_compute(frame, radius);
+
+    frame->glitch_pass = 0;
+    worker_pool_render(pool, perturbation_tile, (void *) frame);
+
+    frame->references = 1;
+    frame->glitched = glitch_pick(frame, &pick_x, &pick_y);
+
+    while ((frame->glitched > 0) && (frame->references < PERTURBATION_MAX_REFERENCES))
+    {
+        ref_x = frame->center_x;
+        ref_y = frame->center_y;
+        bigfix_set_limbs(&ref_x, limbs);
+        bigfix_set_limbs(&ref_y, limbs);
+        bigfix_ldexp(&offset, frame->step_x.mantissa * (pick_x - frame->res_x / 2), frame->step_x.exponent, limbs);
+        bigfix_add(&ref_x, &ref_x, &offset);
+        bigfix_ldexp(&offset, frame->step_y.mantissa * (pick_y - frame->res_y / 2), frame->step_y.exponent, limbs);
+        bigfix_add(&ref_y, &ref_y, &offset);
+
+        frame->ref_x = pick_x;
+        frame->ref_y = pick_y;
+        if (reference_compute(&frame->orbit, &ref_x, &ref_y, frame->max_iteration) != 0)
+            return;
+
+        // No series for the secondary references, they only see a few pixels
+        frame->skip = 0;
+        for (count = 0; count < 6; count++)
+            frame->series[count] = floatexp_from_double(0.0);
+
+        frame->glitch_pass = 1;
+        worker_pool_render(pool, perturbation_tile, (void *) frame);
+
+        frame->references++;
+        frame->glitched = glitch_pick(frame, &pick_x, &pick_y);
+    }
+
+    // Whatever is left is drawn as interior
+    if (frame->glitched > 0)
+    {
+        for (count = 0; count < total; count++)
+            if (frame->out[count] == PERTURBATION_GLITCH)
+                frame->out[count] = 0;
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef PERTURBATION_H
+#define PERTURBATION_H
+
+#include "bigfix.h"
+#include "floatexp.h"
+#include "tile_queue.h"
+#include "worker_pool.h"
+
+// Pixels the current reference cannot handle are marked with this until
+// a new reference fixes them
+#define PERTURBATION_GLITCH -1
+
+// References tried per frame before giving up on the remaining glitches
+#define PERTURBATION_MAX_REFERENCES 16
+
+// Orbit of the reference point, Z_0 .. Z_(length - 1), rounded to double
+typedef struct reference_orbit reference_orbit;
+struct reference_orbit
+{
+    double *zx;
+    double *zy;
+    int length;
+    int capacity;
+    int escaped;
+};
+
+// A deep zoom view. The center is kept in high precision, everything else
+// is relative to the reference. The view is 3.5 * zoom wide and 2.0 * zoom
+// high, like the classic renderer. Sizes are floatexp so the view can go
+// past the double exponent range.
+typedef struct deep_frame deep_frame;
+struct deep_frame
+{
+    int res_x;
+    int res_y;
+    int max_iteration;
+    bigfix center_x;
+    bigfix center_y;
+    floatexp zoom;
+    int *out;
+
+    // Set up by perturbation_render for every reference
+    floatexp step_x;
+    floatexp step_y;
+    int extended;
+    reference_orbit orbit;
+    double ref_x;
+    double ref_y;
+    int skip;
+    floatexp series[6];
+    int glitch_pass;
+
+    // Per frame statistics
+    int references;
+    int glitched;
+};
+
+int perturbation_init(deep_frame *frame, int res_x, int res_y, int *out);
+void perturbation_render(deep_frame *frame, worker_pool *pool);
+void perturbation_release(deep_frame *frame);
+
+#endif
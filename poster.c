@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "poster.h"
+#include "wall_clock.h"
+
+// Takes the strips in order as they come, one fwrite each. The file is
+// unbuffered, a strip goes to the system in a single large write.
+static void *poster_main(void *arguments)
+{
+    poster_writer *poster = (poster_writer *) arguments;
+    const uint32_t *argb;
+    size_t count, pixel;
+    double start;
+    int failed;
+
+    while (1)
+    {
+        pthread_mutex_lock(&poster->lock);
+        start = wall_clock_seconds();
+        while ((poster->written == poster->submitted) && (!poster->closing))
+            pthread_cond_wait(&poster->ready, &poster->lock);
+        poster->write_wait += wall_clock_seconds() - start;
+
+        // Closed with everything written
+        if (poster->written == poster->submitted)
+        {
+            pthread_mutex_unlock(&poster->lock);
+            break;
+        }
+
+        argb = poster->strips[poster->written % POSTER_BUFFERS];
+        count = (size_t) poster->rows[poster->written % POSTER_BUFFERS] * poster->width;
+        failed = poster->failed;
+        pthread_mutex_unlock(&poster->lock);
+
+        // After an error the strips are only given back
+        if (!failed)
+        {
+            for (pixel = 0; pixel < count; pixel++)
+            {
+                poster->rgb[pixel * 3] = (argb[pixel] >> 16) & 0xff;
+                poster->rgb[pixel * 3 + 1] = (argb[pixel] >> 8) & 0xff;
+                poster->rgb[pixel * 3 + 2] = argb[pixel] & 0xff;
+            }
+            failed = (fwrite(poster->rgb, 3, count, poster->file) != count);
+        }
+
+        pthread_mutex_lock(&poster->lock);
+        poster->written++;
+        poster->failed |= failed;
+        pthread_cond_signal(&poster->done);
+        pthread_mutex_unlock(&poster->lock);
+    }
+
+    return NULL;
+}
+
+// Bytes the writer keeps per row of a strip
+size_t poster_row_bytes(int width)
+{
+    return (size_t) width * (POSTER_BUFFERS * sizeof(uint32_t) + 3);
+}
+
+// The PPM header goes out here, the strips must then cover the height
+int poster_open(poster_writer *poster, const char *path, int width, int height, int strip_rows)
+{
+    size_t pixels = (size_t) width * strip_rows;
+    int count;
+
+    poster->path = path;
+    poster->width = width;
+    poster->height = height;
+    poster->strip_rows = strip_rows;
+    poster->submitted = 0;
+    poster->written = 0;
+    poster->closing = 0;
+    poster->failed = 0;
+    poster->render_wait = 0.0;
+    poster->write_wait = 0.0;
+
+    poster->rgb = malloc(pixels * 3);
+    for (count = 0; count < POSTER_BUFFERS; count++)
+        poster->strips[count] = malloc(pixels * sizeof(uint32_t));
+    for (count = 0; count < POSTER_BUFFERS; count++)
+    {
+        if ((poster->strips[count] == NULL) || (poster->rgb == NULL))
+        {
+            fprintf(stderr, "Bad luck, out of memory\n");
+            return 2;
+        }
+    }
+
+    poster->file = fopen(path, "wb");
+    if (poster->file == NULL)
+    {
+        fprintf(stderr, "Could not open %s for writing\n", path);
+        return 1;
+    }
+    setvbuf(poster->file, NULL, _IONBF, 0);
+    fprintf(poster->file, "P6\n%d %d\n255\n", width, height);
+
+    pthread_mutex_init(&poster->lock, NULL);
+    pthread_cond_init(&poster->ready, NULL);
+    pthread_cond_init(&poster->done, NULL);
+    if (pthread_create(&poster->thread, NULL, poster_main, (void *) poster) != 0)
+    {
+        fprintf(stderr, "Error creating the writer thread\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+// Buffer for the next strip, strip_rows rows of width pixels. Waits while
+// all of them are still to be written. NULL once a write failed.
+uint32_t *poster_strip(poster_writer *poster)
+{
+    uint32_t *strip;
+    double start;
+
+    pthread_mutex_lock(&poster->lock);
+    start = wall_clock_seconds();
+    while ((poster->submitted - poster->written >= POSTER_BUFFERS) && (!poster->failed))
+        pthread_cond_wait(&poster->done, &poster->lock);
+    poster->render_wait += wall_clock_seconds() - start;
+
+    strip = poster->failed ? NULL : poster->strips[poster->submitted % POSTER_BUFFERS];
+    pthread_mutex_unlock(&poster->lock);
+
+    return strip;
+}
+
+// Hands the strip from poster_strip to the writer, rows of it are written
+void poster_submit(poster_writer *poster, int rows)
+{
+    pthread_mutex_lock(&poster->lock);
+    poster->rows[poster->submitted % POSTER_BUFFERS] = rows;
+    poster->submitted++;
+    pthread_cond_signal(&poster->ready);
+    pthread_mutex_unlock(&poster->lock);
+}
+
+// Waits for the strips left, returns 1 when the file could not be written
+int poster_close(poster_writer *poster)
+{
+    int count;
+
+    pthread_mutex_lock(&poster->lock);
+    poster->closing = 1;
+    pthread_cond_signal(&poster->ready);
+    pthread_mutex_unlock(&poster->lock);
+
+    if (pthread_join(poster->thread, NULL) != 0)
+        printf("Error in the writer thread\n");
+
+    if (fclose(poster->file) != 0)
+        poster->failed = 1;
+    if (poster->failed)
+        fprintf(stderr, "Could not write %s\n", poster->path);
+
+    pthread_cond_destroy(&poster->done);
+    pthread_cond_destroy(&poster->ready);
+    pthread_mutex_destroy(&poster->lock);
+    for (count = 0; count < POSTER_BUFFERS; count++)
+        free(poster->strips[count]);
+    free(poster->rgb);
+
+    return poster->failed;
+}
+
+void poster_report(const poster_writer *poster, FILE *stream)
+{
+    fprintf(stream, "Poster: %d strips of %d rows, rendering waited %0.2f s for the writer, the writer %0.2f s for strips\n",
+            poster->written, poster->strip_rows, poster->render_wait, poster->write_wait);
+}
@@ -0,0 +1,53 @@
+#ifndef POSTER_H
+#define POSTER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+// Strips in flight between the renderer and the writer: one being
+// rendered, one being written and one ready for either
+#define POSTER_BUFFERS 3
+
+// Writes an image too large to keep in memory as a PPM, strip by strip
+// from the top. The renderer colors a strip into the buffer poster_strip
+// gives and hands it back with poster_submit; a thread of its own turns
+// it into RGB and appends it to the file while the next strips render.
+// Only POSTER_BUFFERS strips exist, the renderer waits for the writer
+// when it gets that far ahead.
+typedef struct poster_writer poster_writer;
+struct poster_writer
+{
+    FILE *file;
+    const char *path;
+    int width;
+    int height;
+    int strip_rows;
+    uint32_t *strips[POSTER_BUFFERS];
+    int rows[POSTER_BUFFERS];
+    unsigned char *rgb;
+
+    // Strips handed over and strips written, the buffer of strip n is
+    // strips[n % POSTER_BUFFERS]
+    int submitted;
+    int written;
+    int closing;
+    int failed;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t done;
+
+    // Seconds each side spent waiting for the other
+    double render_wait;
+    double write_wait;
+};
+
+size_t poster_row_bytes(int width);
+int poster_open(poster_writer *poster, const char *path, int width, int height, int strip_rows);
+uint32_t *poster_strip(poster_writer *poster);
+void poster_submit(poster_writer *poster, int rows);
+int poster_close(poster_writer *poster);
+void poster_report(const poster_writer *poster, FILE *stream);
+
+#endif
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "progressive.h"
+
+int progressive_init(progressive_image *image, int res_x, int res_y)
+{
+    image->res_x = res_x;
+    image->res_y = res_y;
+    image->zoom = 0.0;
+    image->center_x = 0.0;
+    image->center_y = 0.0;
+    image->shown = calloc(res_x * res_y, sizeof(int));
+    image->moved = malloc(res_x * res_y * sizeof(int));
+    image->coarseness = malloc(res_x * res_y);
+    image->moved_coarseness = malloc(res_x * res_y);
+    image->columns = malloc(res_x * sizeof(int));
+
+    if ((image->shown == NULL) || (image->moved == NULL) || (image->coarseness == NULL) ||
+        (image->moved_coarseness == NULL) || (image->columns == NULL))
+    {
+        fprintf(stderr, "Bad luck, out of memory\n");
+        return 2;
+    }
+
+    progressive_forget(image);
+    return 0;
+}
+
+// Spreads the samples of a pass over the image, each one covers the
+// step x step block right and below it
+void progressive_fill(progressive_image *image, const int *samples, int step)
+{
+    const int *line;
+    int x, y, pixel;
+
+    if (step == 1)
+    {
+        memcpy(image->shown, samples, image->res_x * image->res_y * sizeof(int));
+        memset(image->coarseness, 1, image->res_x * image->res_y);
+        return;
+    }
+
+    for (y = 0; y < image->res_y; y++)
+    {
+        line = &samples[(y - y % step) * image->res_x];
+        pixel = y * image->res_x;
+        for (x = 0; x < image->res_x; x++, pixel++)
+        {
+            if (image->coarseness[pixel] >= step)
+            {
+                image->shown[pixel] = line[x - x % step];
+                image->coarseness[pixel] = step;
+            }
+        }
+    }
+}
+
+// Takes a rectangle of a frame computed at every pixel
+void progressive_copy(progressive_image *image, const int *samples, int x, int y, int width, int height)
+{
+    int row, first;
+
+    for (row = y; row < y + height; row++)
+    {
+        first = x + row * image->res_x;
+        memcpy(&image->shown[first], &samples[first], width * sizeof(int));
+        memset(&image->coarseness[first], 1, width);
+    }
+}
+
+// Pixel (x, y) of the moved image takes pixel (x * scale + shift_x,
+// y * scale + shift_y) of the one on screen, the nearest one. Out of it
+// the border is stretched, but unknown.
+static void progressive_move(progressive_image *image, double scale, double shift_x, double shift_y, int resampled)
+{
+    unsigned char *old_coarseness, coarseness;
+    int *old, *swap;
+    int x, y, old_y, inside_y, pixel, source;
+    unsigned char *swap_coarseness;
+
+    old = image->shown;
+    old_coarseness = image->coarseness;
+
+    // Columns out of the old image are negative, -1 - the nearest one
+    for (x = 0; x < image->res_x; x++)
+    {
+        image->columns[x] = (int) floor(x * scale + shift_x + 0.5);
+        if (image->columns[x] < 0)
+            image->columns[x] = -1;
+        else if (image->columns[x] >= image->res_x)
+            image->columns[x] = -image->res_x;
+    }
+
+    for (y = 0; y < image->res_y; y++)
+    {
+        old_y = (int) floor(y * scale + shift_y + 0.5);
+        inside_y = (old_y >= 0) && (old_y < image->res_y);
+        if (old_y < 0)
+            old_y = 0;
+        else if (old_y >= image->res_y)
+            old_y = image->res_y - 1;
+
+        pixel = y * image->res_x;
+        for (x = 0; x < image->res_x; x++, pixel++)
+        {
+            source = image->columns[x];
+            if (inside_y && (source >= 0))
+            {
+                source += old_y * image->res_x;
+                coarseness = old_coarseness[source];
+
+                // A resampled pixel is worth a pass coarser than its own
+                if (resampled)
+                    coarseness = (coarseness >= PROGRESSIVE_UNKNOWN / 2) ? PROGRESSIVE_UNKNOWN : coarseness * 2;
+            }
+            else
+            {
+                source = ((source >= 0) ? source : -1 - source) + old_y * image->res_x;
+                coarseness = PROGRESSIVE_UNKNOWN;
+            }
+
+            image->moved[pixel] = old[source];
+            image->moved_coarseness[pixel] = coarseness;
+        }
+    }
+
+    swap = image->shown;
+    image->shown = image->moved;
+    image->moved = swap;
+    swap_coarseness = image->coarseness;
+    image->coarseness = image->moved_coarseness;
+    image->moved_coarseness = swap_coarseness;
+}
+
+// A pan by whole pixels to the view at center: pixel (x, y) of it is
+// pixel (x + shift_x, y + shift_y) of the old one, kept as it is
+void progressive_shift(progressive_image *image, int shift_x, int shift_y, float center_x, float center_y)
+{
+    progressive_move(image, 1.0, shift_x, shift_y, 0);
+    image->center_x = center_x;
+    image->center_y = center_y;
+}
+
+// Any other move of a Mandelbrot view, the image on screen becomes an
+// estimate of the new one. Same mapping as the kernel: the top left
+// corner is at -center and the frame is 3.5 * zoom by 2.0 * zoom.
+void progressive_zoom(progressive_image *image, float zoom, float center_x, float center_y)
+{
+    double scale, shift_x, shift_y;
+
+    if ((zoom == image->zoom) && (center_x == image->center_x) && (center_y == image->center_y))
+        return;
+
+    if (image->zoom > 0.0)
+    {
+        scale = zoom / image->zoom;
+        shift_x = (image->center_x - center_x) * image->res_x / (3.5 * image->zoom);
+        shift_y = (image->center_y - center_y) * image->res_y / (2.0 * image->zoom);
+        progressive_move(image, scale, shift_x, shift_y, 1);
+    }
+    else
+        progressive_forget(image);
+
+    image->zoom = zoom;
+    image->center_x = center_x;
+    image->center_y = center_y;
+}
+
+// Nothing on screen belongs to the next view, the next pass replaces it
+// all. The iterations stay until then.
+void progressive_forget(progressive_image *image)
+{
+    memset(image->coarseness, PROGRESSIVE_UNKNOWN, image->res_x * image->res_y);
+}
+
+void progressive_release(progressive_image *image)
+{
+    free(image->shown);
+    free(image->moved);
+    free(image->coarseness);
+    free(image->moved_coarseness);
+    free(image->columns);
+}
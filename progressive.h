@@ -0,0 +1,41 @@
+#ifndef PROGRESSIVE_H
+#define PROGRESSIVE_H
+
+// Views are computed a pass at a time: first one sample every
+// PROGRESSIVE_STEP pixels across and down, then the step halves down to
+// every pixel. A pass keeps the samples of the one before.
+#define PROGRESSIVE_STEP 4
+
+// Coarseness of a pixel nothing is known about, any pass replaces it
+#define PROGRESSIVE_UNKNOWN (PROGRESSIVE_STEP * 2)
+
+// What is on screen in the interactive viewer: the iterations of each
+// pixel, how coarse they are (the step of the pass they come from) and
+// the view they belong to. When the view moves what is still visible is
+// kept, and a pass only replaces pixels as coarse as it or worse.
+typedef struct progressive_image progressive_image;
+struct progressive_image
+{
+    int res_x;
+    int res_y;
+    int *shown;
+    unsigned char *coarseness;
+    float zoom;
+    float center_x;
+    float center_y;
+
+    // The next image while moving
+    int *moved;
+    unsigned char *moved_coarseness;
+    int *columns;
+};
+
+int progressive_init(progressive_image *image, int res_x, int res_y);
+void progressive_fill(progressive_image *image, const int *samples, int step);
+void progressive_copy(progressive_image *image, const int *samples, int x, int y, int width, int height);
+void progressive_shift(progressive_image *image, int shift_x, int shift_y, float center_x, float center_y);
+void progressive_zoom(progressive_image *image, float zoom, float center_x, float center_y);
+void progressive_forget(progressive_image *image);
+void progressive_release(progressive_image *image);
+
+#endif
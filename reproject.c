@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "reproject.h"
+
+// Past this scale change between two frames the old pixels are too
+// coarse (or too many per new pixel) to be worth looking at
+#define REPROJECT_MAX_RATIO 4.0
+
+int reproject_init(reproject *reuse, int res_x, int res_y, int refresh)
+{
+    reuse->res_x = res_x;
+    reuse->res_y = res_y;
+    reuse->refresh = refresh;
+    reuse->previous = malloc(res_x * res_y * sizeof(int));
+    reuse->stale = malloc(res_x * res_y);
+    reuse->old_x = malloc(res_x * sizeof(int));
+    reuse->old_y = malloc(res_y * sizeof(int));
+    reuse->across = malloc(res_x * res_y);
+    reuse->uniform = malloc(res_x * res_y);
+    reuse->max_iteration = 0;
+    reuse->age = 0;
+    reuse->active = 0;
+    reuse->radius = 1;
+    reuse->reused = 0;
+    reuse->computed = 0;
+
+    if ((reuse->previous == NULL) || (reuse->stale == NULL) || (reuse->old_x == NULL) ||
+        (reuse->old_y == NULL) || (reuse->across == NULL) || (reuse->uniform == NULL))
+    {
+        fprintf(stderr, "Bad luck, out of memory\n");
+        return 2;
+    }
+
+    return 0;
+}
+
+// Nearest old pixel of every new column (or row), -1 when it is too close
+// to the old border to look around it
+static void reproject_map(int *old, int size, double next_origin, double next_step,
+                          double origin, double step, int radius)
+{
+    int count, nearest;
+    double first = (next_origin - origin) / step + 0.5;
+    double ratio = next_step / step;
+
+    for (count = 0; count < size; count++)
+    {
+        nearest = (int) floor(first + count * ratio);
+        old[count] = ((nearest >= radius) && (nearest < size - radius)) ? nearest : -1;
+    }
+}
+
+// Marks the old pixels whose whole (2 * radius + 1) square is one value.
+// Done in two passes, along the rows and then down the columns.
+static void reproject_uniform(reproject *reuse)
+{
+    int x, y, k, same, value;
+    int res_x = reuse->res_x, res_y = reuse->res_y, radius = reuse->radius;
+    const int *line;
+
+    memset(reuse->across, 0, res_x * res_y);
+    memset(reuse->uniform, 0, res_x * res_y);
+
+    for (y = 0; y < res_y; y++)
+    {
+        line = &reuse->previous[y * res_x];
+        for (x = radius; x < res_x - radius; x++)
+        {
+            same = 1;
+            for (k = 1; k <= radius; k++)
+                same &= (line[x - k] == line[x]) & (line[x + k] == line[x]);
+            reuse->across[x + y * res_x] = same;
+        }
+    }
+
+    for (y = radius; y < res_y - radius; y++)
+    {
+        for (x = radius; x < res_x - radius; x++)
+        {
+            value = reuse->previous[x + y * res_x];
+            same = reuse->across[x + y * res_x];
+            for (k = 1; k <= radius; k++)
+                same &= reuse->across[x + (y - k) * res_x] & reuse->across[x + (y + k) * res_x] &
+                        (reuse->previous[x + (y - k) * res_x] == value) &
+                        (reuse->previous[x + (y + k) * res_x] == value);
+            reuse->uniform[x + y * res_x] = same;
+        }
+    }
+}
+
+// Decides if the next frame can be taken from the previous one. It can't
+// for the first frame, every refresh frames or when the iteration limit
+// or the scale changed too much. Returns 1 if it can.
+int reproject_begin(reproject *reuse, const reproject_view *view, int max_iteration)
+{
+    double ratio = 1.0;
+
+    if (reuse->age > 0)
+    {
+        ratio = view->step_x / reuse->view.step_x;
+        if (view->step_y / reuse->view.step_y > ratio)
+            ratio = view->step_y / reuse->view.step_y;
+    }
+
+    reuse->next = *view;
+    reuse->active = (reuse->age > 0) && (reuse->age < reuse->refresh) &&
+                    (max_iteration == reuse->max_iteration) &&
+                    (ratio < REPROJECT_MAX_RATIO) && (ratio > 1.0 / REPROJECT_MAX_RATIO);
+    reuse->max_iteration = max_iteration;
+
+    if (!reuse->active)
+        return 0;
+
+    // When zooming out a new pixel covers more than one old pixel, all of
+    // them have to agree
+    reuse->radius = (ratio > 1.0) ? (int) ceil(ratio) : 1;
+
+    reproject_map(reuse->old_x, reuse->res_x, view->origin_x, view->step_x,
+                  reuse->view.origin_x, reuse->view.step_x, reuse->radius);
+    reproject_map(reuse->old_y, reuse->res_y, view->origin_y, view->step_y,
+                  reuse->view.origin_y, reuse->view.step_y, reuse->radius);
+    reproject_uniform(reuse);
+
+    return 1;
+}
+
+// Fills a run of pixels of a new frame row with the old values that can
+// be trusted. The indices (from image_x) of those that have to be computed
+// go to stale_x, returns how many they are.
+int reproject_row(reproject *reuse, int image_y, int image_x, int width, int *out, int *stale_x)
+{
+    int count, stale, old_x, old_y, old;
+    unsigned char *mark = &reuse->stale[image_x + image_y * reuse->res_x];
+
+    old_y = reuse->old_y[image_y];
+    if (!reuse->active || (old_y < 0))
+    {
+        for (count = 0; count < width; count++)
+        {
+            stale_x[count] = count;
+            mark[count] = 1;
+        }
+        return width;
+    }
+
+    stale = 0;
+    for (count = 0; count < width; count++)
+    {
+        old_x = reuse->old_x[image_x + count];
+        old = old_x + old_y * reuse->res_x;
+
+        if ((old_x >= 0) && reuse->uniform[old])
+        {
+            out[count] = reuse->previous[old];
+            mark[count] = 0;
+        }
+        else
+        {
+            stale_x[stale++] = count;
+            mark[count] = 1;
+        }
+    }
+
+    return stale;
+}
+
+// The frame is complete, it becomes the one the next frame reprojects
+void reproject_end(reproject *reuse, frame_buffer *frame, worker_pool *pool)
+{
+    int count, total = reuse->res_x * reuse->res_y;
+    unsigned long stale = 0;
+
+    for (count = 0; count < total; count++)
+        stale += reuse->stale[count];
+
+    reuse->computed += stale;
+    reuse->reused += total - stale;
+    reuse->age = reuse->active ? reuse->age + 1 : 1;
+    reuse->view = reuse->next;
+    frame_buffer_linearize(frame, reuse->previous, pool);
+}
+
+void reproject_release(reproject *reuse)
+{
+    free(reuse->previous);
+    free(reuse->stale);
+    free(reuse->old_x);
+    free(reuse->old_y);
+    free(reuse->across);
+    free(reuse->uniform);
+}
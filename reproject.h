@@ -0,0 +1,56 @@
+#ifndef REPROJECT_H
+#define REPROJECT_H
+
+#include "frame_buffer.h"
+
+// Where the pixels of a frame fall in the complex plane, pixel (i, j) is
+// at (origin_x + i * step_x, origin_y + j * step_y)
+typedef struct reproject_view reproject_view;
+struct reproject_view
+{
+    double origin_x;
+    double origin_y;
+    double step_x;
+    double step_y;
+};
+
+// Reuse of the previous frame of a zoom animation. A pixel of the new
+// frame takes the value of the old pixel it lands on when all the old
+// pixels around it agree, the others (edges of iteration bands, newly
+// exposed borders) are computed again. Every refresh frames everything is
+// computed, so the copied values cannot drift too far.
+typedef struct reproject reproject;
+struct reproject
+{
+    int res_x;
+    int res_y;
+    int refresh;
+    int *previous;
+    unsigned char *stale;
+
+    // Set up by reproject_begin. The old column and row every new one
+    // lands on (-1 if it is out), and the old pixels with all their
+    // neighbours within radius at the same value.
+    int *old_x;
+    int *old_y;
+    unsigned char *across;
+    unsigned char *uniform;
+    reproject_view view;
+    reproject_view next;
+    int max_iteration;
+    int age;
+    int active;
+    int radius;
+
+    // Statistics of the whole animation
+    unsigned long reused;
+    unsigned long computed;
+};
+
+int reproject_init(reproject *reuse, int res_x, int res_y, int refresh);
+int reproject_begin(reproject *reuse, const reproject_view *view, int max_iteration);
+int reproject_row(reproject *reuse, int image_y, int image_x, int width, int *out, int *stale_x);
+void reproject_end(reproject *reuse, frame_buffer *frame, worker_pool *pool);
+void reproject_release(reproject *reuse);
+
+#endif
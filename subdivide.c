@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "subdivide.h"
+#include "tile_queue.h"
+
+// State of one tile. Pixels already iterated are marked in known, so the
+// lines two rectangles share are only done once.
+typedef struct subdivide_state subdivide_state;
+struct subdivide_state
+{
+    const escape_job *job;
+    escape_tile_fn kernel;
+    unsigned char known[TILE_SIZE * TILE_SIZE];
+
+    // Pixels waiting to be iterated, as one list of points
+    int pending;
+    int where[TILE_SIZE * TILE_SIZE];
+    float pos_x[TILE_SIZE * TILE_SIZE];
+    float pos_y[TILE_SIZE * TILE_SIZE];
+    int found[TILE_SIZE * TILE_SIZE];
+    unsigned char fraction[TILE_SIZE * TILE_SIZE];
+};
+
+static inline void subdivide_want(subdivide_state *state, int x, int y)
+{
+    int pixel = x + y * TILE_SIZE;
+
+    if (state->known[pixel])
+        return;
+
+    state->known[pixel] = 1;
+    state->where[state->pending] = x + y * state->job->stride;
+    state->pos_x[state->pending] = state->job->pos_x[x];
+    state->pos_y[state->pending] = state->job->pos_y[y];
+    state->pending++;
+}
+
+// Iterates the pixels asked for since the last call in a single kernel run
+static void subdivide_flush(subdivide_state *state)
+{
+    escape_job points;
+    int count;
+
+    if (state->pending == 0)
+        return;
+
+    points = *state->job;
+    points.out = state->found;
+    points.fraction = (state->job->fraction != NULL) ? state->fraction : NULL;
+    points.stride = state->pending;
+    points.pos_x = state->pos_x;
+    points.width = state->pending;
+    points.pos_y = state->pos_y;
+    points.height = 1;
+    points.paired = 1;
+
+    state->kernel(&points);
+
+    for (count = 0; count < state->pending; count++)
+        state->job->out[state->where[count]] = state->found[count];
+    if (points.fraction != NULL)
+    {
+        for (count = 0; count < state->pending; count++)
+            state->job->fraction[state->where[count]] = state->fraction[count];
+    }
+    state->pending = 0;
+}
+
+// Rectangle from (x0, y0) to (x1, y1), both corners included
+typedef struct rectangle rectangle;
+struct rectangle
+{
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+};
+
+// A tile of side n never has more than (n / SUBDIVIDE_MIN_SIDE)^2 parts
+#define SUBDIVIDE_MAX_PARTS ((TILE_SIZE / SUBDIVIDE_MIN_SIDE) * (TILE_SIZE / SUBDIVIDE_MIN_SIDE))
+
+static inline void subdivide_part(rectangle *part, int x0, int y0, int x1, int y1)
+{
+    part->x0 = x0;
+    part->y0 = y0;
+    part->x1 = x1;
+    part->y1 = y1;
+}
+
+static int subdivide_same(const escape_job *job, const rectangle *part)
+{
+    int x, y, same, value;
+
+    value = job->out[part->x0 + part->y0 * job->stride];
+
+    // With fractions only the inside of the set is flat, escaped bands
+    // are always iterated
+    if ((job->fraction != NULL) && (value != 0))
+        return 0;
+
+    same = 1;
+    for (x = part->x0; x <= part->x1; x++)
+        same &= (job->out[x + part->y0 * job->stride] == value) & (job->out[x + part->y1 * job->stride] == value);
+    for (y = part->y0 + 1; y < part->y1; y++)
+        same &= (job->out[part->x0 + y * job->stride] == value) & (job->out[part->x1 + y * job->stride] == value);
+
+    return same;
+}
+
+// The rectangles are handled a level at a time, so the borders of all the
+// parts of a level (and the insides too small to split) go to the kernel
+// together and keep its lanes busy
+static void subdivide_levels(subdivide_state *state, rectangle *parts, rectangle *next)
+{
+    const escape_job *job = state->job;
+    int number_parts = 1, number_next, count, x, y, middle_x, middle_y, value;
+    rectangle *part, *swap;
+    int *line;
+
+    while (number_parts > 0)
+    {
+        for (count = 0; count < number_parts; count++)
+        {
+            part = &parts[count];
+            for (x = part->x0; x <= part->x1; x++)
+            {
+                subdivide_want(state, x, part->y0);
+                subdivide_want(state, x, part->y1);
+            }
+            for (y = part->y0 + 1; y < part->y1; y++)
+            {
+                subdivide_want(state, part->x0, y);
+                subdivide_want(state, part->x1, y);
+            }
+        }
+        subdivide_flush(state);
+
+        number_next = 0;
+        for (count = 0; count < number_parts; count++)
+        {
+            part = &parts[count];
+
+            // Nothing inside
+            if ((part->x1 - part->x0 < 2) || (part->y1 - part->y0 < 2))
+                continue;
+
+            if (subdivide_same(job, part))
+            {
+                value = job->out[part->x0 + part->y0 * job->stride];
+                for (y = part->y0 + 1; y < part->y1; y++)
+                {
+                    line = &job->out[y * job->stride];
+                    for (x = part->x0 + 1; x < part->x1; x++)
+                    {
+                        line[x] = value;
+                        state->known[x + y * TILE_SIZE] = 1;
+                    }
+                    if (job->fraction != NULL)
+                        memset(&job->fraction[part->x0 + 1 + y * job->stride], 0, part->x1 - part->x0 - 1);
+                }
+            }
+            else if ((part->x1 - part->x0 - 1 <= SUBDIVIDE_MIN_SIDE) || (part->y1 - part->y0 - 1 <= SUBDIVIDE_MIN_SIDE) ||
+                     (number_next + 4 > SUBDIVIDE_MAX_PARTS))
+            {
+                for (y = part->y0 + 1; y < part->y1; y++)
+                    for (x = part->x0 + 1; x < part->x1; x++)
+                        subdivide_want(state, x, y);
+            }
+            else
+            {
+                // The four parts share the middle lines
+                middle_x = (part->x0 + part->x1) / 2;
+                middle_y = (part->y0 + part->y1) / 2;
+                subdivide_part(&next[number_next++], part->x0, part->y0, middle_x, middle_y);
+                subdivide_part(&next[number_next++], middle_x, part->y0, part->x1, middle_y);
+                subdivide_part(&next[number_next++], part->x0, middle_y, middle_x, part->y1);
+                subdivide_part(&next[number_next++], middle_x, middle_y, part->x1, part->y1);
+            }
+        }
+        subdivide_flush(state);
+
+        swap = parts;
+        parts = next;
+        next = swap;
+        number_parts = number_next;
+    }
+}
+
+void subdivide_tile(const escape_job *job, escape_tile_fn kernel)
+{
+    subdivide_state state;
+    rectangle parts[SUBDIVIDE_MAX_PARTS], next[SUBDIVIDE_MAX_PARTS];
+
+    if ((job->width > TILE_SIZE) || (job->height > TILE_SIZE) || job->paired)
+    {
+        kernel(job);
+        return;
+    }
+
+    state.job = job;
+    state.kernel = kernel;
+    state.pending = 0;
+    memset(state.known, 0, sizeof(state.known));
+
+    subdivide_part(&parts[0], 0, 0, job->width - 1, job->height - 1);
+    subdivide_levels(&state, parts, next);
+}
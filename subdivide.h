@@ -0,0 +1,17 @@
+#ifndef SUBDIVIDE_H
+#define SUBDIVIDE_H
+
+#include "escape_kernel.h"
+
+// Rectangles whose inside is this many pixels or less across are
+// iterated pixel by pixel instead of split again
+#define SUBDIVIDE_MIN_SIDE 4
+
+// Mariani-Silver over a tile job: the border of a rectangle is iterated,
+// when it has a single value the inside is filled with it, otherwise the
+// rectangle is cut in four and each part is checked the same way. Jobs
+// bigger than a tile go straight to the kernel. Jobs with fractions only
+// fill the inside of the set.
+void subdivide_tile(const escape_job *job, escape_tile_fn kernel);
+
+#endif
@@ -4,14 +4,13 @@
 
 #include <SDL.h>
 
+#include "orbit_cache.h"
+#include "fractal_engine.h"
+
 #define MAX_SOURCE_SIZE (0x100000)
 
 
-#ifdef CACHE
-int** cached_points;
-int** cached_x;
-int** cached_y;
-#endif
+orbit_cache *cache;
 
 int get_x (int linear_point, int width) 
 {
@@ -37,61 +36,6 @@ double map_y(int y, int height, double zoom)
     return (((double)y / (double)height) * (2.0 * zoom)) - (1.0 - (1.0 - zoom));
 }
 
-#ifdef CACHE
-int cached_iteration(double pos_x, double pos_y)
-{
-    double centered_x = pos_x + 2.5;
-    double centered_y = pos_y + 1.0;
-    double temp_x = floor(centered_x * 1000.0);
-    double temp_y = floor(centered_y * 1000.0);
-
-    int trs_pos_x = (int)temp_x;
-    int trs_pos_y = (int)temp_y;
-
-    return cached_points[trs_pos_x][trs_pos_y];
-}
-
-double get_cached_x(double pos_x, double pos_y)
-{
-    double centered_x = pos_x + 2.5;
-    double centered_y = pos_y + 1.0;
-    double temp_x = floor(centered_x * 1000.0);
-    double temp_y = floor(centered_y * 1000.0);
-
-    int trs_pos_x = (int)temp_x;
-    int trs_pos_y = (int)temp_y;
-
-    return cached_x[trs_pos_x][trs_pos_y];
-}
-
-double get_cached_y(double pos_x, double pos_y)
-{
-    double centered_x = pos_x + 2.5;
-    double centered_y = pos_y + 1.0;
-    double temp_x = floor(centered_x * 1000.0);
-    double temp_y = floor(centered_y * 1000.0);
-
-    int trs_pos_x = (int)temp_x;
-    int trs_pos_y = (int)temp_y;
-
-    return cached_y[trs_pos_x][trs_pos_y];
-}
-
-void store_iteration(double pos_x, double pos_y, int iteration, double x, double y)
-{
-    double centered_x = pos_x + 2.5;
-    double centered_y = pos_y + 1.0;
-    double temp_x = floor(centered_x * 1000.0);
-    double temp_y = floor(centered_y * 1000.0);
-
-    int trs_pos_x = (int)temp_x;
-    int trs_pos_y = (int)temp_y;
-
-    cached_points[trs_pos_x][trs_pos_y] = iteration;
-    cached_x[trs_pos_x][trs_pos_y] = x;
-    cached_y[trs_pos_x][trs_pos_y] = y;
-}
-#endif
 
 int mandelbrot_point(int res_x, int res_y, int image_x, int image_y, double zoom, int max_iteration)
 {
@@ -105,36 +49,35 @@ int julia_point(int res_x, int res_y, int image_x, int image_y, double zoom, int
     double pos_y = map_y(image_y, res_y, 1.0);
     double x = pos_x;
     double y = pos_y;
-    double xtemp, xx, yy;
-#ifdef CACHE
-    int storeable = 1;
-#endif
     int iteration = 0;
-
-#ifdef CACHE
-    // Look up our cache
-    iteration = cached_iteration(pos_x, pos_y);
-
-    if (iteration > 0)
+    orbit_key key;
+    orbit_state state;
+
+    // Look up our cache, resuming the orbit if it did not escape yet
+    key.pos_x = pos_x;
+    key.pos_y = pos_y;
+    key.julia_x = 0.353 + zoom;
+    key.julia_y = 0.288;
+    key.julia = 1;
+    if ((cache != NULL) && orbit_cache_lookup(cache, &key, &state))
     {
-        x = get_cached_x(pos_x, pos_y);
-        y = get_cached_y(pos_x, pos_y);
-        yy = y * y;
+        if (state.escaped || (state.iteration >= max_iteration))
+            return (state.escaped && (state.iteration < max_iteration)) ? state.iteration : 0;
+
+        x = state.x;
+        y = state.y;
+        iteration = state.iteration;
     }
-    if (iteration < 0) storeable = 0;
-#endif
 
-    while (iteration < max_iteration)
+    iteration = fractal_escape_double(2, 0, &x, &y, 0.353 + zoom, 0.288, iteration, max_iteration);
+
+    if (cache != NULL)
     {
-        xx = x * x;
-        yy = y * y;
-        if ((xx) + (yy) > (4.0)) break;
-        y = pow((x + y), 2) - xx - yy;
-        y = y + 0.288;
-        xtemp = xx - yy + 0.353 + zoom;
-
-        x = xtemp;
-        iteration++;
+        state.x = x;
+        state.y = y;
+        state.iteration = iteration;
+        state.escaped = (iteration < max_iteration);
+        orbit_cache_store(cache, &key, &state);
     }
 
     if (iteration >= max_iteration)
@@ -143,12 +86,6 @@ int julia_point(int res_x, int res_y, int image_x, int image_y, double zoom, int
     }
     else
     {
-#ifdef CACHE
-        if (storeable == 1)
-        {
-            store_iteration(pos_x, pos_y, iteration, x, y);
-        }
-#endif
         return iteration;
     }
 }
@@ -165,37 +102,16 @@ int main(int argn, char **argv) {
     int res_x = 800;
     int res_y = 600;
 
-#ifdef CACHE
-    // Init our cached points
-    cached_points = malloc(res_y * 1000 * sizeof(int *));
-    cached_x = malloc(res_y * 1000 * sizeof(double *));
-    cached_y = malloc(res_y * 1000 * sizeof(double *));
-    if (cached_points == NULL)
+    // -cache MB keeps the orbits of the points already computed
+    orbit_cache orbits;
+    if ((argn == 3) && (strcmp(argv[1], "-cache") == 0))
     {
-        fprintf(stderr, "Bad luck, out of memory\n");
-        return 2;
-    }
-
-    int count;
-    for (count = 0; count < res_y * 1000; count++)
-    {
-        cached_points[count] = malloc(res_x * 1000 * sizeof(int));
-        if(cached_points[count] == NULL)
-        {
-            fprintf(stderr, "Bad luck, out of memory\n");
+        if (orbit_cache_init(&orbits, (size_t) atoi(argv[2]) << 20) != 0)
             return 2;
-        }
-        cached_x[count] = malloc(res_x * 1000 * sizeof(double));
-        cached_y[count] = malloc(res_x * 1000 * sizeof(double));
-        /*for (count2 = 0; count2 < res_x * 100; count2++)
-        {
-            cached_points[count][count2] = -1;
-        }*/
+        cache = &orbits;
+        printf("Cache ready\n");
     }
 
-    printf("Cache ready\n");
-#endif
-
     // screen = SDL_SetVideoMode(res_x, res_y, 0, SDL_HWSURFACE|SDL_DOUBLEBUF);
     screen = SDL_SetVideoMode(res_x, res_y, 0, SDL_DOUBLEBUF);
     if(!screen)
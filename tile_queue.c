@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tile_queue.h"
+
+// Cuts the image in tiles. The ones on the right and bottom edges get
+// whatever is left, so every pixel belongs to exactly one tile.
+int tile_queue_init(tile_queue *queue, int res_x, int res_y, int tile_size, int number_deques)
+{
+    int x, y, count;
+    int tiles_x = (res_x + tile_size - 1) / tile_size;
+    int tiles_y = (res_y + tile_size - 1) / tile_size;
+
+    if (number_deques < 1)
+        number_deques = 1;
+
+    queue->res_x = res_x;
+    queue->res_y = res_y;
+    queue->number_tiles = tiles_x * tiles_y;
+    queue->number_deques = number_deques;
+    queue->tiles = malloc(queue->number_tiles * sizeof(tile));
+    queue->deques = malloc(number_deques * sizeof(tile_deque));
+
+    if ((queue->tiles == NULL) || (queue->deques == NULL))
+    {
+        fprintf(stderr, "Bad luck, out of memory\n");
+        return 2;
+    }
+
+    count = 0;
+    for (y = 0; y < res_y; y += tile_size)
+    {
+        for (x = 0; x < res_x; x += tile_size)
+        {
+            queue->tiles[count].x = x;
+            queue->tiles[count].y = y;
+            queue->tiles[count].width = (x + tile_size > res_x) ? res_x - x : tile_size;
+            queue->tiles[count].height = (y + tile_size > res_y) ? res_y - y : tile_size;
+            count++;
+        }
+    }
+
+    for (count = 0; count < number_deques; count++)
+    {
+        pthread_mutex_init(&queue->deques[count].lock, NULL);
+        queue->deques[count].items = malloc(queue->number_tiles * sizeof(int));
+        if (queue->deques[count].items == NULL)
+        {
+            fprintf(stderr, "Bad luck, out of memory\n");
+            return 2;
+        }
+        queue->deques[count].head = 0;
+        queue->deques[count].tail = 0;
+    }
+
+    return 0;
+}
+
+// Deals a contiguous run of tiles to every deque. Must be called before
+// the workers of a frame start.
+void tile_queue_fill(tile_queue *queue)
+{
+    int count, item, first, last;
+
+    for (count = 0; count < queue->number_deques; count++)
+    {
+        tile_deque *deque = &queue->deques[count];
+        first = (queue->number_tiles * count) / queue->number_deques;
+        last = (queue->number_tiles * (count + 1)) / queue->number_deques;
+
+        pthread_mutex_lock(&deque->lock);
+        deque->head = 0;
+        deque->tail = 0;
+        for (item = first; item < last; item++)
+            deque->items[deque->tail++] = item;
+        pthread_mutex_unlock(&deque->lock);
+    }
+}
+
+// Gives the next tile for a worker: its own newest tile if any, else the
+// oldest tile of the first busy deque found. Returns 0 when the frame is done.
+int tile_queue_next(tile_queue *queue, int worker, tile *next)
+{
+    int count, victim, item;
+    tile_deque *deque;
+
+    worker = worker % queue->number_deques;
+    deque = &queue->deques[worker];
+
+    pthread_mutex_lock(&deque->lock);
+    item = -1;
+    if (deque->tail > deque->head)
+        item = deque->items[--deque->tail];
+    pthread_mutex_unlock(&deque->lock);
+
+    for (count = 1; (item < 0) && (count < queue->number_deques); count++)
+    {
+        victim = (worker + count) % queue->number_deques;
+        deque = &queue->deques[victim];
+
+        pthread_mutex_lock(&deque->lock);
+        if (deque->tail > deque->head)
+            item = deque->items[deque->head++];
+        pthread_mutex_unlock(&deque->lock);
+    }
+
+    if (item < 0)
+        return 0;
+
+    *next = queue->tiles[item];
+    return 1;
+}
+
+void tile_queue_release(tile_queue *queue)
+{
+    int count;
+
+    for (count = 0; count < queue->number_deques; count++)
+    {
+        pthread_mutex_destroy(&queue->deques[count].lock);
+        free(queue->deques[count].items);
+    }
+
+    free(queue->deques);
+    free(queue->tiles);
+}
@@ -0,0 +1,44 @@
+#ifndef TILE_QUEUE_H
+#define TILE_QUEUE_H
+
+#include <pthread.h>
+
+// Side of the square tiles the image is cut into
+#define TILE_SIZE 32
+
+typedef struct tile tile;
+struct tile
+{
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+// One deque per worker. The owner pops from the tail, thieves take from the head.
+typedef struct tile_deque tile_deque;
+struct tile_deque
+{
+    pthread_mutex_t lock;
+    int *items;
+    int head;
+    int tail;
+};
+
+typedef struct tile_queue tile_queue;
+struct tile_queue
+{
+    int res_x;
+    int res_y;
+    tile *tiles;
+    int number_tiles;
+    tile_deque *deques;
+    int number_deques;
+};
+
+int tile_queue_init(tile_queue *queue, int res_x, int res_y, int tile_size, int number_deques);
+void tile_queue_fill(tile_queue *queue);
+int tile_queue_next(tile_queue *queue, int worker, tile *next);
+void tile_queue_release(tile_queue *queue);
+
+#endif
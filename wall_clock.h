@@ -0,0 +1,16 @@
+#ifndef WALL_CLOCK_H
+#define WALL_CLOCK_H
+
+#include <time.h>
+
+// Elapsed real time in seconds. clock() adds up the CPU time of every
+// thread, which makes threaded runs look slower than they are.
+static inline double wall_clock_seconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+#endif
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "worker_pool.h"
+
+typedef struct worker_args worker_args;
+struct worker_args
+{
+    worker_pool *pool;
+    int worker;
+};
+
+// Sleeps until a new frame is posted, then drains the tile queue with it
+static void *worker_main(void *arguments)
+{
+    worker_args *args = (worker_args *) arguments;
+    worker_pool *pool = args->pool;
+    int worker = args->worker;
+    unsigned long seen = 0;
+    pool_job job;
+    void *frame;
+    tile piece;
+
+    free(args);
+
+    while (1)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while ((pool->generation == seen) && (!pool->quit))
+            pthread_cond_wait(&pool->wake, &pool->lock);
+
+        if (pool->quit)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+
+        seen = pool->generation;
+        job = pool->job;
+        frame = pool->frame;
+        pthread_mutex_unlock(&pool->lock);
+
+        while (tile_queue_next(pool->queue, worker, &piece))
+            job(frame, &piece, worker);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->pending--;
+        if (pool->pending == 0)
+            pthread_cond_signal(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return NULL;
+}
+
+// The queue must have been created with one deque per worker
+int worker_pool_init(worker_pool *pool, int number_workers, tile_queue *queue)
+{
+    int count;
+
+    pool->number_workers = number_workers;
+    pool->queue = queue;
+    pool->job = NULL;
+    pool->frame = NULL;
+    pool->generation = 0;
+    pool->pending = 0;
+    pool->quit = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    pool->threads = malloc(number_workers * sizeof(pthread_t));
+    if (pool->threads == NULL)
+    {
+        fprintf(stderr, "Bad luck, out of memory\n");
+        return 2;
+    }
+
+    for (count = 0; count < number_workers; count++)
+    {
+        worker_args *args = malloc(sizeof(worker_args));
+        if (args == NULL)
+        {
+            fprintf(stderr, "Bad luck, out of memory\n");
+            return 2;
+        }
+        args->pool = pool;
+        args->worker = count;
+
+        if (pthread_create(&pool->threads[count], NULL, worker_main, (void *) args) != 0)
+        {
+            fprintf(stderr, "Error creating worker %d\n", count);
+            free(args);
+            pool->number_workers = count;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Hands a frame to the workers and waits until all its tiles are done
+void worker_pool_render(worker_pool *pool, pool_job job, void *frame)
+{
+    tile_queue_fill(pool->queue);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->job = job;
+    pool->frame = frame;
+    pool->pending = pool->number_workers;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+
+    while (pool->pending > 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void worker_pool_release(worker_pool *pool)
+{
+    int count;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (count = 0; count < pool->number_workers; count++)
+    {
+        if (pthread_join(pool->threads[count], NULL) != 0)
+            printf("Error in %d thread\n", count);
+    }
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+}
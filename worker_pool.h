@@ -0,0 +1,31 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <pthread.h>
+
+#include "tile_queue.h"
+
+// Work done for every tile of a frame. worker is the index of the calling thread.
+typedef void (*pool_job)(void *frame, const tile *piece, int worker);
+
+typedef struct worker_pool worker_pool;
+struct worker_pool
+{
+    pthread_t *threads;
+    int number_workers;
+    tile_queue *queue;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    pool_job job;
+    void *frame;
+    unsigned long generation;
+    int pending;
+    int quit;
+};
+
+int worker_pool_init(worker_pool *pool, int number_workers, tile_queue *queue);
+void worker_pool_render(worker_pool *pool, pool_job job, void *frame);
+void worker_pool_release(worker_pool *pool);
+
+#endif